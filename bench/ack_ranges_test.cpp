@@ -0,0 +1,412 @@
+// Correctness check of IKCP_CMD_ACK_RANGES in kcp_core
+// Covers the in-band negotiation with capable and old peers, how the acklist is merged into ranges and split by mtu,
+// how received ranges are clamped to the send window, and delivery over a lossy, duplicating and reordering link
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../src/3rd_party/ikcp.hpp"
+
+namespace
+{
+	constexpr uint32_t conv = 0x11223344;
+	constexpr uint8_t cmd_push = 81;
+	constexpr uint8_t cmd_ack = 82;
+	constexpr uint8_t cmd_ack_ranges = 85;
+	constexpr uint8_t ack_ranges_supported = 1;
+	constexpr size_t overhead = 24;
+
+	size_t failures = 0;
+
+	void fail(const char *test_name, const char *what)
+	{
+		if (failures++ < 16)
+			std::printf("  %s: %s\n", test_name, what);
+	}
+
+	struct wire_segment
+	{
+		uint8_t cmd;
+		uint8_t frg;
+		uint32_t ts;
+		uint32_t sn;
+		uint32_t una;
+		std::vector<std::pair<uint32_t, uint32_t>> ranges;	// IKCP_CMD_ACK_RANGES only
+	};
+
+	uint32_t read32(const std::string &data, size_t pos)
+	{
+		return (uint32_t)(uint8_t)data[pos] | (uint32_t)(uint8_t)data[pos + 1] << 8 |
+			(uint32_t)(uint8_t)data[pos + 2] << 16 | (uint32_t)(uint8_t)data[pos + 3] << 24;
+	}
+
+	uint16_t read16(const std::string &data, size_t pos)
+	{
+		return (uint16_t)((uint8_t)data[pos] | (uint8_t)data[pos + 1] << 8);
+	}
+
+	void write32(std::string &data, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			data.push_back((char)(value >> (i * 8)));
+	}
+
+	void write16(std::string &data, uint16_t value)
+	{
+		data.push_back((char)value);
+		data.push_back((char)(value >> 8));
+	}
+
+	std::vector<wire_segment> parse_datagram(const std::string &datagram)
+	{
+		std::vector<wire_segment> segments;
+		for (size_t pos = 0; pos + overhead <= datagram.size();)
+		{
+			wire_segment seg{ (uint8_t)datagram[pos + 4], (uint8_t)datagram[pos + 5],
+				read32(datagram, pos + 8), read32(datagram, pos + 12), read32(datagram, pos + 16), {} };
+			uint32_t len = read32(datagram, pos + 20);
+			pos += overhead;
+			if (seg.cmd == cmd_ack_ranges)
+			{
+				for (size_t range_pos = pos; range_pos + 6 <= pos + len; range_pos += 6)
+					seg.ranges.emplace_back(read32(datagram, range_pos), read16(datagram, range_pos + 4));
+			}
+			pos += len;
+			segments.push_back(std::move(seg));
+		}
+		return segments;
+	}
+
+	// 'sn' and 'ts' are the RTT echo of the header
+	std::string make_ack_ranges(uint32_t sn, uint32_t ts, uint32_t una, const std::vector<std::pair<uint32_t, uint16_t>> &ranges)
+	{
+		std::string datagram;
+		write32(datagram, conv);
+		datagram.push_back((char)cmd_ack_ranges);
+		datagram.push_back((char)ack_ranges_supported);
+		write16(datagram, 256);
+		write32(datagram, ts);
+		write32(datagram, sn);
+		write32(datagram, una);
+		write32(datagram, (uint32_t)(ranges.size() * 6));
+		for (auto [start, count] : ranges)
+		{
+			write32(datagram, start);
+			write16(datagram, count);
+		}
+		return datagram;
+	}
+
+	// A kcp_core that has been updated once, with its output collected in 'sent'
+	struct endpoint
+	{
+		KCP::kcp_core kcp;
+		std::vector<std::string> sent;
+
+		endpoint()
+		{
+			kcp.initialise(conv, nullptr);
+			kcp.set_output([this](const char *buf, int len, void *) { sent.emplace_back(buf, len); return 0; });
+			kcp.set_nodelay(1, 10, 2, 1);
+			kcp.set_wndsize(256, 256);
+			kcp.set_clock(1'000'000);
+			kcp.update(1000);
+		}
+
+		std::vector<wire_segment> flush_acklist(std::vector<std::pair<uint32_t, uint32_t>> acklist)
+		{
+			sent.clear();
+			kcp.acklist = std::move(acklist);
+			kcp.remote_ack_ranges = true;
+			kcp.flush();
+			std::vector<wire_segment> segments;
+			for (const std::string &datagram : sent)
+			{
+				auto parsed = parse_datagram(datagram);
+				segments.insert(segments.end(), parsed.begin(), parsed.end());
+			}
+			return segments;
+		}
+	};
+
+	std::vector<std::pair<uint32_t, uint32_t>> all_ranges(const std::vector<wire_segment> &segments)
+	{
+		std::vector<std::pair<uint32_t, uint32_t>> ranges;
+		for (const wire_segment &seg : segments)
+			if (seg.cmd == cmd_ack_ranges)
+				ranges.insert(ranges.end(), seg.ranges.begin(), seg.ranges.end());
+		return ranges;
+	}
+
+	void check_merge(std::mt19937 &rng)
+	{
+		const char *test_name = "merge";
+		// sn -> ts, with duplicates of retransmitted segments
+		std::vector<std::pair<uint32_t, uint32_t>> acklist;
+		for (uint32_t sn = 100; sn < 110; sn++)
+			acklist.emplace_back(sn, 500 + sn);
+		acklist.emplace_back(105, 900);
+		acklist.emplace_back(100, 700);
+		acklist.emplace_back(120, 600);
+		acklist.emplace_back(121, 601);
+		acklist.emplace_back(121, 602);
+		for (uint32_t sn = 200; sn < 203; sn++)
+			acklist.emplace_back(sn, 650);
+		std::shuffle(acklist.begin(), acklist.end(), rng);
+
+		endpoint receiver;
+		auto segments = receiver.flush_acklist(acklist);
+		std::vector<std::pair<uint32_t, uint32_t>> expected_ranges = { { 100, 10 }, { 120, 2 }, { 200, 3 } };
+		if (all_ranges(segments) != expected_ranges)
+			fail(test_name, "reordered and duplicated ACKs not merged into the expected ranges");
+		if (segments.size() != 1 || segments[0].cmd != cmd_ack_ranges)
+			fail(test_name, "expected exactly one IKCP_CMD_ACK_RANGES segment");
+		else if (segments[0].sn != 105 || segments[0].ts != 900)
+			fail(test_name, "RTT echo is not the newest timestamp");
+		if (!receiver.kcp.acklist.empty())
+			fail(test_name, "acklist not cleared");
+
+		// a run across the 32-bit wrap-around of sn
+		acklist = { { 1, 10 }, { 0xFFFFFFFE, 10 }, { 0, 10 }, { 0xFFFFFFFF, 10 }, { 0, 11 } };
+		segments = receiver.flush_acklist(acklist);
+		expected_ranges = { { 0xFFFFFFFE, 4 } };
+		if (all_ranges(segments) != expected_ranges)
+			fail(test_name, "range across the sn wrap-around not merged");
+	}
+
+	void check_mtu_split()
+	{
+		const char *test_name = "mtu split";
+		endpoint receiver;
+		receiver.kcp.set_mtu(100);
+		std::vector<std::pair<uint32_t, uint32_t>> acklist;
+		std::vector<std::pair<uint32_t, uint32_t>> expected_ranges;
+		for (uint32_t sn = 0; sn < 400; sn += 2)
+		{
+			acklist.emplace_back(sn, 1000 + sn);
+			expected_ranges.emplace_back(sn, 1);
+		}
+
+		auto segments = receiver.flush_acklist(acklist);
+		if (all_ranges(segments) != expected_ranges)
+			fail(test_name, "ranges lost or reordered when split");
+		if (receiver.sent.size() < 2)
+			fail(test_name, "ranges beyond the mtu were not split");
+		for (const std::string &datagram : receiver.sent)
+			if (datagram.size() > 100)
+				fail(test_name, "datagram larger than the mtu");
+		for (const wire_segment &seg : segments)
+		{
+			if (seg.ranges.empty())
+				fail(test_name, "empty range segment");
+			bool echoed = std::any_of(seg.ranges.begin(), seg.ranges.end(),
+				[&seg](const auto &range) { return seg.sn - range.first < range.second; });
+			if (!echoed || seg.ts != 1000 + seg.sn)
+				fail(test_name, "RTT echo is not one of the segment's own ranges");
+		}
+	}
+
+	void check_clamp()
+	{
+		const char *test_name = "clamp";
+		endpoint sender;
+		sender.kcp.rmt_wnd = 256;
+		char data[100] = {};
+		for (int i = 0; i < 10; i++)
+			sender.kcp.send(data, sizeof(data));
+		sender.kcp.set_clock(1'010'000);
+		sender.kcp.update(1010);
+		if (sender.kcp.snd_una != 0 || sender.kcp.snd_nxt != 10)
+		{
+			fail(test_name, "segments 0 to 9 not sent");
+			return;
+		}
+
+		std::string datagram = make_ack_ranges(0, 1010, 0, { { 0, 3 } });
+		sender.kcp.input(datagram.data(), (long)datagram.size());
+		if (sender.kcp.snd_una != 3)
+			fail(test_name, "plain range not acknowledged");
+
+		// straddles snd_una, straddles snd_nxt, lies behind snd_nxt, and an empty range
+		datagram = make_ack_ranges(3, 1010, 0, { { 0xFFFFFFF0, 0x15 }, { 8, 0xFFFF }, { 50, 10 }, { 6, 0 } });
+		if (sender.kcp.input(datagram.data(), (long)datagram.size()) != 0)
+			fail(test_name, "valid range segment rejected");
+		if (sender.kcp.snd_una != 5 || sender.kcp.snd_nxt != 10 || sender.kcp.get_waitsnd() != 3)
+			fail(test_name, "ranges outside snd_una and snd_nxt not clamped");
+
+		datagram = make_ack_ranges(6, 1010, 0, { { 6, 1 } });
+		datagram.push_back(0);
+		datagram[20]++;	// length no longer a multiple of a range
+		if (sender.kcp.input(datagram.data(), (long)datagram.size()) >= 0)
+			fail(test_name, "truncated range accepted");
+		if (sender.kcp.get_waitsnd() != 3)
+			fail(test_name, "truncated range acknowledged segments");
+	}
+
+	struct peer_stats
+	{
+		size_t plain_acks = 0;
+		size_t range_acks = 0;
+		size_t plain_acks_after_ranges = 0;
+	};
+
+	// Drops, duplicates and delays datagrams, and delivers each batch in random order
+	struct lossy_link
+	{
+		std::deque<std::string> delayed;
+
+		void deliver(std::vector<std::string> &sent, KCP::kcp_core &destination, std::mt19937 &rng)
+		{
+			std::vector<std::string> arriving(delayed.begin(), delayed.end());
+			delayed.clear();
+			for (std::string &datagram : sent)
+			{
+				uint32_t dice = rng() % 100;
+				if (dice < 10)
+					continue;
+				if (dice < 20)
+					arriving.push_back(datagram);
+				if (dice >= 80)
+					delayed.push_back(std::move(datagram));
+				else
+					arriving.push_back(std::move(datagram));
+			}
+			sent.clear();
+			std::shuffle(arriving.begin(), arriving.end(), rng);
+			for (const std::string &datagram : arriving)
+				destination.input(datagram.data(), (long)datagram.size());
+		}
+	};
+
+	void count_acks(const std::vector<std::string> &sent, peer_stats &stats)
+	{
+		for (const std::string &datagram : sent)
+		{
+			for (const wire_segment &seg : parse_datagram(datagram))
+			{
+				if (seg.cmd == cmd_ack)
+				{
+					stats.plain_acks++;
+					if (stats.range_acks > 0)
+						stats.plain_acks_after_ranges++;
+				}
+				else if (seg.cmd == cmd_ack_ranges)
+					stats.range_acks++;
+			}
+		}
+	}
+
+	// Mimics a peer without IKCP_CMD_ACK_RANGES: its ACK, WASK and WINS never carry the flag
+	void strip_flag(std::vector<std::string> &sent)
+	{
+		for (std::string &datagram : sent)
+		{
+			for (size_t pos = 0; pos + overhead <= datagram.size(); pos += overhead + read32(datagram, pos + 20))
+				if ((uint8_t)datagram[pos + 4] != cmd_push)
+					datagram[pos + 5] = 0;
+		}
+	}
+
+	std::string make_message(uint32_t index)
+	{
+		std::string message(1 + (index * 37) % 3000, '\0');
+		for (size_t i = 0; i < message.size(); i++)
+			message[i] = (char)(index + i * 7);
+		return message;
+	}
+
+	// A sends 'message_count' messages to B, and B to A if 'both_ways' is set
+	// One way, A sends no ACKs, so B can only learn the flag from the WINS that answers its plain ACKs
+	// 'b_is_old' makes B behave like a peer without ranges
+	void check_transfer(const char *test_name, bool both_ways, bool b_is_old, std::mt19937 &rng)
+	{
+		constexpr uint32_t message_count = 3000;
+		uint32_t b_message_count = both_ways ? message_count : 0;
+		endpoint a, b;
+		lossy_link a_to_b, b_to_a;
+		peer_stats a_stats, b_stats;
+		uint32_t a_next = 0, b_next = 0, a_received = 0, b_received = 0;
+		std::vector<char> buffer(4096);
+		bool mismatch = false;
+
+		uint64_t current_us = 1'000'000;
+		for (int step = 0; step < 100000 && (a_received < b_message_count || b_received < message_count); step++)
+		{
+			for (; a_next < message_count && a.kcp.get_waitsnd() < 512; a_next++)
+			{
+				std::string message = make_message(a_next);
+				a.kcp.send(message.data(), (int)message.size());
+			}
+			for (; b_next < b_message_count && b.kcp.get_waitsnd() < 512; b_next++)
+			{
+				std::string message = make_message(b_next + message_count);
+				b.kcp.send(message.data(), (int)message.size());
+			}
+
+			current_us += 5000;
+			a.kcp.set_clock(current_us);
+			b.kcp.set_clock(current_us);
+			a.kcp.update((uint32_t)(current_us / 1000));
+			b.kcp.update((uint32_t)(current_us / 1000));
+
+			if (b_is_old)
+				strip_flag(b.sent);
+			count_acks(a.sent, a_stats);
+			count_acks(b.sent, b_stats);
+			a_to_b.deliver(a.sent, b.kcp, rng);
+			b_to_a.deliver(b.sent, a.kcp, rng);
+			if (b_is_old)
+				b.kcp.remote_ack_ranges = false;
+
+			for (int size; (size = b.kcp.receive(buffer.data(), (int)buffer.size())) > 0; b_received++)
+				mismatch |= std::string(buffer.data(), size) != make_message(b_received);
+			for (int size; (size = a.kcp.receive(buffer.data(), (int)buffer.size())) > 0; a_received++)
+				mismatch |= std::string(buffer.data(), size) != make_message(a_received + message_count);
+		}
+
+		if (a_received != b_message_count || b_received != message_count)
+			fail(test_name, "not all messages delivered");
+		if (mismatch)
+			fail(test_name, "messages corrupted or out of order");
+		if (b_is_old)
+		{
+			if (a_stats.range_acks != 0)
+				fail(test_name, "range ACKs sent to a peer that never set the flag");
+			if (both_ways && a_stats.plain_acks == 0)
+				fail(test_name, "no plain ACKs sent to the old peer");
+			if (a.kcp.remote_ack_ranges)
+				fail(test_name, "flag of the old peer seen");
+		}
+		else
+		{
+			if (!a.kcp.remote_ack_ranges || !b.kcp.remote_ack_ranges)
+				fail(test_name, "capable peers did not negotiate ranges");
+			if ((both_ways && a_stats.range_acks == 0) || b_stats.range_acks == 0)
+				fail(test_name, "capable peers did not switch to range ACKs");
+			if (a_stats.plain_acks_after_ranges != 0 || b_stats.plain_acks_after_ranges != 0)
+				fail(test_name, "plain ACKs sent after switching to ranges");
+		}
+
+		std::printf("%s: %u/%u and %u/%u messages, A sent %zu plain and %zu range ACKs, B sent %zu plain and %zu range ACKs\n",
+			test_name, b_received, message_count, a_received, b_message_count,
+			a_stats.plain_acks, a_stats.range_acks, b_stats.plain_acks, b_stats.range_acks);
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	check_merge(rng);
+	check_mtu_split();
+	check_clamp();
+	check_transfer("capable peers", true, false, rng);
+	check_transfer("capable peers, one way", false, false, rng);
+	check_transfer("old peer", true, true, rng);
+	check_transfer("old peer, one way", false, true, rng);
+	std::printf("%zu failures\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+// Time spent in kcp_core per segment with full send and receive windows of 1k, 8k and 32k segments
+// Segments and ACKs are delivered in reverse order, so every lookup lands in the middle of a window
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../src/3rd_party/ikcp.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static double nanoseconds_between(bench_clock::time_point start, bench_clock::time_point end)
+{
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+static void run_window(int window_size)
+{
+	constexpr int warm_up_rounds = 2;
+	constexpr int rounds = 40;
+	double send_time = 0, flush_time = 0, input_data_time = 0, input_ack_time = 0;
+	long segment_count = 0;
+
+	KCP::kcp_core sender, receiver;
+	std::vector<std::string> to_receiver, to_sender;
+	sender.initialise(1, nullptr);
+	receiver.initialise(1, nullptr);
+	sender.set_output([&](const char *buf, int len, void *) { to_receiver.emplace_back(buf, len); return 0; });
+	receiver.set_output([&](const char *buf, int len, void *) { to_sender.emplace_back(buf, len); return 0; });
+	sender.set_nodelay(1, 10, 2, 1);
+	receiver.set_nodelay(1, 10, 2, 1);
+	sender.set_wndsize(window_size, window_size);
+	receiver.set_wndsize(window_size, window_size);
+	sender.rmt_wnd = window_size;
+
+	char data[1300] = {};
+	static char received[1 << 20];
+	uint64_t current_us = 1'000'000;
+	for (int round = 0; round < warm_up_rounds + rounds; ++round)
+	{
+		auto send_start = bench_clock::now();
+		for (int i = 0; i < window_size; ++i)
+			sender.send(data, sizeof(data));
+		auto send_end = bench_clock::now();
+
+		current_us += 1000;
+		sender.set_clock(current_us);
+		receiver.set_clock(current_us);
+		auto flush_start = bench_clock::now();
+		sender.update((uint32_t)(current_us / 1000));
+		sender.flush();
+		auto flush_end = bench_clock::now();
+
+		auto input_data_start = bench_clock::now();
+		for (size_t i = to_receiver.size(); i-- > 0;)
+			receiver.input(to_receiver[i].data(), (long)to_receiver[i].size());
+		auto input_data_end = bench_clock::now();
+		to_receiver.clear();
+		while (receiver.receive(received, sizeof(received)) > 0) {}
+		receiver.update((uint32_t)(current_us / 1000));
+		receiver.flush();
+
+		auto input_ack_start = bench_clock::now();
+		for (size_t i = to_sender.size(); i-- > 0;)
+			sender.input(to_sender[i].data(), (long)to_sender[i].size());
+		auto input_ack_end = bench_clock::now();
+		to_sender.clear();
+
+		if (round < warm_up_rounds)
+			continue;
+		send_time += nanoseconds_between(send_start, send_end);
+		flush_time += nanoseconds_between(flush_start, flush_end);
+		input_data_time += nanoseconds_between(input_data_start, input_data_end);
+		input_ack_time += nanoseconds_between(input_ack_start, input_ack_end);
+		segment_count += window_size;
+	}
+
+	std::printf("window %5d: send %6.1f ns/seg, flush %6.1f ns/seg, input data %6.1f ns/seg, input ack %6.1f ns/seg, unacknowledged %d\n",
+		window_size, send_time / segment_count, flush_time / segment_count, input_data_time / segment_count, input_ack_time / segment_count, sender.get_waitsnd());
+}
+
+int main()
+{
+	for (int window_size : { 1024, 8192, 32768 })
+		run_window(window_size);
+	return 0;
+}
@@ -0,0 +1,177 @@
+// ttp::task_group_pool against the earlier design: one std::list per worker thread behind a mutex, a condition variable signalled for every task
+// Measures throughput of keyed tasks with several producers, and the wake-up latency of a single task pushed to a parked pool
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../src/3rd_party/thread_pool.hpp"
+
+namespace
+{
+	using bench_clock = std::chrono::steady_clock;
+
+	class list_group_pool
+	{
+	public:
+		explicit list_group_pool(size_t thread_count) : queues(thread_count)
+		{
+			for (size_t i = 0; i < thread_count; ++i)
+				threads.emplace_back(&list_group_pool::worker, this, i);
+		}
+
+		~list_group_pool()
+		{
+			wait_for_tasks();
+			for (per_thread_queue &queue : queues)
+			{
+				std::scoped_lock locker{ queue.mutex_tasks };
+				queue.running = false;
+				queue.task_available.notify_all();
+			}
+			for (std::thread &thread : threads)
+				thread.join();
+		}
+
+		template<typename F>
+		void push_task(size_t number, F &&task_function, packet_buffer data)
+		{
+			per_thread_queue &queue = queues[number % queues.size()];
+			{
+				std::scoped_lock locker{ queue.mutex_tasks };
+				queue.tasks.emplace_back(std::forward<F>(task_function), std::move(data));
+				++queue.tasks_total;
+			}
+			queue.task_available.notify_one();
+		}
+
+		size_t get_task_count(size_t number) const
+		{
+			return queues[number % queues.size()].tasks_total.load();
+		}
+
+		void wait_for_tasks()
+		{
+			for (per_thread_queue &queue : queues)
+			{
+				std::unique_lock locker{ queue.mutex_tasks };
+				queue.task_done.wait(locker, [&queue] { return queue.tasks_total.load() == 0; });
+			}
+		}
+
+	private:
+		struct per_thread_queue
+		{
+			std::mutex mutex_tasks;
+			std::condition_variable task_available;
+			std::condition_variable task_done;
+			std::list<std::pair<std::function<void(packet_buffer)>, packet_buffer>> tasks;
+			std::atomic<size_t> tasks_total{ 0 };
+			bool running = true;
+		};
+
+		void worker(size_t thread_number)
+		{
+			per_thread_queue &queue = queues[thread_number];
+			std::unique_lock locker{ queue.mutex_tasks };
+			while (true)
+			{
+				queue.task_available.wait(locker, [&queue] { return !queue.tasks.empty() || !queue.running; });
+				if (queue.tasks.empty())
+					return;
+				auto [task_function, data] = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+				locker.unlock();
+				task_function(std::move(data));
+				locker.lock();
+				--queue.tasks_total;
+				queue.task_done.notify_all();
+			}
+		}
+
+		std::vector<per_thread_queue> queues;
+		std::vector<std::thread> threads;
+	};
+
+	// Every producer uses its own key, so the tasks of one producer must run in order
+	template<typename Pool>
+	double keyed_throughput(size_t producer_count, size_t tasks_per_producer, size_t worker_count, bool &ordered)
+	{
+		std::vector<std::atomic<size_t>> next_index(producer_count);
+		std::atomic<bool> out_of_order = false;
+		auto start = bench_clock::now();
+		{
+			Pool pool(worker_count);
+			std::vector<std::thread> producers;
+			for (size_t producer = 0; producer < producer_count; ++producer)
+			{
+				producers.emplace_back([&, producer]()
+					{
+						for (size_t i = 0; i < tasks_per_producer; ++i)
+						{
+							while (pool.get_task_count(producer) > 2048)
+								std::this_thread::yield();
+							packet_buffer data = make_packet_buffer(64);
+							pool.push_task(producer, [&, producer, i](packet_buffer)
+								{
+									if (next_index[producer].load(std::memory_order_relaxed) != i)
+										out_of_order = true;
+									next_index[producer].store(i + 1, std::memory_order_relaxed);
+								}, std::move(data));
+						}
+					});
+			}
+			for (std::thread &producer : producers)
+				producer.join();
+		}
+		ordered = !out_of_order;
+		return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / (double)(producer_count * tasks_per_producer);
+	}
+
+	// One task at a time, the pool has gone idle before each push
+	template<typename Pool>
+	double parked_wake_up(size_t worker_count, size_t rounds)
+	{
+		Pool pool(worker_count);
+		std::atomic<bool> done = false;
+		double total_time = 0;
+		for (size_t round = 0; round < rounds; ++round)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			done.store(false);
+			auto start = bench_clock::now();
+			pool.push_task(round, [&done](packet_buffer) { done.store(true, std::memory_order_release); }, nullptr);
+			while (!done.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			total_time += std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+		}
+		return total_time / (double)rounds;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	size_t producer_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+	size_t worker_count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+	size_t tasks_per_producer = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 500000;
+
+	for (int round = 0; round < 3; ++round)
+	{
+		bool list_ordered = false, ring_ordered = false;
+		double list_time = keyed_throughput<list_group_pool>(producer_count, tasks_per_producer, worker_count, list_ordered);
+		double ring_time = keyed_throughput<ttp::task_group_pool>(producer_count, tasks_per_producer, worker_count, ring_ordered);
+		std::printf("%zu producers, %zu workers: std::list pool %6.1f ns/task (ordered %d), task_ring pool %6.1f ns/task (ordered %d)\n",
+			producer_count, worker_count, list_time, list_ordered, ring_time, ring_ordered);
+	}
+
+	double list_wake_up = parked_wake_up<list_group_pool>(worker_count, 5000);
+	double ring_wake_up = parked_wake_up<ttp::task_group_pool>(worker_count, 5000);
+	std::printf("wake-up of a parked pool: std::list pool %.0f ns, task_ring pool %.0f ns\n", list_wake_up, ring_wake_up);
+	return 0;
+}
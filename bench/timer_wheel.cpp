@@ -0,0 +1,67 @@
+// Cost of KCP::timer_wheel operations with 100k sessions (or the count given on the command line)
+// Sessions are updated every 1 to 100 ms of virtual time, as KCP::UpdateCheck() would ask for
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include "../src/networks/kcp_updater.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static double nanoseconds_each(bench_clock::time_point start, bench_clock::time_point end, size_t count)
+{
+	return std::chrono::duration<double, std::nano>(end - start).count() / (double)count;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t session_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	constexpr uint32_t virtual_duration = 10000;	// milliseconds
+
+	std::vector<std::shared_ptr<KCP::KCP>> sessions;
+	for (size_t i = 0; i < session_count; ++i)
+		sessions.push_back(std::make_shared<KCP::KCP>((uint32_t)i + 1));
+
+	std::mt19937 rng(7);
+	KCP::timer_wheel wheel;
+	uint32_t current_time = KCP::TimeNowForKCP();
+
+	auto schedule_start = bench_clock::now();
+	for (std::shared_ptr<KCP::KCP> &kcp_ptr : sessions)
+		wheel.schedule(kcp_ptr, current_time + 1 + rng() % 100);
+	auto schedule_end = bench_clock::now();
+
+	// an earlier time moves the session, a later one leaves it where it is
+	auto reschedule_start = bench_clock::now();
+	for (std::shared_ptr<KCP::KCP> &kcp_ptr : sessions)
+		wheel.schedule(kcp_ptr, current_time + 1 + rng() % 100);
+	auto reschedule_end = bench_clock::now();
+
+	size_t update_count = 0;
+	KCP::timer_wheel::due_list due_kcp;
+	auto advance_start = bench_clock::now();
+	for (uint32_t elapsed = 1; elapsed <= virtual_duration; ++elapsed)
+	{
+		wheel.advance(current_time + elapsed, due_kcp);
+		for (auto &[node, kcp_weak] : due_kcp)
+			wheel.finish(node, kcp_weak.lock().get(), current_time + elapsed + 1 + rng() % 100);
+		update_count += due_kcp.size();
+		due_kcp.clear();
+	}
+	auto advance_end = bench_clock::now();
+
+	auto cancel_start = bench_clock::now();
+	for (std::shared_ptr<KCP::KCP> &kcp_ptr : sessions)
+		wheel.cancel(kcp_ptr.get());
+	auto cancel_end = bench_clock::now();
+
+	std::printf("%zu sessions: schedule %.1f ns, reschedule %.1f ns, cancel %.1f ns each\n", session_count,
+		nanoseconds_each(schedule_start, schedule_end, session_count),
+		nanoseconds_each(reschedule_start, reschedule_end, session_count),
+		nanoseconds_each(cancel_start, cancel_end, session_count));
+	std::printf("%zu updates in %u ms of virtual time: %.1f ns per update for advance() and finish()\n",
+		update_count, virtual_duration, nanoseconds_each(advance_start, advance_end, update_count));
+	return 0;
+}
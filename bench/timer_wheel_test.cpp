@@ -0,0 +1,169 @@
+// Correctness check of KCP::timer_wheel through its public interface
+// Starts next to the 8, 16, 24 and 32-bit boundaries, so every level cascades and the time wraps around,
+// and cancels sessions while they are scheduled, while they are being updated and after they have been given back
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include "../src/networks/kcp_updater.hpp"
+
+namespace
+{
+	using KCP::timer_wheel;
+
+	constexpr uint32_t far_away = 0x40000000;
+
+	// Moves the wheel to 'target'; the parked session keeps it from starting over at the current clock
+	void move_wheel(timer_wheel &wheel, uint32_t &current_time, uint32_t target)
+	{
+		timer_wheel::due_list due_kcp;
+		while (current_time != target)
+		{
+			current_time += std::min<uint32_t>(target - current_time, far_away);
+			wheel.advance(current_time, due_kcp);
+			for (auto &[node, kcp_weak] : due_kcp)
+				wheel.finish(node, kcp_weak.lock().get(), current_time + far_away);
+			due_kcp.clear();
+		}
+	}
+
+	size_t run_from(uint32_t start_time, std::mt19937 &rng)
+	{
+		size_t failures = 0;
+		auto fail = [&failures](const char *what, uint32_t current_time, uint32_t expected_time)
+			{
+				if (failures++ < 8)
+					std::printf("  %s: now %08x, expected %08x\n", what, current_time, expected_time);
+			};
+
+		timer_wheel wheel;
+		uint32_t current_time = KCP::TimeNowForKCP();
+		std::shared_ptr<KCP::KCP> parked = std::make_shared<KCP::KCP>();
+		wheel.schedule(parked, current_time + far_away);
+		move_wheel(wheel, current_time, start_time);
+
+		constexpr size_t session_count = 20000;
+		std::unordered_map<const KCP::KCP *, std::shared_ptr<KCP::KCP>> sessions;
+		std::unordered_map<const KCP::KCP *, uint32_t> expected;
+		for (size_t i = 0; i < session_count; ++i)
+		{
+			std::shared_ptr<KCP::KCP> kcp_ptr = std::make_shared<KCP::KCP>();
+			uint32_t selector = rng() % 20;
+			uint32_t delay = selector < 15 ? rng() % 3000 : selector < 19 ? rng() % 70000 : rng() % 0x01100000;
+			uint32_t expire_time = start_time + delay;
+			wheel.schedule(kcp_ptr, expire_time);
+			if (i % 7 == 0)
+			{
+				// scheduling again keeps the earlier time
+				uint32_t another_time = start_time + rng() % 3000;
+				wheel.schedule(kcp_ptr, another_time);
+				if ((int32_t)(another_time - expire_time) < 0)
+					expire_time = another_time;
+			}
+			expected[kcp_ptr.get()] = expire_time;
+			sessions[kcp_ptr.get()] = kcp_ptr;
+			if (i % 13 == 0)
+			{
+				wheel.cancel(kcp_ptr.get());
+				expected.erase(kcp_ptr.get());
+			}
+		}
+
+		size_t expected_total = expected.size();
+		size_t fired = 0;
+		size_t given_back = 0;
+		timer_wheel::due_list due_kcp;
+		uint32_t previous_time = start_time - 1;	// timers at the start time are already due
+		for (uint32_t elapsed = 0; elapsed < 0x01200000 && !expected.empty();)
+		{
+			uint32_t step = elapsed < 80000 ? (elapsed % 5 == 0 ? 3 : 1) : 997;
+			elapsed += step;
+			current_time = start_time + elapsed;
+			wheel.advance(current_time, due_kcp);
+
+			size_t index = 0;
+			for (auto &[node, kcp_weak] : due_kcp)
+			{
+				std::shared_ptr<KCP::KCP> kcp_ptr = kcp_weak.lock();
+				if (kcp_ptr == parked)
+				{
+					wheel.finish(node, kcp_ptr.get(), current_time + far_away);
+					continue;
+				}
+
+				++index;
+				auto iter = expected.find(kcp_ptr.get());
+				if (iter == expected.end())
+				{
+					fail("unexpected or repeated timer", current_time, 0);
+					wheel.finish(node, kcp_ptr.get(), current_time + far_away);
+					continue;
+				}
+				if ((int32_t)(iter->second - previous_time) <= 0 || (int32_t)(current_time - iter->second) < 0)
+					fail("timer out of its step", current_time, iter->second);
+				expected.erase(iter);
+				++fired;
+
+				if (index % 3 == 0)
+				{
+					// removed while being updated, finish() deletes the node
+					wheel.cancel(kcp_ptr.get());
+					wheel.finish(node, kcp_ptr.get(), current_time + far_away);
+				}
+				else if (index % 3 == 1)
+				{
+					// the KCP is gone
+					sessions.erase(kcp_ptr.get());
+					kcp_ptr.reset();
+					wheel.finish(node, kcp_weak.lock().get(), 0);
+				}
+				else
+				{
+					wheel.finish(node, kcp_ptr.get(), current_time + far_away);
+					if (index % 2 == 0)
+						wheel.cancel(kcp_ptr.get());
+					else
+						++given_back;
+				}
+			}
+			due_kcp.clear();
+
+			uint32_t next_time = wheel.next_expire_time();
+			if ((int32_t)(next_time - current_time) <= 0)
+				fail("next expire time in the past", current_time, next_time);
+			if (elapsed % 64 == 0 && !expected.empty())
+			{
+				auto earliest = std::min_element(expected.begin(), expected.end(),
+					[current_time](const auto &a, const auto &b) { return (int32_t)(a.second - current_time) < (int32_t)(b.second - current_time); });
+				if ((int32_t)(earliest->second - next_time) < 0)
+					fail("next expire time after a due timer", next_time, earliest->second);
+			}
+			previous_time = current_time;
+		}
+
+		if (!expected.empty())
+			fail("timers never fired", current_time, expected.begin()->second);
+		if (wheel.size() != given_back + 1)
+			fail("wrong session count", (uint32_t)wheel.size(), (uint32_t)(given_back + 1));
+
+		for (auto &[kcp_raw_ptr, kcp_ptr] : sessions)
+			wheel.cancel(kcp_ptr.get());
+		wheel.cancel(parked.get());
+		if (wheel.size() != 0)
+			fail("sessions left after cancelling all", (uint32_t)wheel.size(), 0);
+
+		std::printf("start %08x: %zu/%zu fired, %zu failures\n", start_time, fired, expected_total, failures);
+		return failures;
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	size_t failures = 0;
+	for (uint32_t start_time : { 0x00000000u, 0x000000F0u, 0x0000FF00u, 0x00FFFF00u, 0x12345678u, 0xFFFF0000u, 0xFFFFF000u, 0xFFFFFFF0u })
+		failures += run_from(start_time, rng);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+// CPU time per Gbit of udp_send_queue::send() on loopback: UDP GSO (send_segmented), plain sendmmsg, and one sendto() per datagram
+// Only the sending thread is measured; nothing reads the receiving socket, so the kernel drops what does not fit
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/networks/connections.hpp"
+
+namespace
+{
+	constexpr double bits_per_gbit = 1e9;
+
+	double thread_cpu_seconds()
+	{
+		timespec now{};
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+		return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+	}
+
+	std::vector<udp_outgoing_datagram> make_batch(const std::vector<uint8_t> &payload, size_t batch_size, const udp::endpoint &peer)
+	{
+		std::vector<udp_outgoing_datagram> datagrams;
+		for (size_t i = 0; i < batch_size; ++i)
+			datagrams.push_back({ nullptr, nullptr, payload.data(), payload.size(), peer });
+		return datagrams;
+	}
+
+	void report(const char *name, double cpu_seconds, size_t bytes)
+	{
+		double gbits = (double)bytes * 8 / bits_per_gbit;
+		std::printf("%-22s %8.1f ms CPU per Gbit (%.1f Gbit sent)\n", name, cpu_seconds * 1000 / gbits, gbits);
+	}
+
+	void run_queue(const char *name, asio::io_context &ioc, bool gso, int socket_fd, const std::vector<uint8_t> &payload, size_t batch_size, size_t batch_count, const udp::endpoint &peer)
+	{
+		udp_send_queue send_queue(ioc.get_executor(), batch_size, std::chrono::microseconds(100), gso);
+		size_t bytes = 0;
+		double start = thread_cpu_seconds();
+		for (size_t round = 0; round < batch_count; ++round)
+		{
+			std::vector<udp_outgoing_datagram> datagrams = make_batch(payload, batch_size, peer);
+			while (!datagrams.empty())
+			{
+				size_t sent = send_queue.send(socket_fd, datagrams);
+				datagrams.erase(datagrams.begin(), datagrams.begin() + sent);
+			}
+			bytes += payload.size() * batch_size;
+		}
+		report(name, thread_cpu_seconds() - start, bytes);
+	}
+
+	void run_sendto(int socket_fd, const std::vector<uint8_t> &payload, size_t datagram_count, const udp::endpoint &peer)
+	{
+		size_t bytes = 0;
+		double start = thread_cpu_seconds();
+		for (size_t i = 0; i < datagram_count; ++i)
+		{
+			if (sendto(socket_fd, payload.data(), payload.size(), 0, peer.data(), (socklen_t)peer.size()) > 0)
+				bytes += payload.size();
+		}
+		report("sendto() each", thread_cpu_seconds() - start, bytes);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	size_t datagram_size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1400;
+	size_t batch_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : gbv_gso_segments_max;
+	size_t batch_count = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 20000;
+
+	int receiver_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	int sender_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in receiver_address{};
+	receiver_address.sin_family = AF_INET;
+	receiver_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t address_length = sizeof(receiver_address);
+	if (receiver_fd < 0 || sender_fd < 0 ||
+		bind(receiver_fd, (sockaddr *)&receiver_address, sizeof(receiver_address)) != 0 ||
+		getsockname(receiver_fd, (sockaddr *)&receiver_address, &address_length) != 0)
+	{
+		std::perror("loopback sockets");
+		return 1;
+	}
+	udp::endpoint peer(asio::ip::address_v4::loopback(), ntohs(receiver_address.sin_port));
+
+	asio::io_context ioc;
+	std::vector<uint8_t> payload(datagram_size, 0x5a);
+	std::printf("%zu-byte datagrams, batches of %zu\n", datagram_size, batch_size);
+	run_queue("send_segmented (GSO)", ioc, true, sender_fd, payload, batch_size, batch_count, peer);
+	run_queue("sendmmsg", ioc, false, sender_fd, payload, batch_size, batch_count, peer);
+	run_sendto(sender_fd, payload, batch_size * batch_count, peer);
+
+	close(sender_fd);
+	close(receiver_fd);
+	return 0;
+}
@@ -17,6 +17,9 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <algorithm>
+#include <limits>
+#include <new>
 
 
 //---------------------------------------------------------------------
@@ -67,6 +70,9 @@ constexpr uint32_t IKCP_CMD_PUSH = 81;		// cmd: push data
 constexpr uint32_t IKCP_CMD_ACK = 82;		// cmd: ack
 constexpr uint32_t IKCP_CMD_WASK = 83;		// cmd: window probe (ask)
 constexpr uint32_t IKCP_CMD_WINS = 84;		// cmd: window size (tell)
+constexpr uint32_t IKCP_CMD_ACK_RANGES = 85;	// cmd: ack of sn ranges, only sent to a peer that reads them
+constexpr uint32_t IKCP_ACK_RANGES_SUPPORTED = 1;	// frg of ACK, WASK and WINS: the sender reads IKCP_CMD_ACK_RANGES
+constexpr uint32_t IKCP_ACK_RANGE_SIZE = 6;	// 32-bit start sn, 16-bit count
 constexpr uint32_t IKCP_ASK_SEND = 1;		// need to send IKCP_CMD_WASK
 constexpr uint32_t IKCP_ASK_TELL = 2;		// need to send IKCP_CMD_WINS
 constexpr uint32_t IKCP_WND_SND = 32;
@@ -195,6 +201,170 @@ void ikcp_qprint(const char *name, const struct IQUEUEHEAD *head)
 
 namespace KCP
 {
+	void segment_deleter::operator()(segment *seg) const
+	{
+		if (seg->owner != nullptr)
+			seg->owner->release(seg);
+		else
+			delete seg;
+	}
+
+	segment_pool::~segment_pool()
+	{
+		for (void *block : cached_blocks)
+			::operator delete(block);
+	}
+
+	segment_ptr segment_pool::make(uint32_t len)
+	{
+		void *block = nullptr;
+		if (cached_blocks.empty())
+		{
+			block = ::operator new(sizeof(segment) + payload_size);
+		}
+		else
+		{
+			block = cached_blocks.back();
+			cached_blocks.pop_back();
+		}
+
+		segment_ptr seg{ new (block) segment };
+		seg->data = (char *)block + sizeof(segment);
+		seg->capacity = payload_size;
+		seg->inline_capacity = payload_size;
+		seg->owner = this;
+		if (!seg->resize(len))
+			return nullptr;
+		seg->len = len;
+		return seg;
+	}
+
+	void segment_pool::release(segment *seg)
+	{
+		bool reusable = seg->inline_capacity == payload_size && cached_blocks.size() < cache_limit;
+		seg->~segment();
+		if (reusable)
+			cached_blocks.push_back(seg);
+		else
+			::operator delete(seg);
+	}
+
+	void segment_pool::set_payload_size(uint32_t new_payload_size)
+	{
+		if (new_payload_size == payload_size)
+			return;
+		for (void *block : cached_blocks)
+			::operator delete(block);
+		cached_blocks.clear();
+		payload_size = new_payload_size;
+	}
+
+	void retransmit_heap::push(segment *seg)
+	{
+		heap.push_back(seg);
+		seg->resend_index = (uint32_t)(heap.size() - 1);
+		sift_up(seg->resend_index);
+	}
+
+	segment* retransmit_heap::pop()
+	{
+		segment *seg = heap.front();
+		erase(seg);
+		return seg;
+	}
+
+	void retransmit_heap::erase(segment *seg)
+	{
+		uint32_t index = seg->resend_index;
+		if (index == UINT32_MAX)
+			return;
+		seg->resend_index = UINT32_MAX;
+
+		segment *last = heap.back();
+		heap.pop_back();
+		if (last == seg)
+			return;
+		place(index, last);
+		update(last);
+	}
+
+	void retransmit_heap::update(segment *seg)
+	{
+		uint32_t index = seg->resend_index;
+		if (index > 0 && _itimediff(seg->resendts, heap[(index - 1) / 2]->resendts) < 0)
+			sift_up(index);
+		else
+			sift_down(index);
+	}
+
+	void retransmit_heap::sift_up(uint32_t index)
+	{
+		segment *seg = heap[index];
+		while (index > 0)
+		{
+			uint32_t parent = (index - 1) / 2;
+			if (_itimediff(seg->resendts, heap[parent]->resendts) >= 0)
+				break;
+			place(index, heap[parent]);
+			index = parent;
+		}
+		place(index, seg);
+	}
+
+	void retransmit_heap::sift_down(uint32_t index)
+	{
+		segment *seg = heap[index];
+		uint32_t count = (uint32_t)heap.size();
+		while (true)
+		{
+			uint32_t child = index * 2 + 1;
+			if (child >= count)
+				break;
+			if (child + 1 < count && _itimediff(heap[child + 1]->resendts, heap[child]->resendts) < 0)
+				child++;
+			if (_itimediff(heap[child]->resendts, seg->resendts) >= 0)
+				break;
+			place(index, heap[child]);
+			index = child;
+		}
+		place(index, seg);
+	}
+
+	void retransmit_heap::place(uint32_t index, segment *seg)
+	{
+		heap[index] = seg;
+		seg->resend_index = index;
+	}
+
+	void fastack_list::push_back(segment *seg)
+	{
+		seg->fastack_prev = tail;
+		seg->fastack_next = nullptr;
+		if (tail != nullptr)
+			tail->fastack_next = seg;
+		else
+			head = seg;
+		tail = seg;
+		seg->fastack_listed = true;
+	}
+
+	void fastack_list::erase(segment *seg)
+	{
+		if (!seg->fastack_listed)
+			return;
+		if (seg->fastack_prev != nullptr)
+			seg->fastack_prev->fastack_next = seg->fastack_next;
+		else
+			head = seg->fastack_next;
+		if (seg->fastack_next != nullptr)
+			seg->fastack_next->fastack_prev = seg->fastack_prev;
+		else
+			tail = seg->fastack_prev;
+		seg->fastack_prev = nullptr;
+		seg->fastack_next = nullptr;
+		seg->fastack_listed = false;
+	}
+
 	// write log
 	void kcp_core::ikcp_log(int mask, const char *fmt, ...)
 	{
@@ -245,6 +415,7 @@ namespace KCP
 		this->cwnd = 0;
 		this->incr = 0;
 		this->probe = 0;
+		this->remote_ack_ranges = false;
 		this->mtu = IKCP_MTU_DEF;
 		this->mss = this->mtu - IKCP_OVERHEAD;
 		this->stream = 0;
@@ -252,13 +423,17 @@ namespace KCP
 		this->buffer = std::make_unique<char[]>((this->mtu + IKCP_OVERHEAD) * 3);
 		if (this->buffer == nullptr)
 			return false;
+		this->segments.set_payload_size(this->mss);
 
 		this->state = 0;
 		this->rx_srtt = 0;
 		this->rx_rttval = 0;
+		this->rx_srtt_us = 0;
+		this->rx_rttval_us = 0;
 		this->rx_rto = IKCP_RTO_DEF;
 		this->rx_minrto = IKCP_RTO_MIN;
 		this->current = 0;
+		this->current_us = 0;
 		this->interval = IKCP_INTERVAL;
 		this->ts_flush = IKCP_INTERVAL;
 		this->nodelay = 0;
@@ -291,16 +466,21 @@ namespace KCP
 		this->cwnd = other.cwnd;
 		this->incr = other.incr;
 		this->probe = other.probe;
+		this->remote_ack_ranges = other.remote_ack_ranges;
 		this->mtu = other.mtu;
 		this->mss = other.mss;
 		this->stream = other.stream;
 		this->buffer = std::move(other.buffer);
+		this->segments.set_payload_size(this->mss);
 		this->state = other.state;
 		this->rx_srtt = other.rx_srtt;
 		this->rx_rttval = other.rx_rttval;
+		this->rx_srtt_us = other.rx_srtt_us;
+		this->rx_rttval_us = other.rx_rttval_us;
 		this->rx_rto = other.rx_rto;
 		this->rx_minrto = other.rx_minrto;
 		this->current = other.current;
+		this->current_us = other.current_us;
 		this->interval = other.interval;
 		this->ts_flush = other.ts_flush;
 		this->nodelay = other.nodelay;
@@ -332,7 +512,6 @@ namespace KCP
 	{
 		bool ispeek = (len < 0);
 		int peeksize;
-		int recover = 0;
 
 		if (this->rcv_queue.empty())
 			return -1;
@@ -347,62 +526,64 @@ namespace KCP
 		if (peeksize > len)
 			return -3;
 
-		if (this->rcv_queue.size() >= this->rcv_wnd)
-			recover = 1;
-
 		len = 0;
+		size_t merged = 0;
 		// merge fragment
-		for (auto seg = rcv_queue.begin(), next = seg; seg != this->rcv_queue.end(); seg = next)
+		for (segment_ptr &seg : this->rcv_queue)
 		{
 			int fragment;
-			++next;
+			++merged;
 
 			if (buffer)
 			{
-				std::copy_n(seg->data.get(), seg->len, buffer);
+				std::copy_n(seg->data, seg->len, buffer);
 				buffer += seg->len;
 			}
 
 			len += (int)seg->len;
 			fragment = seg->frg;
 
-			if (ikcp_canlog(IKCP_LOG_RECV))
+			if (ispeek && ikcp_canlog(IKCP_LOG_RECV))
 			{
 				ikcp_log(IKCP_LOG_RECV, "recv sn=%lu", (unsigned long)seg->sn);
 			}
 
-			if (ispeek == false)
-				this->rcv_queue.erase(seg);
-
 			if (fragment == 0)
 				break;
 		}
 
+		if (ispeek == false)
+			remove_message(merged);
+
 		assert(len == peeksize);
 
-		// move available data from rcv_buf -> rcv_queue
-		while (!this->rcv_buf.empty())
+		return len;
+	}
+
+
+	//---------------------------------------------------------------------
+	// drop the first message of rcv_queue after it has been read
+	//---------------------------------------------------------------------
+	void kcp_core::remove_message(size_t fragments)
+	{
+		bool recover = this->rcv_queue.size() >= this->rcv_wnd;
+
+		if (ikcp_canlog(IKCP_LOG_RECV))
 		{
-			auto iter = this->rcv_buf.begin();
-			uint32_t seg_sn = iter->first;
-			segment *seg = iter->second.get();
-			if (seg->sn == this->rcv_nxt && this->rcv_queue.size() < this->rcv_wnd)
-			{
-				this->rcv_queue.emplace_back(std::move(*seg));
-				this->rcv_nxt++;
-				rcv_buf.erase(iter);
-			}
-			else break;
+			for (size_t i = 0; i < fragments; i++)
+				ikcp_log(IKCP_LOG_RECV, "recv sn=%lu", (unsigned long)this->rcv_queue[i]->sn);
 		}
 
+		this->rcv_queue.erase(this->rcv_queue.begin(), this->rcv_queue.begin() + fragments);
+
+		move_to_rcv_queue();
+
 		// fast recover
 		if (this->rcv_queue.size() < this->rcv_wnd && recover) {
 			// ready to send back IKCP_CMD_WINS in ikcp_flush
 			// tell remote my window size
 			this->probe |= IKCP_ASK_TELL;
 		}
-
-		return len;
 	}
 
 
@@ -415,12 +596,12 @@ namespace KCP
 
 		if (this->rcv_queue.empty()) return -1;
 
-		auto seg = this->rcv_queue.begin();
-		if (seg->frg == 0) return (int)seg->len;
+		const segment *first = this->rcv_queue.front().get();
+		if (first->frg == 0) return (int)first->len;
 
-		if (this->rcv_queue.size() < (size_t)(seg->frg) + 1) return -1;
+		if (this->rcv_queue.size() < (size_t)(first->frg) + 1) return -1;
 
-		for (seg = this->rcv_queue.begin(); seg != this->rcv_queue.end(); ++seg)
+		for (const segment_ptr &seg : this->rcv_queue)
 		{
 			length += (int)seg->len;
 			if (seg->frg == 0) break;
@@ -430,16 +611,93 @@ namespace KCP
 	}
 
 
+	//---------------------------------------------------------------------
+	// reads the buffers of a message one after another, reads nothing if
+	// there is no buffer
+	//---------------------------------------------------------------------
+	class gather_reader
+	{
+	public:
+		explicit gather_reader(std::span<const std::span<const char>> buffers) : buffers(buffers) {}
+
+		void read(char *output, size_t size)
+		{
+			while (size > 0 && index < buffers.size())
+			{
+				size_t available = buffers[index].size() - offset;
+				size_t piece = size < available ? size : available;
+				std::copy_n(buffers[index].data() + offset, piece, output);
+				output += piece;
+				size -= piece;
+				advance(piece);
+			}
+		}
+
+		// the next 'size' bytes without copying, they must be in one buffer
+		const char* take(size_t size)
+		{
+			assert(index < buffers.size() && offset + size <= buffers[index].size());
+			const char *ptr = buffers[index].data() + offset;
+			advance(size);
+			return ptr;
+		}
+
+	private:
+		void advance(size_t size)
+		{
+			offset += size;
+			if (offset == buffers[index].size())
+			{
+				++index;
+				offset = 0;
+			}
+		}
+
+		std::span<const std::span<const char>> buffers;
+		size_t index = 0;
+		size_t offset = 0;
+	};
+
+
 	//---------------------------------------------------------------------
 	// user/upper level send, returns below zero for error
 	//---------------------------------------------------------------------
 	int kcp_core::send(const char *buffer, int len)
+	{
+		if (len < 0) return -1;
+		std::span<const char> message{ buffer, buffer == nullptr ? 0 : (size_t)len };
+		gather_reader source{ { &message, buffer == nullptr ? 0u : 1u } };
+		return send_message(source, len, nullptr);
+	}
+
+	int kcp_core::send(std::span<const std::span<const char>> buffers)
+	{
+		size_t len = 0;
+		for (const std::span<const char> &buffer : buffers)
+			len += buffer.size();
+		if (len > (size_t)std::numeric_limits<int>::max()) return -1;
+		gather_reader source{ buffers };
+		return send_message(source, (int)len, nullptr);
+	}
+
+	int kcp_core::send(std::unique_ptr<payload_owner> owner, const char *buffer, int len)
+	{
+		if (owner == nullptr || buffer == nullptr || len < 0) return -1;
+		std::span<const char> message{ buffer, (size_t)len };
+		gather_reader source{ { &message, 1 } };
+		int sent = send_message(source, len, owner.get());
+		// segments that point into the buffer free it
+		if (owner->references > 0)
+			owner.release();
+		return sent;
+	}
+
+	int kcp_core::send_message(gather_reader &source, int len, payload_owner *adopted)
 	{
 		int count, i;
 		int sent = 0;
 
 		assert(this->mss > 0);
-		if (len < 0) return -1;
 
 		// append to previous segment in streaming mode (if possible)
 		if (this->stream != 0)
@@ -456,11 +714,7 @@ namespace KCP
 					if (!resized)
 						return -2;
 
-					if (buffer)
-					{
-						std::copy_n(buffer, extend, seg->data.get() + old_size);
-						buffer += extend;
-					}
+					source.read(seg->data + old_size, extend);
 					seg->len = old_size + extend;
 					seg->frg = 0;
 					len -= extend;
@@ -487,18 +741,18 @@ namespace KCP
 		for (i = 0; i < count; i++)
 		{
 			int size = len > (int)this->mss ? (int)this->mss : len;
-			std::unique_ptr<segment> seg = std::make_unique<segment>(size);
+			segment_ptr seg = this->segments.make(adopted == nullptr ? size : 0);
 			if (seg == nullptr)
 				return -2;
 
-			if (buffer && len > 0)
-				std::copy_n(buffer, size, seg->data.get());
+			if (adopted != nullptr)
+				seg->adopt_payload(adopted, source.take(size), size);
+			else
+				source.read(seg->data, size);
 
 			seg->len = size;
 			seg->frg = (this->stream == 0) ? (count - i - 1) : 0;
 			this->snd_queue.emplace_back(std::move(seg));
-			if (buffer)
-				buffer += size;
 
 			len -= size;
 			sent += size;
@@ -511,32 +765,54 @@ namespace KCP
 	//---------------------------------------------------------------------
 	// parse ack
 	//---------------------------------------------------------------------
-	void kcp_core::update_ack(int32_t rtt)
+	void kcp_core::update_ack(int64_t rtt_us)
 	{
-		int32_t rto = 0;
-		if (this->rx_srtt == 0)
+		int64_t rto_us = 0;
+		if (this->rx_srtt_us == 0)
 		{
-			this->rx_srtt = rtt;
-			this->rx_rttval = rtt / 2;
+			this->rx_srtt_us = rtt_us;
+			this->rx_rttval_us = rtt_us / 2;
 		}
 		else
 		{
-			long delta = rtt - this->rx_srtt;
+			int64_t delta = rtt_us - this->rx_srtt_us;
 			if (delta < 0) delta = -delta;
-			this->rx_rttval = (3 * this->rx_rttval + delta) / 4;
-			this->rx_srtt = (7 * this->rx_srtt + rtt) / 8;
-			if (this->rx_srtt < 1) this->rx_srtt = 1;
+			this->rx_rttval_us = (3 * this->rx_rttval_us + delta) / 4;
+			this->rx_srtt_us = (7 * this->rx_srtt_us + rtt_us) / 8;
+			if (this->rx_srtt_us < 1) this->rx_srtt_us = 1;
 		}
-		rto = this->rx_srtt + _imax_(this->interval, 4 * this->rx_rttval);
-		this->rx_rto = _ibound_(this->rx_minrto, rto, IKCP_RTO_MAX);
+		this->rx_srtt = (int32_t)((this->rx_srtt_us + 999) / 1000);
+		this->rx_rttval = (int32_t)((this->rx_rttval_us + 999) / 1000);
+		rto_us = this->rx_srtt_us + std::max<int64_t>((int64_t)this->interval * 1000, 4 * this->rx_rttval_us);
+		this->rx_rto = _ibound_(this->rx_minrto, (uint32_t)std::min<int64_t>((rto_us + 999) / 1000, IKCP_RTO_MAX), IKCP_RTO_MAX);
+	}
+
+	// RTT of an acknowledged segment in microsec, or -1 if there is nothing to sample.
+	// Must be called before the segment is removed by parse_una() or parse_ack().
+	int64_t kcp_core::sample_rtt(uint32_t sn, uint32_t ts)
+	{
+		// The echoed timestamp belongs to the latest transmission, so the local microsecond time of it can be used
+		if (this->snd_buf.contains(this->snd_una, sn))
+		{
+			const segment &seg = *this->snd_buf[sn];
+			if (seg.ts == ts && this->current_us >= seg.ts_us)
+				return (int64_t)(this->current_us - seg.ts_us);
+		}
+
+		long rtt = _itimediff((uint32_t)(this->current_us / 1000), ts);
+		return rtt >= 0 ? (int64_t)rtt * 1000 : -1;
 	}
 
 	void kcp_core::shrink_buf()
 	{
-		if (!this->snd_buf.empty())
-			this->snd_una = this->snd_buf.begin()->first;
-		else
+		if (this->snd_buf.empty())
+		{
 			this->snd_una = this->snd_nxt;
+			return;
+		}
+
+		while (this->snd_una != this->snd_nxt && this->snd_buf[this->snd_una] == nullptr)
+			this->snd_una++;
 	}
 
 	void kcp_core::parse_ack(uint32_t sn)
@@ -544,42 +820,35 @@ namespace KCP
 		if (sn < this->snd_una || sn >= this->snd_nxt)
 			return;
 
-		if (auto iter = this->snd_buf.find(sn); iter != this->snd_buf.end())
+		if (segment_ptr seg = this->snd_buf.erase(sn); seg != nullptr)
 		{
-			std::shared_ptr<segment> seg = iter->second;
-
-			if (auto resendts_iter = this->resendts_buf.find(seg->resendts); resendts_iter != this->resendts_buf.end())
-				if (auto um_iter = resendts_iter->second.find(sn); um_iter != resendts_iter->second.end())
-					resendts_iter->second.erase(um_iter);
-
-			if (auto fastack_iter = this->fastack_buf.find(seg->fastack); fastack_iter != this->fastack_buf.end())
-				if (auto um_iter = fastack_iter->second.find(sn); um_iter != fastack_iter->second.end())
-					fastack_iter->second.erase(um_iter);
-
-			this->snd_buf.erase(iter);
+			this->resendts_heap.erase(seg.get());
+			this->fastack_candidates.erase(seg.get());
 		}
 	}
 
+	void kcp_core::parse_ack_range(uint32_t start, uint32_t count)
+	{
+		uint32_t end = start + count;
+		if (_itimediff(start, this->snd_una) < 0)
+			start = this->snd_una;
+		if (_itimediff(end, this->snd_nxt) > 0)
+			end = this->snd_nxt;
+
+		for (uint32_t sn = start; _itimediff(end, sn) > 0; ++sn)
+			parse_ack(sn);
+	}
+
 	void kcp_core::parse_una(uint32_t una)
 	{
-		for (auto iter = this->snd_buf.begin(), next = iter; iter != this->snd_buf.end(); iter = next)
+		for (uint32_t sn = this->snd_una; sn != this->snd_nxt && una > sn && !this->snd_buf.empty(); ++sn)
 		{
-			++next;
-			uint32_t sn = iter->first;
-			std::shared_ptr<segment> seg = iter->second;
-			if (una > sn)
-			{
-				if (auto resendts_iter = this->resendts_buf.find(seg->resendts); resendts_iter != this->resendts_buf.end())
-					if (auto um_iter = resendts_iter->second.find(sn); um_iter != resendts_iter->second.end())
-						resendts_iter->second.erase(um_iter);
-
-				if (auto fastack_iter = this->fastack_buf.find(seg->fastack); fastack_iter != this->fastack_buf.end())
-					if (auto um_iter = fastack_iter->second.find(sn); um_iter != fastack_iter->second.end())
-						fastack_iter->second.erase(um_iter);
+			segment_ptr seg = this->snd_buf.erase(sn);
+			if (seg == nullptr)
+				continue;
 
-				this->snd_buf.erase(iter);
-			}
-			else break;
+			this->resendts_heap.erase(seg.get());
+			this->fastack_candidates.erase(seg.get());
 		}
 	}
 
@@ -588,53 +857,38 @@ namespace KCP
 		if (sn < this->snd_una || sn >= this->snd_nxt)
 			return;
 
-		for (auto &[seg_sn, seg] : this->snd_buf)
+		for (uint32_t seg_sn = this->snd_una; seg_sn != sn; ++seg_sn)
 		{
-			if (sn < seg_sn) break;
-			else if (sn != seg_sn)
-			{
-				if (auto fastack_iter = this->fastack_buf.find(seg->fastack); fastack_iter != this->fastack_buf.end())
-					if (auto um_iter = fastack_iter->second.find(seg_sn); um_iter != fastack_iter->second.end())
-						fastack_iter->second.erase(um_iter);
+			segment *seg = this->snd_buf[seg_sn].get();
+			if (seg == nullptr)
+				continue;
 
-				seg->fastack++;
-				this->fastack_buf[seg->fastack][seg_sn] = seg;
-			}
+			seg->fastack++;
+			if (this->fastresend > 0 && seg->fastack >= (uint32_t)this->fastresend && !seg->fastack_listed &&
+				((int)seg->xmit <= this->fastlimit || this->fastlimit <= 0))
+				this->fastack_candidates.push_back(seg);
 		}
 	}
 
 	//---------------------------------------------------------------------
 	// parse data
 	//---------------------------------------------------------------------
-	void kcp_core::parse_data(segment &newseg)
+	void kcp_core::parse_data(segment_ptr newseg)
 	{
-		uint32_t sn = newseg.sn;
+		uint32_t sn = newseg->sn;
 
 		if (sn >= this->rcv_nxt + this->rcv_wnd || sn < this->rcv_nxt)
 			return;
 
-		if (auto iter = this->rcv_buf.find(sn); iter == this->rcv_buf.end())
-			this->rcv_buf.insert({ sn, std::make_unique<segment>(std::move(newseg))});
+		if (!this->rcv_buf.contains(this->rcv_nxt, sn))
+			this->rcv_buf.insert(this->rcv_nxt, sn, std::move(newseg));
 
 #if 0
 		PrintQueue("rcvbuf", &this->rcv_buf);
 		printf("rcv_nxt=%lu\n", this->rcv_nxt);
 #endif
 
-		// move available data from rcv_buf -> rcv_queue
-		while (!this->rcv_buf.empty())
-		{
-			auto iter = this->rcv_buf.begin();
-			uint32_t seg_sn = iter->first;
-			segment *seg = iter->second.get();
-			if (seg->sn == this->rcv_nxt && this->rcv_queue.size() < this->rcv_wnd)
-			{
-				this->rcv_queue.emplace_back(std::move(*seg));
-				this->rcv_nxt++;
-				rcv_buf.erase(iter);
-			}
-			else break;
-		}
+		move_to_rcv_queue();
 
 
 #if 0
@@ -649,6 +903,22 @@ namespace KCP
 	}
 
 
+	//---------------------------------------------------------------------
+	// move available data from rcv_buf -> rcv_queue
+	//---------------------------------------------------------------------
+	void kcp_core::move_to_rcv_queue()
+	{
+		while (!this->rcv_buf.empty() && this->rcv_queue.size() < this->rcv_wnd)
+		{
+			segment_ptr seg = this->rcv_buf.erase(this->rcv_nxt);
+			if (seg == nullptr)
+				break;
+			this->rcv_queue.emplace_back(std::move(seg));
+			this->rcv_nxt++;
+		}
+	}
+
+
 	//---------------------------------------------------------------------
 	// input data
 	//---------------------------------------------------------------------
@@ -685,17 +955,30 @@ namespace KCP
 			if (size < (long)len || (int)len < 0) return -2;
 
 			if (cmd != IKCP_CMD_PUSH && cmd != IKCP_CMD_ACK &&
-				cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS)
+				cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS &&
+				cmd != IKCP_CMD_ACK_RANGES)
 				return -3;
 
+			if (cmd == IKCP_CMD_ACK_RANGES && len % IKCP_ACK_RANGE_SIZE != 0)
+				return -3;
+
+			if (cmd != IKCP_CMD_PUSH && (frg & IKCP_ACK_RANGES_SUPPORTED) != 0)
+			{
+				this->remote_ack_ranges = true;
+				// a plain ACK means the remote end has not seen our flag yet
+				if (cmd == IKCP_CMD_ACK)
+					this->probe |= IKCP_ASK_TELL;
+			}
+
 			this->rmt_wnd = wnd;
+			int64_t rtt_us = (cmd == IKCP_CMD_ACK || cmd == IKCP_CMD_ACK_RANGES) ? sample_rtt(sn, ts) : -1;
 			parse_una(una);
 			shrink_buf();
 
 			if (cmd == IKCP_CMD_ACK)
 			{
-				if (this->current >= ts)
-					update_ack(_itimediff(this->current, ts));
+				if (rtt_us >= 0)
+					update_ack(rtt_us);
 
 				parse_ack(sn);
 				shrink_buf();
@@ -717,10 +1000,44 @@ namespace KCP
 				{
 					ikcp_log(IKCP_LOG_IN_ACK,
 						"input ack: sn=%lu rtt=%ld rto=%ld", (unsigned long)sn,
-						(long)_itimediff(this->current, ts),
+						(long)(rtt_us / 1000),
 						(long)this->rx_rto);
 				}
 			}
+			else if (cmd == IKCP_CMD_ACK_RANGES)
+			{
+				// 'sn' and 'ts' echo one segment of the ranges, for the RTT
+				if (rtt_us >= 0)
+					update_ack(rtt_us);
+
+				const char *range_ptr = data;
+				for (uint32_t i = 0; i < len / IKCP_ACK_RANGE_SIZE; i++)
+				{
+					uint32_t start;
+					uint16_t count;
+					range_ptr = ikcp_decode32u(range_ptr, &start);
+					range_ptr = ikcp_decode16u(range_ptr, &count);
+					if (count == 0)
+						continue;
+
+					parse_ack_range(start, count);
+					uint32_t last = start + count - 1;
+					if (flag == 0 || last > maxack)
+					{
+						flag = 1;
+						maxack = last;
+						latest_ts = ts;
+					}
+					if (ikcp_canlog(IKCP_LOG_IN_ACK))
+					{
+						ikcp_log(IKCP_LOG_IN_ACK,
+							"input ack range: sn=%lu count=%lu rtt=%ld rto=%ld", (unsigned long)start,
+							(unsigned long)count, (long)(rtt_us / 1000), (long)this->rx_rto);
+					}
+				}
+				shrink_buf();
+				this->remote_ack_ranges = true;
+			}
 			else if (cmd == IKCP_CMD_PUSH)
 			{
 				if (ikcp_canlog(IKCP_LOG_IN_DATA))
@@ -729,22 +1046,24 @@ namespace KCP
 				if (sn < this->rcv_nxt + this->rcv_wnd)
 				{
 					this->acklist.push_back({ sn , ts });
-					if (sn >= this->rcv_nxt)
+					if (sn >= this->rcv_nxt && !this->rcv_buf.contains(this->rcv_nxt, sn))
 					{
-						segment seg(len);
-						seg.conv = conv;
-						seg.cmd = cmd;
-						seg.frg = frg;
-						seg.wnd = wnd;
-						seg.ts = ts;
-						seg.sn = sn;
-						seg.una = una;
-						seg.len = len;
+						segment_ptr seg = this->segments.make(len);
+						if (seg == nullptr)
+							return -2;
+						seg->conv = conv;
+						seg->cmd = cmd;
+						seg->frg = frg;
+						seg->wnd = wnd;
+						seg->ts = ts;
+						seg->sn = sn;
+						seg->una = una;
+						seg->len = len;
 
 						if (len > 0)
-							std::copy_n(data, len, seg.data.get());
+							std::copy_n(data, len, seg->data);
 
-						parse_data(seg);
+						parse_data(std::move(seg));
 					}
 				}
 			}
@@ -845,6 +1164,68 @@ namespace KCP
 	}
 
 
+	//---------------------------------------------------------------------
+	// flush acklist as sn ranges, duplicates from retransmits and FEC are
+	// merged. Each segment echoes the newest timestamp among its ranges.
+	// acklist is empty afterwards
+	//---------------------------------------------------------------------
+	char* kcp_core::flush_ack_ranges(char *ptr, char *buffer, segment &seg)
+	{
+		std::sort(this->acklist.begin(), this->acklist.end(),
+			[](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) { return _itimediff(a.first, b.first) < 0; });
+
+		seg.cmd = IKCP_CMD_ACK_RANGES;
+		size_t i = 0;
+		while (i < this->acklist.size())
+		{
+			int size = (int)(ptr - buffer);
+			if (size + (int)(IKCP_OVERHEAD + IKCP_ACK_RANGE_SIZE) > (int)this->mtu)
+			{
+				call_output(buffer, size);
+				ptr = buffer;
+				size = 0;
+			}
+
+			// ranges are written behind the space of the header, which needs the echo and the length
+			uint32_t ranges_limit = (this->mtu - (uint32_t)size - IKCP_OVERHEAD) / IKCP_ACK_RANGE_SIZE;
+			uint32_t ranges = 0;
+			char *range_ptr = ptr + IKCP_OVERHEAD;
+			seg.sn = this->acklist[i].first;
+			seg.ts = this->acklist[i].second;
+
+			for (; i < this->acklist.size() && ranges < ranges_limit; ranges++)
+			{
+				uint32_t start = this->acklist[i].first;
+				uint32_t count = 0;
+				for (; i < this->acklist.size() && count < 0xFFFF; i++)
+				{
+					auto [ack_sn, ack_ts] = this->acklist[i];
+					if (ack_sn == start + count)
+						count++;
+					else if (ack_sn != start + count - 1)
+						break;
+					if (_itimediff(ack_ts, seg.ts) > 0)
+					{
+						seg.sn = ack_sn;
+						seg.ts = ack_ts;
+					}
+				}
+				range_ptr = ikcp_encode32u(range_ptr, start);
+				range_ptr = ikcp_encode16u(range_ptr, (uint16_t)count);
+			}
+
+			seg.len = ranges * IKCP_ACK_RANGE_SIZE;
+			ikcp_encode_seg(ptr, seg);
+			ptr = range_ptr;
+		}
+
+		seg.cmd = IKCP_CMD_ACK;
+		seg.len = 0;
+		this->acklist.clear();
+		return ptr;
+	}
+
+
 	//---------------------------------------------------------------------
 	// ikcp_flush
 	//---------------------------------------------------------------------
@@ -868,13 +1249,16 @@ namespace KCP
 
 		seg.conv = this->conv;
 		seg.cmd = IKCP_CMD_ACK;
-		seg.frg = 0;
+		seg.frg = IKCP_ACK_RANGES_SUPPORTED;	// ignored by peers without IKCP_CMD_ACK_RANGES
 		seg.wnd = get_wnd_unused();
 		seg.una = this->rcv_nxt;
 		seg.sn = 0;
 		seg.ts = 0;
 
 		// flush acknowledges
+		if (this->remote_ack_ranges && !this->acklist.empty())
+			ptr = flush_ack_ranges(ptr, buffer, seg);
+
 		for (auto [ack_sn, ack_ts] : this->acklist)
 		{
 			int size = (int)(ptr - buffer);
@@ -956,116 +1340,73 @@ namespace KCP
 
 		// flush data segments
 
-		for (auto iter = this->resendts_buf.begin(), next = iter; iter != this->resendts_buf.end(); iter = next)
+		// segments due for a timeout retransmit leave the heap first, so a new resendts that is still due cannot loop
+		this->due_segments.clear();
+		while (!this->resendts_heap.empty() && _itimediff(current, this->resendts_heap.top()->resendts) >= 0)
+			this->due_segments.push_back(this->resendts_heap.pop());
+
+		for (segment *segptr : this->due_segments)
 		{
-			++next;
-			auto &[resend_ts, seg_list] = *iter;
-			if (seg_list.empty())
+			segptr->xmit++;
+			this->xmit++;
+			if (this->nodelay == 0)
 			{
-				this->resendts_buf.erase(iter);
-				continue;
+				segptr->rto += _imax_(segptr->rto, (uint32_t)this->rx_rto);
 			}
-
-			if (current < resend_ts) break;
-
-			for (auto seg_iter = seg_list.begin(), seg_next = seg_iter;
-				seg_iter != seg_list.end();
-				seg_iter = seg_next)
+			else
 			{
-				++seg_next;
-				auto [seg_sn, seg_weak] = *seg_iter;
-				std::shared_ptr segptr = seg_weak.lock();
-				if (segptr == nullptr)
-				{
-					seg_list.erase(seg_iter);
-					continue;
-				}
-
-				segptr->xmit++;
-				this->xmit++;
-				if (this->nodelay == 0)
-				{
-					segptr->rto += _imax_(segptr->rto, (uint32_t)this->rx_rto);
-				}
-				else
-				{
-					int32_t step = (this->nodelay < 2) ?
-						((int32_t)(segptr->rto)) : this->rx_rto;
-					segptr->rto += step / 2;
-				}
-				segptr->resendts = current + segptr->rto;
-				lost = 1;
-
-				seg_list.erase(seg_iter);
-				this->resendts_buf[segptr->resendts][seg_sn] = segptr;
-
-				segptr->ts = current;
-				segptr->wnd = seg.wnd;
-				segptr->una = this->rcv_nxt;
-				ptr = send_out(ptr, buffer, segptr.get());
+				int32_t step = (this->nodelay < 2) ?
+					((int32_t)(segptr->rto)) : this->rx_rto;
+				segptr->rto += step / 2;
 			}
+			segptr->resendts = current + segptr->rto;
+			lost = 1;
 
-			if (seg_list.empty())
-				this->resendts_buf.erase(iter);
+			this->resendts_heap.push(segptr);
+
+			segptr->ts = current;
+			segptr->ts_us = this->current_us;
+			segptr->wnd = seg.wnd;
+			segptr->una = this->rcv_nxt;
+			ptr = send_out(ptr, buffer, segptr);
 		}
 
-		for (auto iter = this->fastack_buf.rbegin(), next = iter; iter != this->fastack_buf.rend(); iter = next)
+		for (segment *segptr = this->fastack_candidates.front(), *next = nullptr; segptr != nullptr; segptr = next)
 		{
-			++next;
-			auto &[fast_ack, seg_list] = *iter;
-			if (seg_list.empty())
+			next = segptr->fastack_next;
+			if (segptr->fastack < resent)
 				continue;
 
-			if (fast_ack < resent) break;
-
-			for (auto seg_iter = seg_list.begin(), seg_next = seg_iter;
-				seg_iter != seg_list.end();
-				seg_iter = seg_next)
+			this->fastack_candidates.erase(segptr);
+			if ((int)segptr->xmit <= this->fastlimit || this->fastlimit <= 0)
 			{
-				++seg_next;
-				auto [seg_sn, seg_weak] = *seg_iter;
-				std::shared_ptr segptr = seg_weak.lock();
-				if (segptr == nullptr)
-				{
-					seg_list.erase(seg_iter);
-					continue;
-				}
-
-				if ((int)segptr->xmit <= this->fastlimit || this->fastlimit <= 0)
-				{
-					uint32_t old_resendtrs = segptr->resendts;
-					segptr->xmit++;
-					segptr->fastack = 0;
-					segptr->resendts = current + segptr->rto;
-					change++;
-
-					seg_list.erase(seg_iter);
-					this->fastack_buf[segptr->fastack][seg_sn] = segptr;
-
-					if (auto resendts_iter = this->resendts_buf.find(old_resendtrs); resendts_iter != this->resendts_buf.end())
-						if (auto um_iter = resendts_iter->second.find(seg_sn); um_iter != resendts_iter->second.end())
-							resendts_iter->second.erase(um_iter);
+				segptr->xmit++;
+				segptr->fastack = 0;
+				segptr->resendts = current + segptr->rto;
+				change++;
 
-					this->resendts_buf[segptr->resendts][seg_sn] = segptr;
+				this->resendts_heap.update(segptr);
 
-					segptr->ts = current;
-					segptr->wnd = seg.wnd;
-					segptr->una = this->rcv_nxt;
-					ptr = send_out(ptr, buffer, segptr.get());
-				}
+				segptr->ts = current;
+				segptr->ts_us = this->current_us;
+				segptr->wnd = seg.wnd;
+				segptr->una = this->rcv_nxt;
+				ptr = send_out(ptr, buffer, segptr);
 			}
 		}
 
 		// move data from snd_queue to snd_buf
 		while (this->snd_nxt < this->snd_una + cwnd && !this->snd_queue.empty())
 		{
-			auto iter = this->snd_queue.begin();
-			std::shared_ptr<segment> newseg = std::move(*iter);
+			segment_ptr queued_seg = std::move(this->snd_queue.front());
+			this->snd_queue.pop_front();
+			segment *newseg = queued_seg.get();
 
 			newseg->conv = this->conv;
 			newseg->cmd = IKCP_CMD_PUSH;
 			newseg->wnd = seg.wnd;
 			newseg->ts = current;
+			newseg->ts_us = this->current_us;
 			newseg->sn = this->snd_nxt++;
 			newseg->una = this->rcv_nxt;
 			newseg->resendts = current + this->rx_rto + rtomin;
@@ -1073,12 +1414,10 @@ namespace KCP
 			newseg->fastack = 0;
 			newseg->xmit = 1;
 
-			this->snd_buf[newseg->sn] = newseg;
-			this->snd_queue.pop_front();
-			resendts_buf[newseg->resendts][newseg->sn] = newseg;
-			fastack_buf[newseg->fastack][newseg->sn] = newseg;
+			this->snd_buf.insert(this->snd_una, newseg->sn, std::move(queued_seg));
+			this->resendts_heap.push(newseg);
 
-			ptr = send_out(ptr, buffer, newseg.get());
+			ptr = send_out(ptr, buffer, newseg);
 		}
 
 		// flash remain segments	
@@ -1124,6 +1463,7 @@ namespace KCP
 		int32_t slap;
 
 		this->current = current;
+		this->segments.set_cache_limit((size_t)this->snd_wnd + this->rcv_wnd);
 
 		if (this->updated == 0)
 		{
@@ -1179,11 +1519,9 @@ namespace KCP
 
 		tm_flush = _itimediff(ts_flush, current);
 
-		if (!this->resendts_buf.empty())
+		if (!this->resendts_heap.empty())
 		{
-			auto &[resend_ts, seg_list] = *this->resendts_buf.begin();
-
-			int32_t diff = _itimediff(resend_ts, current);
+			int32_t diff = _itimediff(this->resendts_heap.top()->resendts, current);
 			if (diff <= 0)
 				return current;
 
@@ -1207,6 +1545,7 @@ namespace KCP
 		this->mtu = mtu;
 		this->mss = this->mtu - IKCP_OVERHEAD;
 		this->buffer = std::move(buffer);
+		this->segments.set_payload_size(this->mss);
 		return 0;
 	}
 
@@ -1287,7 +1626,7 @@ namespace KCP
 
 		if (segptr->len > 0)
 		{
-			std::copy_n(segptr->data.get(), segptr->len, ptr);
+			std::copy_n(segptr->data, segptr->len, ptr);
 			ptr += segptr->len;
 		}
 
@@ -17,12 +17,12 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdint.h>
+#include <bit>
+#include <deque>
 #include <functional>
-#include <list>
-#include <map>
 #include <memory>
+#include <span>
 #include <vector>
-#include <unordered_map>
 
 
 #ifdef _MSC_VER
@@ -34,6 +34,27 @@
 
 namespace KCP
 {
+	struct segment;
+	class segment_pool;
+	class gather_reader;
+
+	// returns the segment to its pool
+	struct segment_deleter
+	{
+		void operator()(segment *seg) const;
+	};
+
+	using segment_ptr = std::unique_ptr<segment, segment_deleter>;
+
+	// Send buffer adopted by kcp_core::send(), freed when the last segment
+	// pointing into it is released. Only used under the lock of the session,
+	// so the count is not atomic.
+	struct payload_owner
+	{
+		uint32_t references = 0;
+		virtual ~payload_owner() = default;
+	};
+
 	//=====================================================================
 	// SEGMENT
 	//=====================================================================
@@ -51,27 +72,195 @@ namespace KCP
 		uint32_t rto = 0;
 		uint32_t fastack = 0;
 		uint32_t xmit = 0;
-		std::unique_ptr<char[]> data;
+		uint64_t ts_us = 0;	// local time of the latest transmission in microseconds, 'ts' is its millisecond form on the wire
+		char *data = nullptr;	// inline storage of a pooled segment, heap_data, or a part of payload_ref
+		uint32_t capacity = 0;
+		uint32_t inline_capacity = 0;
+		segment_pool *owner = nullptr;
+		std::unique_ptr<char[]> heap_data;	// payload larger than the inline storage
+		payload_owner *payload_ref = nullptr;	// adopted send buffer
+		uint32_t resend_index = UINT32_MAX;	// position in the retransmit heap, UINT32_MAX: not queued
+		segment *fastack_prev = nullptr;
+		segment *fastack_next = nullptr;
+		bool fastack_listed = false;
 
 		segment() = default;
 		segment(const segment &other) = delete;
-		segment(segment &&other) = default;
-		segment(uint32_t new_size)
-		{
-			data = std::make_unique<char[]>(new_size);
-			if (data != nullptr)
-				len = new_size;
-		}
+		segment& operator=(const segment &other) = delete;
+		~segment() { release_payload(); }
 
 		bool resize(uint32_t new_size)
 		{
+			if (new_size <= capacity) return true;
 			std::unique_ptr<char[]> new_data = std::make_unique<char[]>(new_size);
 			if (new_data == nullptr) return false;
 			if (data != nullptr)
-				std::copy_n(data.get(), len, new_data.get());
-			data = std::move(new_data);
+				std::copy_n(data, len, new_data.get());
+			heap_data = std::move(new_data);
+			data = heap_data.get();
+			capacity = new_size;
+			release_payload();
 			return true;
 		}
+
+		void adopt_payload(payload_owner *owner_ptr, const char *payload, uint32_t size)
+		{
+			release_payload();
+			data = const_cast<char *>(payload);
+			capacity = size;
+			len = size;
+			payload_ref = owner_ptr;
+			++payload_ref->references;
+		}
+
+		void release_payload()
+		{
+			if (payload_ref != nullptr && --payload_ref->references == 0)
+				delete payload_ref;
+			payload_ref = nullptr;
+		}
+	};
+
+
+	//=====================================================================
+	// SEGMENT POOL
+	// Each segment and its payload of up to 'payload_size' bytes share one
+	// allocation. Released segments are kept for reuse, up to about one set
+	// of windows, so a session under bulk load recycles the segments freed
+	// by ACKs. A pool belongs to one kcp_core and is only used under the
+	// lock of that session.
+	//=====================================================================
+	class segment_pool
+	{
+	public:
+		segment_pool() = default;
+		segment_pool(const segment_pool &) = delete;
+		segment_pool& operator=(const segment_pool &) = delete;
+		~segment_pool();
+
+		// 'len' larger than payload_size gets its payload from the heap
+		segment_ptr make(uint32_t len);
+		void release(segment *seg);
+
+		// segments of the previous size are not reused any more
+		void set_payload_size(uint32_t new_payload_size);
+		void set_cache_limit(size_t new_cache_limit) { cache_limit = new_cache_limit; }
+
+	private:
+		std::vector<void *> cached_blocks;
+		size_t cache_limit = 128;
+		uint32_t payload_size = 0;
+	};
+
+
+	//=====================================================================
+	// SEQUENCE RING
+	// Window of segments indexed by sn. The capacity is a power of two and
+	// only grows, every sn from 'base' to 'base + capacity - 1' has its own
+	// slot. 'base' is the oldest sn that can be stored (snd_una, rcv_nxt).
+	//=====================================================================
+	template<typename T>
+	class sequence_ring
+	{
+	public:
+		sequence_ring() : slots(initial_capacity), mask(initial_capacity - 1), count(0) {}
+
+		// caller makes sure 'sn' is inside the window
+		T& operator[](uint32_t sn) { return slots[sn & mask]; }
+
+		bool contains(uint32_t base, uint32_t sn) const
+		{
+			return sn - base <= mask && slots[sn & mask] != nullptr;
+		}
+
+		void insert(uint32_t base, uint32_t sn, T value)
+		{
+			if (sn - base > mask)
+				grow(base, sn - base + 1);
+			T &slot = slots[sn & mask];
+			assert(slot == nullptr);
+			slot = std::move(value);
+			++count;
+		}
+
+		// caller makes sure 'sn' is inside the window
+		T erase(uint32_t sn)
+		{
+			T value = std::move(slots[sn & mask]);
+			slots[sn & mask] = nullptr;
+			if (value != nullptr)
+				--count;
+			return value;
+		}
+
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		uint32_t capacity() const { return mask + 1; }
+
+	private:
+		static constexpr uint32_t initial_capacity = 32;
+
+		void grow(uint32_t base, uint32_t required)
+		{
+			uint32_t new_mask = std::bit_ceil(required) - 1;
+			std::vector<T> new_slots(new_mask + 1);
+			for (uint32_t offset = 0; offset <= mask; ++offset)
+				new_slots[(base + offset) & new_mask] = std::move(slots[(base + offset) & mask]);
+			slots = std::move(new_slots);
+			mask = new_mask;
+		}
+
+		std::vector<T> slots;
+		uint32_t mask;
+		size_t count;
+	};
+
+
+	//=====================================================================
+	// RETRANSMIT HEAP
+	// Min-heap of the segments in snd_buf, ordered by resendts. Every
+	// segment knows its own position, so an ACK or a new resendts only
+	// costs a sift, and flush() only looks at the segments that are due.
+	//=====================================================================
+	class retransmit_heap
+	{
+	public:
+		bool empty() const { return heap.empty(); }
+		size_t size() const { return heap.size(); }
+		segment* top() const { return heap.front(); }
+
+		void push(segment *seg);
+		segment* pop();
+		void erase(segment *seg);
+		// call it after seg->resendts has changed
+		void update(segment *seg);
+
+	private:
+		void sift_up(uint32_t index);
+		void sift_down(uint32_t index);
+		void place(uint32_t index, segment *seg);
+
+		std::vector<segment *> heap;
+	};
+
+
+	//=====================================================================
+	// FASTACK LIST
+	// Intrusive list of the segments in snd_buf that have been skipped by
+	// enough ACKs for a fast retransmit.
+	//=====================================================================
+	class fastack_list
+	{
+	public:
+		segment* front() const { return head; }
+
+		void push_back(segment *seg);
+		// does nothing if seg is not listed
+		void erase(segment *seg);
+
+	private:
+		segment *head = nullptr;
+		segment *tail = nullptr;
 	};
 
 
@@ -84,18 +273,23 @@ namespace KCP
 		uint32_t snd_una, snd_nxt, rcv_nxt;
 		uint32_t ts_recent, ts_lastack, ssthresh;
 		int32_t rx_rttval, rx_srtt, rx_rto, rx_minrto;
+		int64_t rx_rttval_us, rx_srtt_us;	// rx_rttval and rx_srtt are these rounded up to millisec
 		uint32_t snd_wnd, rcv_wnd, rmt_wnd, cwnd, probe;
 		uint32_t current, interval, ts_flush, xmit;
+		uint64_t current_us;
 		uint32_t nodelay, updated;
 		uint32_t ts_probe, probe_wait;
 		uint32_t dead_link, incr;
-		std::list<std::unique_ptr<segment>> snd_queue;
-		std::list<segment> rcv_queue;
-		std::map<uint32_t, std::shared_ptr<segment>> snd_buf;	// SN -> segment
-		std::map<uint32_t, std::unordered_map<uint32_t, std::weak_ptr<segment>>> resendts_buf;	// resendts -> segment
-		std::map<uint32_t, std::unordered_map<uint32_t, std::weak_ptr<segment>>> fastack_buf;	// fastack -> segment
-		std::map<uint32_t, std::unique_ptr<segment>> rcv_buf;	// SN -> segment
+		segment_pool segments;	// declared before the containers, so it is destroyed after them
+		std::deque<segment_ptr> snd_queue;
+		std::deque<segment_ptr> rcv_queue;
+		sequence_ring<segment_ptr> snd_buf;	// SN -> segment
+		retransmit_heap resendts_heap;	// every segment in snd_buf
+		fastack_list fastack_candidates;	// segments in snd_buf with fastack >= fastresend
+		std::vector<segment *> due_segments;	// flush() only
+		sequence_ring<segment_ptr> rcv_buf;	// SN -> segment
 		std::vector<std::pair<uint32_t, uint32_t>> acklist;
+		bool remote_ack_ranges;	// the remote end reads ACKs as sn ranges
 		void *user;
 		std::unique_ptr<char[]> buffer;
 		int fastresend;
@@ -130,8 +324,32 @@ namespace KCP
 		// user/upper level recv: returns size, returns below zero for EAGAIN
 		int receive(char *buffer, int len);
 
+		// calls 'visitor' with each fragment of the next message as a
+		// std::span<const char>, in order, then removes the message.
+		// returns the message size, below zero if no message is complete
+		template<typename Visitor>
+		int receive_fragments(Visitor &&visitor)
+		{
+			int size = peek_size();
+			if (size < 0) return size;
+
+			size_t fragments = 0;
+			for (const segment_ptr &seg : this->rcv_queue)
+			{
+				++fragments;
+				visitor(std::span<const char>(seg->data, seg->len));
+				if (seg->frg == 0) break;
+			}
+			remove_message(fragments);
+			return size;
+		}
+
 		// user/upper level send, returns below zero for error
 		int send(const char *buffer, int len);
+		// gather the buffers into one message
+		int send(std::span<const std::span<const char>> buffers);
+		// the segments point into 'buffer' instead of copying it, 'owner' keeps it alive until they are all released
+		int send(std::unique_ptr<payload_owner> owner, const char *buffer, int len);
 
 		// update state (call it repeatedly, every 10ms-100ms), or you can ask 
 		// ikcp_check when to call it again (without ikcp_input/_send calling).
@@ -147,6 +365,10 @@ namespace KCP
 		// or optimize ikcp_update when handling massive kcp connections)
 		uint32_t check(uint32_t current);
 
+		// set the monotonic time in microsec of the next input/update/flush,
+		// segments sent and acknowledgements received are timed with it
+		void set_clock(uint64_t current_us) { this->current_us = current_us; }
+
 		// when you received a low level packet (eg. UDP packet), call it
 		int input(const char *data, long size);
 
@@ -182,16 +404,22 @@ namespace KCP
 		uint32_t get_conv();
 
 	protected:
-		void update_ack(int32_t rtt);
+		void update_ack(int64_t rtt_us);
+		int64_t sample_rtt(uint32_t sn, uint32_t ts);
 		void shrink_buf();
 		void parse_ack(uint32_t sn);
+		void parse_ack_range(uint32_t start, uint32_t count);
 		void parse_una(uint32_t una);
 		void parse_fastack(uint32_t sn, uint32_t ts);
 		int get_wnd_unused();
-		void parse_data(segment &newseg);
+		void parse_data(segment_ptr newseg);
+		void move_to_rcv_queue();
+		void remove_message(size_t fragments);
+		int send_message(gather_reader &source, int len, payload_owner *adopted);
 		int ikcp_canlog(int mask);
 		int call_output(const void *data, int size);
 		char* send_out(char *ptr, char *buffer, segment *newseg);
+		char* flush_ack_ranges(char *ptr, char *buffer, segment &seg);
 	};
 }
 
@@ -8,15 +8,18 @@
 
 #include <atomic>             // std::atomic
 #include <condition_variable> // std::condition_variable
+#include <deque>
 #include <exception>          // std::current_exception
 #include <functional>         // std::bind, std::function, std::invoke
 #include <future>             // std::future, std::promise
 #include <memory>             // std::make_shared, std::make_unique, std::shared_ptr, std::unique_ptr
 #include <mutex>              // std::mutex, std::scoped_lock, std::unique_lock
 #include <list>
+#include <new>                // placement new
 #include <thread>             // std::thread
 #include <type_traits>        // std::common_type_t, std::decay_t, std::invoke_result_t, std::is_void_v
 #include <utility>            // std::forward, std::move, std::swap
+#include "../shares/packet_buffer.hpp"
 
 namespace ttp
 {
@@ -25,10 +28,123 @@ namespace ttp
 	*/
 	using concurrency_t = std::invoke_result_t<decltype(std::thread::hardware_concurrency)>;
 
-	using task_callback = std::function<void(std::unique_ptr<uint8_t[]>)>;
+	/**
+	* @brief A move-only replacement of std::function<void(packet_buffer)>. Callables up to inline_size bytes are stored in place, so handing a task to a worker does not allocate.
+	*/
+	class task_callback
+	{
+	public:
+		static constexpr size_t inline_size = 64;
+
+		task_callback() noexcept = default;
+		task_callback(std::nullptr_t) noexcept {}
+
+		template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, task_callback> && std::is_invocable_v<std::decay_t<F>&, packet_buffer>>>
+		task_callback(F &&func)
+		{
+			using callable = std::decay_t<F>;
+			if constexpr (sizeof(callable) <= inline_size && alignof(callable) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<callable>)
+			{
+				new (storage) callable(std::forward<F>(func));
+				operations = &inline_operations<callable>;
+			}
+			else
+			{
+				*reinterpret_cast<callable **>(storage) = new callable(std::forward<F>(func));
+				operations = &heap_operations<callable>;
+			}
+		}
+
+		task_callback(task_callback &&other) noexcept
+		{
+			take(other);
+		}
+
+		task_callback& operator=(task_callback &&other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				take(other);
+			}
+			return *this;
+		}
+
+		task_callback& operator=(std::nullptr_t) noexcept
+		{
+			reset();
+			return *this;
+		}
+
+		task_callback(const task_callback &) = delete;
+		task_callback& operator=(const task_callback &) = delete;
+
+		~task_callback()
+		{
+			reset();
+		}
+
+		explicit operator bool() const noexcept
+		{
+			return operations != nullptr;
+		}
+
+		void operator()(packet_buffer data)
+		{
+			operations->invoke(storage, std::move(data));
+		}
+
+	private:
+		struct operation_table
+		{
+			void (*invoke)(void *storage, packet_buffer &&data);
+			void (*move_to)(void *from, void *to);	// leaves 'from' destroyed
+			void (*destroy)(void *storage);
+		};
+
+		template <typename callable>
+		static constexpr operation_table inline_operations =
+		{
+			[](void *storage, packet_buffer &&data) { (*static_cast<callable *>(storage))(std::move(data)); },
+			[](void *from, void *to)
+			{
+				new (to) callable(std::move(*static_cast<callable *>(from)));
+				static_cast<callable *>(from)->~callable();
+			},
+			[](void *storage) { static_cast<callable *>(storage)->~callable(); }
+		};
+
+		template <typename callable>
+		static constexpr operation_table heap_operations =
+		{
+			[](void *storage, packet_buffer &&data) { (**static_cast<callable **>(storage))(std::move(data)); },
+			[](void *from, void *to) { *static_cast<callable **>(to) = *static_cast<callable **>(from); },
+			[](void *storage) { delete *static_cast<callable **>(storage); }
+		};
+
+		void take(task_callback &other) noexcept
+		{
+			if (other.operations == nullptr)
+				return;
+			other.operations->move_to(other.storage, storage);
+			operations = std::exchange(other.operations, nullptr);
+		}
+
+		void reset() noexcept
+		{
+			if (operations == nullptr)
+				return;
+			operations->destroy(storage);
+			operations = nullptr;
+		}
+
+		alignas(std::max_align_t) unsigned char storage[inline_size];
+		const operation_table *operations = nullptr;
+	};
+
 	using task_void_callback = std::function<void()>;
 
-	using task_queue = std::list<std::tuple<task_callback, std::unique_ptr<uint8_t[]>>>;
+	using task_queue = std::list<std::tuple<task_callback, packet_buffer>>;
 
 	/**
 	* @brief A fast, lightweight, and easy-to-use C++17 thread pool class. This is a lighter version of the main thread pool class.
@@ -105,11 +221,11 @@ namespace ttp
 		* @param task_function The function to push.
 		* @param data The data to be used by task_function.
 		*/
-		void push_task(task_callback task_function, std::unique_ptr<uint8_t[]> data)
+		void push_task(task_callback task_function, packet_buffer data)
 		{
 			{
 				std::scoped_lock tasks_lock(tasks_mutex);
-				tasks.push_back({ task_function, std::move(data) });
+				tasks.push_back({ std::move(task_function), std::move(data) });
 				++tasks_total;
 			}
 			task_available_cv.notify_one();
@@ -160,7 +276,7 @@ namespace ttp
 		//    return task_promise->get_future();
 		//}
 
-		template <typename R, typename D = std::unique_ptr<uint8_t[]>>
+		template <typename R, typename D = packet_buffer>
 		[[nodiscard]] std::future<R> submit(std::function<R(D)> task_function, D data)
 		{
 			std::shared_ptr<std::promise<R>> task_promise = std::make_shared<std::promise<R>>();
@@ -272,8 +388,8 @@ namespace ttp
 				if (running)
 				{
 					std::tuple tuple_values = std::move(tasks.front());
-					task_callback task = std::get<0>(tuple_values);
-					std::unique_ptr<uint8_t[]> data = std::move(std::get<1>(tuple_values));
+					task_callback task = std::move(std::get<0>(tuple_values));
+					packet_buffer data = std::move(std::get<1>(tuple_values));
 					tasks.pop_front();
 					tasks_lock.unlock();
 					task(std::move(data));
@@ -335,6 +451,98 @@ namespace ttp
 		std::atomic<bool> waiting = false;
 	};
 
+	/**
+	* @brief A bounded lock-free ring of tasks (D. Vyukov's bounded queue). Any thread can push, only the worker thread that owns the ring can pop.
+	*/
+	class task_ring
+	{
+	public:
+		/**
+		* @brief Construct a ring.
+		*
+		* @param capacity_ The number of slots, must be a power of 2.
+		*/
+		task_ring(size_t capacity_ = 4096) : slots(std::make_unique<slot[]>(capacity_)), mask(capacity_ - 1), enqueue_position(0), dequeue_position(0)
+		{
+			for (size_t i = 0; i < capacity_; ++i)
+				slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		/**
+		* @brief Try to push a task. The arguments are moved from only if the task is pushed.
+		*
+		* @return false if the ring is full.
+		*/
+		bool try_push(task_callback &task_function, packet_buffer &data)
+		{
+			size_t position = enqueue_position.load(std::memory_order_relaxed);
+			slot *current_slot = nullptr;
+			while (true)
+			{
+				current_slot = &slots[position & mask];
+				size_t sequence = current_slot->sequence.load(std::memory_order_acquire);
+				intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+				if (difference == 0)
+				{
+					if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+				{
+					return false;
+				}
+				else
+				{
+					position = enqueue_position.load(std::memory_order_relaxed);
+				}
+			}
+			current_slot->task = std::move(task_function);
+			current_slot->data = std::move(data);
+			current_slot->sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		* @brief Try to pop a task. Owner thread only; ownership may move to another thread as long as the hand-over synchronises.
+		*
+		* @return false if the ring is empty, or if the oldest slot has been claimed by a producer that has not finished writing it.
+		*/
+		bool try_pop(task_callback &task_function, packet_buffer &data)
+		{
+			size_t position = dequeue_position.load(std::memory_order_relaxed);
+			slot &current_slot = slots[position & mask];
+			if (current_slot.sequence.load(std::memory_order_acquire) != position + 1)
+				return false;
+			task_function = std::move(current_slot.task);
+			data = std::move(current_slot.data);
+			current_slot.task = nullptr;
+			current_slot.sequence.store(position + mask + 1, std::memory_order_release);
+			dequeue_position.store(position + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		/**
+		* @brief Check whether any slot has been claimed by a producer. Owner thread only.
+		*/
+		[[nodiscard]] bool empty() const
+		{
+			return enqueue_position.load(std::memory_order_acquire) == dequeue_position.load(std::memory_order_relaxed);
+		}
+
+	private:
+		struct slot
+		{
+			std::atomic<size_t> sequence;
+			task_callback task;
+			packet_buffer data;
+		};
+
+		std::unique_ptr<slot[]> slots;
+		const size_t mask;
+		alignas(64) std::atomic<size_t> enqueue_position;
+		alignas(64) std::atomic<size_t> dequeue_position;
+	};
+
 	class [[nodiscard]] task_group_pool
 	{
 	public:
@@ -351,11 +559,9 @@ namespace ttp
 			thread_count(determine_thread_count(thread_count_)),
 			threads(std::make_unique<std::thread[]>(thread_count))
 		{
-			task_queue_of_threads = std::make_unique<task_queue[]>(thread_count);
-			tasks_total_of_threads = std::make_unique<std::atomic<size_t>[]>(thread_count);
-			tasks_mutex_of_threads = std::make_unique<std::mutex[]>(thread_count);
-			task_available_cv = std::make_unique<std::condition_variable[]>(thread_count);
-
+			key_queue_count = (size_t)thread_count * key_queues_per_thread;
+			key_queues = std::make_unique<key_queue[]>(key_queue_count);
+			workers = std::make_unique<worker_state[]>(thread_count);
 			create_threads();
 		}
 
@@ -382,38 +588,60 @@ namespace ttp
 			return thread_count;
 		}
 
+		/**
+		* @brief Get the native handle of a thread in the pool, e.g. to set its CPU affinity.
+		*
+		* @param thread_number The index of the thread, from 0 to get_thread_count() - 1.
+		*/
+		[[nodiscard]] std::thread::native_handle_type get_native_handle(concurrency_t thread_number)
+		{
+			return threads[thread_number].native_handle();
+		}
+
 		[[nodiscard]]
 		size_t get_task_count(size_t number) const
 		{
-			size_t thread_number = number % thread_count;
-			return tasks_total_of_threads[thread_number].load();
+			return key_queues[key_queue_of(number)].tasks_total.load();
 		}
 
 		[[nodiscard]]
 		size_t get_task_count() const
 		{
 			size_t total = 0;
-			for (size_t i = 0; i < thread_count; ++i)
-				total += tasks_total_of_threads[i].load();
+			for (size_t i = 0; i < key_queue_count; ++i)
+				total += key_queues[i].tasks_total.load();
 			return total;
 		}
 
+		/**
+		* @brief Get the number of unfinished tasks currently assigned to a thread, either in the key-queues waiting in its ready list or in the key-queue it is running.
+		*
+		* @param thread_number The index of the thread, from 0 to get_thread_count() - 1.
+		* @return The number of tasks.
+		*/
+		[[nodiscard]]
+		size_t get_thread_depth(size_t thread_number) const
+		{
+			const worker_state &worker = workers[thread_number];
+			size_t depth = 0;
+			std::scoped_lock ready_lock(worker.ready_mutex);
+			for (uint32_t queue_number : worker.ready_queues)
+				depth += key_queues[queue_number].tasks_total.load();
+			if (uint32_t queue_number = worker.running_queue.load(); queue_number != no_key_queue)
+				depth += key_queues[queue_number].tasks_total.load();
+			return depth;
+		}
+
 		/**
 		* @brief Push a function with no parameters, and no return value, into the task queue. Does not return a future, so the user must use wait_for_tasks() or some other method to ensure that the task finishes executing, otherwise bad things will happen.
 		*
 		* @param task_function The function to push.
 		*/
-		void push_task(size_t number, task_void_callback void_task_function)
+		template <typename F, typename = std::enable_if_t<std::is_invocable_v<std::decay_t<F>&>>>
+		void push_task(size_t number, F &&void_task_function)
 		{
-			std::unique_ptr<uint8_t[]> data = nullptr;
-			size_t thread_number = number % thread_count;
-			{
-				std::scoped_lock tasks_lock(tasks_mutex_of_threads[thread_number]);
-				auto task_function = [void_task_function](std::unique_ptr<uint8_t[]> data) { void_task_function(); };
-				task_queue_of_threads[thread_number].push_back({ task_function, std::move(data) });
-				++tasks_total_of_threads[thread_number];
-			}
-			task_available_cv[thread_number].notify_one();
+			task_callback task_function = [void_task_function = std::forward<F>(void_task_function)](packet_buffer data) mutable { void_task_function(); };
+			enqueue(number, std::move(task_function), nullptr);
 		}
 
 		/**
@@ -422,31 +650,19 @@ namespace ttp
 		* @param task_function The function to push.
 		* @param data The data to be used by task_function.
 		*/
-		void push_task(size_t number, task_callback task_function, std::unique_ptr<uint8_t[]> data)
+		void push_task(size_t number, task_callback task_function, packet_buffer data)
 		{
-			size_t thread_number = number % thread_count;
-			{
-				std::scoped_lock tasks_lock(tasks_mutex_of_threads[thread_number]);
-				task_queue_of_threads[thread_number].push_back({ task_function, std::move(data) });
-				++tasks_total_of_threads[thread_number];
-			}
-			task_available_cv[thread_number].notify_one();
+			enqueue(number, std::move(task_function), std::move(data));
 		}
 
-		void push_task(size_t number, std::shared_future<task_callback> task_function_run_later, std::unique_ptr<uint8_t[]> data)
+		void push_task(size_t number, std::shared_future<std::function<void(packet_buffer)>> task_function_run_later, packet_buffer data)
 		{
-			size_t thread_number = number % thread_count;
+			task_callback task_func = [task_function_run_later](packet_buffer data)
 			{
-				std::scoped_lock tasks_lock(tasks_mutex_of_threads[thread_number]);
-				auto task_func = [task_function_run_later](std::unique_ptr<uint8_t[]> data)
-				{
-					task_callback task_function = task_function_run_later.get();
-					task_function(std::move(data));
-				};
-				task_queue_of_threads[thread_number].push_back({ task_func, std::move(data) });
-				++tasks_total_of_threads[thread_number];
-			}
-			task_available_cv[thread_number].notify_one();
+				std::function<void(packet_buffer)> task_function = task_function_run_later.get();
+				task_function(std::move(data));
+			};
+			enqueue(number, std::move(task_func), std::move(data));
 		}
 
 		/**
@@ -493,7 +709,7 @@ namespace ttp
 		//    return task_promise->get_future();
 		//}
 
-		template <typename R, typename D = std::unique_ptr<uint8_t[]>>
+		template <typename R, typename D = packet_buffer>
 		[[nodiscard]] std::future<R> submit(size_t number, std::function<R(D)> task_function, D data)
 		{
 			std::shared_ptr<std::promise<R>> task_promise = std::make_shared<std::promise<R>>();
@@ -535,16 +751,49 @@ namespace ttp
 			if (!waiting)
 			{
 				waiting = true;
-				for (concurrency_t i = 0; i < thread_count; ++i)
+				for (size_t i = 0; i < key_queue_count; ++i)
 				{
-					std::unique_lock<std::mutex> tasks_lock(tasks_mutex_of_threads[i]);
-					task_done_cv.wait(tasks_lock, [this, i] { return (tasks_total_of_threads[i].load() == 0); });
+					std::atomic<size_t> &tasks_total = key_queues[i].tasks_total;
+					for (size_t remaining = tasks_total.load(); remaining != 0; remaining = tasks_total.load())
+						tasks_total.wait(remaining);
 				}
 				waiting = false;
 			}
 		}
 
 	private:
+		static constexpr size_t key_queues_per_thread = 8;
+		static constexpr size_t key_queue_ring_size = 512;
+		static constexpr size_t key_queue_batch = 32;
+		static constexpr uint32_t no_key_queue = UINT32_MAX;
+
+		/**
+		* @brief The tasks of all keys that hash to the same slot. Only one thread runs a key-queue at a time, this is what keeps the tasks of a key in order.
+		* tasks_total counts unfinished tasks - either still in the queue, or running in a thread. scheduled is set while the key-queue is in a ready list or running.
+		*/
+		struct key_queue
+		{
+			task_ring ring{ key_queue_ring_size };
+			alignas(64) std::atomic<size_t> tasks_total = 0;
+			std::atomic<size_t> overflow_count = 0;
+			std::atomic<bool> scheduled = false;
+			std::mutex overflow_mutex;
+			task_queue overflow;
+		};
+
+		/**
+		* @brief The ready list of one thread, and what it needs to sleep. Idle threads steal key-queues from the back of the ready lists of busy threads.
+		*/
+		struct worker_state
+		{
+			mutable std::mutex ready_mutex;
+			std::deque<uint32_t> ready_queues;
+			alignas(64) std::atomic<size_t> ready_count = 0;
+			std::atomic<uint32_t> running_queue = no_key_queue;
+			alignas(64) std::atomic<uint32_t> wake_ticket = 0;
+			std::atomic<bool> sleeping = false;
+		};
+
 		// ========================
 		// Private member functions
 		// ========================
@@ -569,8 +818,8 @@ namespace ttp
 			running = false;
 			for (concurrency_t i = 0; i < thread_count; ++i)
 			{
-				const std::scoped_lock tasks_lock(tasks_mutex_of_threads[i]);
-				task_available_cv[i].notify_all();
+				workers[i].wake_ticket.fetch_add(1, std::memory_order_release);
+				workers[i].wake_ticket.notify_one();
 			}
 
 			for (concurrency_t i = 0; i < thread_count; ++i)
@@ -599,58 +848,257 @@ namespace ttp
 		}
 
 		/**
-		* @brief A worker function to be assigned to each thread in the pool. Waits until it is notified by push_task() that a task is available, and then retrieves the task from the queue and executes it. Once the task finishes, the worker notifies wait_for_tasks() in case it is waiting.
+		* @brief Find the key-queue of a key. Keys are mostly pointers, so the bits are mixed first to spread aligned addresses over all key-queues.
 		*/
-		void worker(size_t thread_number)
+		[[nodiscard]] uint32_t key_queue_of(size_t number) const
 		{
-			while (running)
+			uint64_t mixed = (uint64_t)number * 0x9E3779B97F4A7C15ull;
+			return (uint32_t)((mixed >> 32) % key_queue_count);
+		}
+
+		/**
+		* @brief Hand a task to its key-queue. Tasks go to the ring of the key-queue; if the ring is full they go to the overflow list.
+		* Once the overflow list is in use, new tasks keep going there until it has been drained, so tasks pushed by one thread never overtake each other.
+		*/
+		void enqueue(size_t number, task_callback &&task_function, packet_buffer &&data)
+		{
+			uint32_t queue_number = key_queue_of(number);
+			key_queue &queue = key_queues[queue_number];
+			queue.tasks_total.fetch_add(1);
+			if (queue.overflow_count.load(std::memory_order_acquire) > 0 || !queue.ring.try_push(task_function, data))
 			{
-				std::unique_lock<std::mutex> tasks_lock(tasks_mutex_of_threads[thread_number]);
-				task_available_cv[thread_number].wait(tasks_lock, [this, thread_number] { return !task_queue_of_threads[thread_number].empty() || !running; });
-				if (running)
+				std::scoped_lock overflow_lock(queue.overflow_mutex);
+				queue.overflow.push_back({ std::move(task_function), std::move(data) });
+				queue.overflow_count.fetch_add(1, std::memory_order_release);
+			}
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!queue.scheduled.load(std::memory_order_relaxed) && !queue.scheduled.exchange(true, std::memory_order_acq_rel))
+				schedule(queue_number % thread_count, queue_number, true);
+		}
+
+		/**
+		* @brief Append a key-queue to the ready list of a thread. If that thread is busy, an idle thread is woken up to steal it.
+		*/
+		void schedule(size_t thread_number, uint32_t queue_number, bool wake_up)
+		{
+			worker_state &worker = workers[thread_number];
+			{
+				std::scoped_lock ready_lock(worker.ready_mutex);
+				worker.ready_queues.push_back(queue_number);
+				worker.ready_count.fetch_add(1);
+			}
+
+			if (!wake_up)
+				return;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!wake_thread(worker))
+				wake_idle_thread();
+		}
+
+		/**
+		* @brief Wake up a sleeping thread. Only the caller that clears the flag pays for the wake-up call.
+		*
+		* @return false if the thread was not sleeping.
+		*/
+		bool wake_thread(worker_state &worker)
+		{
+			if (!worker.sleeping.load(std::memory_order_relaxed) || !worker.sleeping.exchange(false, std::memory_order_relaxed))
+				return false;
+			worker.wake_ticket.fetch_add(1, std::memory_order_release);
+			worker.wake_ticket.notify_one();
+			return true;
+		}
+
+		void wake_idle_thread()
+		{
+			if (sleeping_threads.load(std::memory_order_relaxed) == 0)
+				return;
+			for (concurrency_t i = 0; i < thread_count; ++i)
+			{
+				if (wake_thread(workers[i]))
+					return;
+			}
+		}
+
+		[[nodiscard]] bool has_tasks(key_queue &queue) const
+		{
+			return !queue.ring.empty() || queue.overflow_count.load(std::memory_order_acquire) > 0;
+		}
+
+		/**
+		* @brief Take the next key-queue from the ready list of this thread, or steal one from a thread that is busy running another key-queue.
+		*
+		* @return false if there is nothing to run.
+		*/
+		bool take_key_queue(size_t thread_number, uint32_t &queue_number)
+		{
+			worker_state &worker = workers[thread_number];
+			if (worker.ready_count.load(std::memory_order_relaxed) > 0)
+			{
+				std::scoped_lock ready_lock(worker.ready_mutex);
+				if (!worker.ready_queues.empty())
 				{
-					std::tuple tuple_values = std::move(task_queue_of_threads[thread_number].front());
-					task_callback task = std::get<0>(tuple_values);
-					std::unique_ptr<uint8_t[]> data = std::move(std::get<1>(tuple_values));
-					task_queue_of_threads[thread_number].pop_front();
-					tasks_lock.unlock();
-					task(std::move(data));
-					tasks_lock.lock();
-					--tasks_total_of_threads[thread_number];
-					if (waiting)
-						task_done_cv.notify_one();
+					queue_number = worker.ready_queues.front();
+					worker.ready_queues.pop_front();
+					worker.ready_count.fetch_sub(1);
+					return true;
 				}
 			}
+
+			for (concurrency_t i = 1; i < thread_count; ++i)
+			{
+				worker_state &victim = workers[(thread_number + i) % thread_count];
+				if (victim.ready_count.load(std::memory_order_relaxed) == 0 || victim.running_queue.load(std::memory_order_relaxed) == no_key_queue)
+					continue;
+				std::scoped_lock ready_lock(victim.ready_mutex);
+				if (victim.ready_queues.empty())
+					continue;
+				queue_number = victim.ready_queues.back();
+				victim.ready_queues.pop_back();
+				victim.ready_count.fetch_sub(1);
+				return true;
+			}
+			return false;
 		}
 
-		// ============
-		// Private data
-		// ============
+		/**
+		* @brief Take the oldest task of a key-queue. The overflow list is only used after everything pushed into the ring before it has been taken.
+		*
+		* @return false if there is nothing to run.
+		*/
+		bool take_task(key_queue &queue, task_callback &task_function, packet_buffer &data)
+		{
+			while (true)
+			{
+				if (queue.ring.try_pop(task_function, data))
+					return true;
+
+				if (!queue.ring.empty())
+				{
+					// A producer has claimed the slot but is still writing it
+					std::this_thread::yield();
+					continue;
+				}
+
+				if (queue.overflow_count.load(std::memory_order_acquire) == 0)
+					return false;
+
+				std::scoped_lock overflow_lock(queue.overflow_mutex);
+				if (!queue.ring.empty())
+					continue;
+				if (queue.overflow.empty())
+					return false;
+				task_function = std::move(std::get<0>(queue.overflow.front()));
+				data = std::move(std::get<1>(queue.overflow.front()));
+				queue.overflow.pop_front();
+				queue.overflow_count.fetch_sub(1, std::memory_order_release);
+				return true;
+			}
+		}
 
 		/**
-		* @brief A condition variable used to notify worker() that a new task has become available.
+		* @brief Run up to key_queue_batch tasks of a key-queue, then put it back to the ready list if it still has tasks, or release it.
+		*/
+		void run_key_queue(size_t thread_number, uint32_t queue_number)
+		{
+			worker_state &worker = workers[thread_number];
+			key_queue &queue = key_queues[queue_number];
+			worker.running_queue.store(queue_number, std::memory_order_relaxed);
+
+			// Anything left in the ready list can be stolen while this thread is busy
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (worker.ready_count.load(std::memory_order_relaxed) > 0)
+				wake_idle_thread();
+
+			task_callback task;
+			packet_buffer data;
+			for (size_t i = 0; i < key_queue_batch && take_task(queue, task, data); ++i)
+			{
+				task(std::move(data));
+				task = nullptr;
+				queue.tasks_total.fetch_sub(1);
+				if (waiting)
+					queue.tasks_total.notify_all();
+			}
+			worker.running_queue.store(no_key_queue, std::memory_order_relaxed);
+
+			if (!has_tasks(queue))
+			{
+				queue.scheduled.store(false, std::memory_order_seq_cst);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!has_tasks(queue) || queue.scheduled.exchange(true, std::memory_order_acq_rel))
+					return;
+			}
+			schedule(thread_number, queue_number, false);
+		}
+
+		/**
+		* @brief Check whether a thread has something to run or steal.
 		*/
-		std::unique_ptr<std::condition_variable[]> task_available_cv = {};
+		[[nodiscard]] bool has_ready_work(size_t thread_number) const
+		{
+			if (workers[thread_number].ready_count.load(std::memory_order_relaxed) > 0)
+				return true;
+			for (concurrency_t i = 0; i < thread_count; ++i)
+			{
+				const worker_state &victim = workers[i];
+				if (victim.ready_count.load(std::memory_order_relaxed) > 0 && victim.running_queue.load(std::memory_order_relaxed) != no_key_queue)
+					return true;
+			}
+			return false;
+		}
 
 		/**
-		* @brief A condition variable used to notify wait_for_tasks() that a tasks is done.
+		* @brief Put a thread to sleep until schedule(), run_key_queue() or destroy_threads() wakes it up.
 		*/
-		std::condition_variable task_done_cv = {};
+		void park(size_t thread_number)
+		{
+			worker_state &worker = workers[thread_number];
+			uint32_t ticket = worker.wake_ticket.load(std::memory_order_acquire);
+			worker.sleeping.store(true, std::memory_order_relaxed);
+			sleeping_threads.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (running && !has_ready_work(thread_number))
+				worker.wake_ticket.wait(ticket, std::memory_order_acquire);
+			sleeping_threads.fetch_sub(1, std::memory_order_relaxed);
+			worker.sleeping.store(false, std::memory_order_relaxed);
+		}
+
+		/**
+		* @brief A worker function to be assigned to each thread in the pool. Sleeps until it is woken up by push_task(), and then takes a key-queue and executes its tasks. Once a task finishes, the worker notifies wait_for_tasks() in case it is waiting.
+		*/
+		void worker(size_t thread_number)
+		{
+			while (running)
+			{
+				uint32_t queue_number = no_key_queue;
+				if (take_key_queue(thread_number, queue_number))
+					run_key_queue(thread_number, queue_number);
+				else
+					park(thread_number);
+			}
+		}
+
+		// ============
+		// Private data
+		// ============
 
 		/**
-		* @brief Some queues of tasks to be executed by the threads.
+		* @brief The queues of tasks to be executed by the threads, key_queues_per_thread for each thread.
 		*/
-		std::unique_ptr<task_queue[]> task_queue_of_threads;
+		std::unique_ptr<key_queue[]> key_queues;
+		size_t key_queue_count = 0;
 
 		/**
-		* @brief Some atomic variables to keep track of the total number of unfinished tasks - either still in the queue, or running in a thread.
+		* @brief The ready lists of the threads, one for each thread.
 		*/
-		std::unique_ptr<std::atomic<size_t>[]> tasks_total_of_threads;
+		std::unique_ptr<worker_state[]> workers;
 
 		/**
-		* @brief Some mutex to synchronize access to the task queue by different threads.
+		* @brief The number of threads that are sleeping, so that push_task() can skip looking for an idle thread when there is none.
 		*/
-		mutable std::unique_ptr<std::mutex[]> tasks_mutex_of_threads;
+		alignas(64) std::atomic<size_t> sleeping_threads = 0;
 
 		/**
 		* @brief The number of threads in the pool.
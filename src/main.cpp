@@ -4,6 +4,7 @@
 #include <iterator>
 #include <fstream>
 #include <limits>
+#include <list>
 #include <thread>
 
 #include <asio.hpp>
@@ -49,28 +50,14 @@ int main(int argc, char *argv[])
 
 	constexpr size_t task_count_limit = 8192u;
 	uint16_t thread_group_count = 1;
-	int io_thread_count = 1;
+	int io_concurrency_hint = 1;
 	if (std::thread::hardware_concurrency() > 3)
 	{
 		auto thread_counts = std::thread::hardware_concurrency();
 		thread_group_count = (uint16_t)(thread_counts / 2);
-		io_thread_count = (int)std::log2(thread_counts);
+		io_concurrency_hint = (int)std::log2(thread_counts);
 	}
 
-	asio::io_context ioc{ io_thread_count };
-
-	KCP::KCPUpdater kcp_updater;
-	std::unique_ptr<ttp::task_group_pool> kcp_data_sender;
-	ttp::task_group_pool task_groups_local{ thread_group_count };
-	ttp::task_group_pool task_groups_peer{ thread_group_count };
-
-	if (std::thread::hardware_concurrency() > 3)
-		kcp_data_sender = std::make_unique<ttp::task_group_pool>(std::thread::hardware_concurrency());
-
-	std::vector<client_mode> clients;
-	std::vector<relay_mode> relays;
-	std::vector<server_mode> servers;
-	std::vector<test_mode> testers;
 	std::vector<user_settings> profile_settings;
 
 	bool error_found = false;
@@ -126,8 +113,160 @@ int main(int argc, char *argv[])
 	if (error_found || check_config)
 		return 0;
 
-	for (user_settings &settings : profile_settings)
+	// Pools without a configured size fall back to these values
+	const uint16_t default_group_threads = thread_group_count;
+	const uint16_t default_sender_threads = std::thread::hardware_concurrency() > 3 ? (uint16_t)std::thread::hardware_concurrency() : 0;
+
+	int configured_io_threads = 0;
+	uint16_t kcp_updater_threads = 0;
+	uint32_t kcp_updater_busy_poll = 0;
+	uint16_t shared_local_threads = 0;
+	uint16_t shared_peer_threads = 0;
+	uint16_t shared_sender_threads = 0;
+	for (const user_settings &settings : profile_settings)
+	{
+		configured_io_threads = std::max<int>(configured_io_threads, settings.io_threads);
+		kcp_updater_threads = std::max(kcp_updater_threads, settings.kcp_updater_threads);
+		kcp_updater_busy_poll = std::max(kcp_updater_busy_poll, settings.busy_poll);
+		if (settings.isolated_pools)
+			continue;
+		shared_local_threads = std::max(shared_local_threads, settings.local_threads);
+		shared_peer_threads = std::max(shared_peer_threads, settings.peer_threads);
+		shared_sender_threads = std::max(shared_sender_threads, settings.sender_threads);
+	}
+	// Only the main thread runs the io_context unless io_threads is set
+	int io_thread_count = 1;
+	if (configured_io_threads > 0)
+	{
+		io_thread_count = configured_io_threads;
+		io_concurrency_hint = configured_io_threads;
+	}
+
+	// KCP updater threads default to log2 of the CPU core count
+	if (kcp_updater_threads == 0)
+		kcp_updater_threads = (uint16_t)(std::thread::hardware_concurrency() > 3 ? std::log2(std::thread::hardware_concurrency()) : 1);
+
+	asio::io_context ioc{ io_concurrency_hint };
+
+	KCP::KCPUpdater kcp_updater{ kcp_updater_threads, std::chrono::microseconds{ kcp_updater_busy_poll } };
+
+	// Task pools of one profile, either shared by all profiles that are not isolated or owned by a single profile
+	struct task_pool_set
+	{
+		std::unique_ptr<ttp::task_group_pool> kcp_data_sender;
+		ttp::task_group_pool task_groups_local;
+		ttp::task_group_pool task_groups_peer;
+
+		task_pool_set(uint16_t local_threads, uint16_t peer_threads, uint16_t sender_threads)
+			: task_groups_local(local_threads), task_groups_peer(peer_threads)
+		{
+			if (sender_threads > 0)
+				kcp_data_sender = std::make_unique<ttp::task_group_pool>(sender_threads);
+		}
+	};
+
+	auto thread_count_or = [](uint16_t configured, uint16_t fallback) { return configured > 0 ? configured : fallback; };
+
+	std::unique_ptr<task_pool_set> shared_pools;
+	std::list<task_pool_set> isolated_pools;
+	std::vector<task_pool_set *> profile_pools;
+	for (const user_settings &settings : profile_settings)
+	{
+		if (settings.isolated_pools)
+		{
+			profile_pools.push_back(&isolated_pools.emplace_back(
+				thread_count_or(settings.local_threads, default_group_threads),
+				thread_count_or(settings.peer_threads, default_group_threads),
+				settings.run_to_completion ? 0 : thread_count_or(settings.sender_threads, default_sender_threads)));
+			continue;
+		}
+
+		if (shared_pools == nullptr)
+			shared_pools = std::make_unique<task_pool_set>(
+				thread_count_or(shared_local_threads, default_group_threads),
+				thread_count_or(shared_peer_threads, default_group_threads),
+				thread_count_or(shared_sender_threads, default_sender_threads));
+		profile_pools.push_back(shared_pools.get());
+	}
+
+	// CPU sets of shared threads apply to the whole process, the first configuration file that sets one is used.
+	// Profiles with isolated pools keep the CPU sets of their own task pools to themselves.
+	auto first_cpu_list = [&profile_settings](std::vector<uint16_t> user_settings::*cpu_list, bool shared_pools_only)
+		{
+			for (const user_settings &settings : profile_settings)
+			{
+				if (shared_pools_only && settings.isolated_pools)
+					continue;
+				if (!(settings.*cpu_list).empty())
+					return settings.*cpu_list;
+			}
+			return std::vector<uint16_t>{};
+		};
+
+	auto pin_task_pool = [](ttp::task_group_pool &task_pool, const std::vector<uint16_t> &cpu_list)
+		{
+			if (cpu_list.empty())
+				return;
+			for (ttp::concurrency_t i = 0; i < task_pool.get_thread_count(); ++i)
+			{
+				if (!set_thread_affinity(task_pool.get_native_handle(i), cpu_list))
+					std::cerr << "Cannot set CPU affinity of task threads\n";
+			}
+		};
+
+	auto pin_task_pool_set = [&pin_task_pool](task_pool_set &pools, const std::vector<uint16_t> &cpu_list_local,
+		const std::vector<uint16_t> &cpu_list_peer, const std::vector<uint16_t> &cpu_list_sender)
+		{
+			pin_task_pool(pools.task_groups_local, cpu_list_local);
+			pin_task_pool(pools.task_groups_peer, cpu_list_peer);
+			if (pools.kcp_data_sender != nullptr)
+				pin_task_pool(*pools.kcp_data_sender, cpu_list_sender);
+		};
+
+	std::vector<uint16_t> cpu_affinity_io = first_cpu_list(&user_settings::cpu_affinity_io, false);
+	if (std::vector<uint16_t> cpu_list = first_cpu_list(&user_settings::cpu_affinity_kcp_updater, false); !cpu_list.empty())
+	{
+		for (KCP::concurrency_t i = 0; i < kcp_updater.get_thread_count(); ++i)
+		{
+			if (!set_thread_affinity(kcp_updater.get_native_handle(i), cpu_list))
+				std::cerr << "Cannot set CPU affinity of KCP update threads\n";
+		}
+	}
+	if (shared_pools != nullptr)
+		pin_task_pool_set(*shared_pools, first_cpu_list(&user_settings::cpu_affinity_local, true),
+			first_cpu_list(&user_settings::cpu_affinity_peer, true), first_cpu_list(&user_settings::cpu_affinity_sender, true));
+	for (size_t i = 0; i < profile_settings.size(); ++i)
+	{
+		if (const user_settings &settings = profile_settings[i]; settings.isolated_pools)
+			pin_task_pool_set(*profile_pools[i], settings.cpu_affinity_local, settings.cpu_affinity_peer, settings.cpu_affinity_sender);
+	}
+
+	// Profiles in run-to-completion mode encrypt and send on the thread that produced the packet
+	std::unique_ptr<ttp::task_group_pool> no_data_sender;
+
+	std::vector<client_mode> clients;
+	std::vector<relay_mode> relays;
+	std::vector<server_mode> servers;
+	std::vector<test_mode> testers;
+
+	// The main thread is one of the io threads
+	auto run_io_context = [&ioc, io_thread_count, &cpu_affinity_io]()
+		{
+			std::vector<std::thread> io_threads;
+			for (int i = 1; i < io_thread_count; ++i)
+				io_threads.emplace_back([&ioc, &cpu_affinity_io]() { set_current_thread_affinity(cpu_affinity_io); ioc.run(); });
+			set_current_thread_affinity(cpu_affinity_io);
+			ioc.run();
+			for (std::thread &io_thread : io_threads)
+				io_thread.join();
+		};
+
+	for (size_t i = 0; i < profile_settings.size(); ++i)
 	{
+		user_settings &settings = profile_settings[i];
+		std::unique_ptr<ttp::task_group_pool> &kcp_data_sender = settings.run_to_completion ? no_data_sender : profile_pools[i]->kcp_data_sender;
+		ttp::task_group_pool &task_groups_local = profile_pools[i]->task_groups_local;
+		ttp::task_group_pool &task_groups_peer = profile_pools[i]->task_groups_peer;
 		switch (settings.mode)
 		{
 		case running_mode::client:
@@ -155,7 +294,7 @@ int main(int argc, char *argv[])
 		for (test_mode &tester : testers)
 		{
 			if (tester.start())
-				ioc.run();
+				run_io_context();
 		}
 		return 0;
 	}
@@ -182,7 +321,7 @@ int main(int argc, char *argv[])
 	}
 
 	if (started_up)
-		ioc.run();
+		run_io_context();
 
 	return 0;
 }
\ No newline at end of file
@@ -252,7 +252,7 @@ void client_mode::tcp_listener_accept_incoming(std::shared_ptr<tcp_session> inco
 	handshakes[hs.get()] = hs;
 }
 
-void client_mode::tcp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_ptr_weak)
+void client_mode::tcp_listener_incoming(packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_ptr_weak)
 {
 	if (data == nullptr || incoming_session == nullptr || data_size == 0)
 		return;
@@ -269,14 +269,14 @@ void client_mode::tcp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t
 	uint8_t *data_ptr = data.get();
 
 	size_t new_data_size = packet::create_data_packet(protocol_type::tcp, data_ptr, data_size);
-	kcp_ptr->Send((const char *)data_ptr, new_data_size);
+	kcp_ptr->Send(std::move(data), (const char *)data_ptr, new_data_size);
 	uint32_t next_update_time = current_settings.blast ? kcp_ptr->Refresh() : kcp_ptr->Check();
 	kcp_updater.submit(kcp_ptr, next_update_time);
 
 	status_counters.egress_inner_traffic += data_size;
 }
 
-void client_mode::udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port)
+void client_mode::udp_listener_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port)
 {
 	if (data == nullptr || data_size == 0)
 		return;
@@ -344,7 +344,7 @@ void client_mode::udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t
 
 	size_t new_data_size = packet::create_data_packet(protocol_type::udp, data_ptr, data_size);
 
-	kcp_session->Send((const char *)data_ptr, new_data_size);
+	kcp_session->Send(std::move(data), (const char *)data_ptr, new_data_size);
 	uint32_t next_update_time = current_settings.blast ? kcp_session->Refresh() : kcp_session->Check();
 	kcp_updater.submit(kcp_session, next_update_time);
 
@@ -355,7 +355,7 @@ void client_mode::udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t
 	status_counters.egress_inner_traffic += data_size;
 }
 
-void client_mode::udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void client_mode::udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	if (kcp_ptr == nullptr || data == nullptr || data_size == 0)
 		return;
@@ -373,7 +373,7 @@ void client_mode::udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, std:
 	udp_forwarder_incoming_unpack(kcp_ptr, std::move(data), plain_size, peer, local_port_number);
 }
 
-void client_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void client_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	if (plain_size == 0)
 		return;
@@ -405,23 +405,18 @@ void client_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_pt
 		return;
 
 	if (data_ptr != nullptr && packet_data_size != 0)
+	{
 		kcp_ptr->Input((const char *)data_ptr, (long)packet_data_size);
+		if (current_settings.run_to_completion)
+			kcp_ptr->Flush();	// send ACKs now instead of waiting for the next update
+	}
 
 	resume_tcp(kcp_mappings_ptr);
 
-	while (true)
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr->ReceiveAll())
 	{
-		int buffer_size = kcp_ptr->PeekSize();
-		if (buffer_size <= 0)
-			break;
-
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
 		auto [ftr, prtcl, unpacked_data_ptr, unpacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
 
 		tcp_session *tcp_channel = kcp_mappings_ptr->local_tcp.get();
@@ -482,7 +477,7 @@ void client_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_pt
 
 			if (prtcl == protocol_type::udp)
 			{
-				std::shared_ptr<udp::endpoint> udp_endpoint = kcp_mappings_ptr->ingress_source_endpoint;
+				std::shared_ptr<udp::endpoint> udp_endpoint = kcp_mappings_ptr->get_ingress_source_endpoint();
 				asio::ip::port_type output_port = kcp_mappings_ptr->ingress_listen_port;
 				udp_access_points[output_port]->async_send_out(std::move(buffer_cache), unpacked_data_ptr, unpacked_data_size, *udp_endpoint);
 				kcp_mappings_ptr->last_data_transfer_time.store(packet::right_now());
@@ -513,7 +508,7 @@ void client_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_pt
 	}
 }
 
-void client_mode::udp_forwarder_to_disconnecting_tcp(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void client_mode::udp_forwarder_to_disconnecting_tcp(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	if (data_size == 0 || kcp_ptr == nullptr)
 		return;
@@ -552,22 +547,17 @@ void client_mode::udp_forwarder_to_disconnecting_tcp(std::shared_ptr<KCP::KCP> k
 		return;
 
 	if (data_ptr != nullptr && packet_data_size != 0)
+	{
 		kcp_ptr->Input((const char *)data_ptr, (long)packet_data_size);
+		if (current_settings.run_to_completion)
+			kcp_ptr->Flush();
+	}
 
-	while (true)
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr->ReceiveAll())
 	{
-		int buffer_size = kcp_ptr->PeekSize();
-		if (buffer_size <= 0)
-			break;
-
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
-		auto [ftr, prtcl, unpacked_data_ptr, unpacked_data_size] = packet::unpack_inner(buffer_ptr, buffer_size);
+		auto [ftr, prtcl, unpacked_data_ptr, unpacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
 		if (prtcl != protocol_type::tcp)
 		{
 			// error
@@ -717,7 +707,7 @@ int client_mode::kcp_sender(const char *buf, int len, void *user)
 	if (current_settings.fec_data == 0 || current_settings.fec_redundant == 0)
 	{
 		int buffer_size = 0;
-		std::unique_ptr<uint8_t[]> new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
+		packet_buffer new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
 		data_sender(kcp_mappings_ptr, std::move(new_buffer), buffer_size);
 	}
 	else
@@ -727,11 +717,32 @@ int client_mode::kcp_sender(const char *buf, int len, void *user)
 	return 0;
 }
 
-void client_mode::data_sender(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size)
+void client_mode::kcp_sender_flush(void *user)
 {
+	if (user == nullptr)
+		return;
+
+	kcp_mappings *kcp_mappings_ptr = (kcp_mappings *)user;
 	if (kcp_data_sender != nullptr)
 	{
-		auto func = [this, kcp_mappings_ptr, buffer_size](std::unique_ptr<uint8_t[]> new_buffer)
+		// behind the sending tasks of this round
+		kcp_data_sender->push_task((size_t)kcp_mappings_ptr, [kcp_mappings_ptr]()
+			{
+				if (kcp_mappings_ptr->egress_forwarder != nullptr)
+					kcp_mappings_ptr->egress_forwarder->flush_send_queue();
+			});
+		return;
+	}
+
+	if (kcp_mappings_ptr->egress_forwarder != nullptr)
+		kcp_mappings_ptr->egress_forwarder->flush_send_queue();
+}
+
+void client_mode::data_sender(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size)
+{
+	if (kcp_data_sender != nullptr)
+	{
+		auto func = [this, kcp_mappings_ptr, buffer_size](packet_buffer new_buffer)
 			{
 				auto [error_message, cipher_size] = encrypt_data(current_settings.encryption_password, current_settings.encryption, new_buffer.get(), (int)buffer_size);
 				if (kcp_mappings_ptr->egress_forwarder == nullptr || !error_message.empty() || cipher_size == 0)
@@ -758,7 +769,7 @@ void client_mode::fec_maker(kcp_mappings *kcp_mappings_ptr, const uint8_t *input
 
 	int conv = kcp_mappings_ptr->egress_kcp->GetConv();
 	int fec_data_buffer_size = 0;
-	std::unique_ptr<uint8_t[]> fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
+	packet_buffer fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
 		fec_controllor.fec_snd_sn.load(), fec_controllor.fec_snd_sub_sn++);
 	data_sender(kcp_mappings_ptr, std::move(fec_data_buffer), fec_data_buffer_size);
 
@@ -795,7 +806,7 @@ std::tuple<uint8_t*, size_t> client_mode::fec_unpack(std::shared_ptr<KCP::KCP> &
 	uint32_t fec_sn = packet_header.sn;
 	uint8_t fec_sub_sn = packet_header.sub_sn;
 	kcp_mappings *kcp_mappings_ptr = nullptr;
-	std::pair<std::unique_ptr<uint8_t[]>, size_t> original_data;
+	std::pair<packet_buffer, size_t> original_data;
 	if (fec_sub_sn >= current_settings.fec_data)
 	{
 		auto [packet_header_redundant, redundant_data_ptr, redundant_data_size] = packet::unpack_fec_redundant(original_data_ptr, plain_size);
@@ -970,7 +981,7 @@ void client_mode::local_disconnect(std::shared_ptr<KCP::KCP> kcp_ptr, std::share
 	std::unique_lock locker{ mux_tunnels->mutex_mux_tcp_cache};
 	if (auto iter = mux_tunnels->mux_tcp_cache.find(kcp_ptr); iter != mux_tunnels->mux_tcp_cache.end())
 	{
-		std::unique_ptr<uint8_t[]> data = std::make_unique<uint8_t[]>(mux_cancel_data.size());
+		packet_buffer data = std::make_unique<uint8_t[]>(mux_cancel_data.size());
 		uint8_t *data_ptr = data.get();
 		std::copy(mux_cancel_data.begin(), mux_cancel_data.end(), data_ptr);
 		mux_data_cache data_cache = { std::move(data), data_ptr, mux_cancel_data.size() };
@@ -1173,13 +1184,13 @@ bool client_mode::handshake_timeout_detection(kcp_mappings *kcp_mappings_ptr)
 		new_kcp_mappings_ptr = create_handshake(kcp_mappings_ptr->local_tcp, kcp_mappings_ptr->remote_output_address, kcp_mappings_ptr->remote_output_port);
 		break;
 	case protocol_type::udp:
-		new_kcp_mappings_ptr = create_handshake(*kcp_mappings_ptr->ingress_source_endpoint, kcp_mappings_ptr->remote_output_address, kcp_mappings_ptr->remote_output_port);
+		new_kcp_mappings_ptr = create_handshake(*kcp_mappings_ptr->get_ingress_source_endpoint(), kcp_mappings_ptr->remote_output_address, kcp_mappings_ptr->remote_output_port);
 		break;
 	default:
 		break;
 	}
 
-	new_kcp_mappings_ptr->ingress_source_endpoint = kcp_mappings_ptr->ingress_source_endpoint;
+	new_kcp_mappings_ptr->set_ingress_source_endpoint(kcp_mappings_ptr->get_ingress_source_endpoint());
 	new_kcp_mappings_ptr->ingress_listen_port = kcp_mappings_ptr->ingress_listen_port;
 
 	if (kcp_mappings_ptr->connection_protocol == protocol_type::udp)
@@ -1189,7 +1200,7 @@ bool client_mode::handshake_timeout_detection(kcp_mappings *kcp_mappings_ptr)
 				std::shared_ptr<kcp_mappings> old_kcp_mappings_ptr = nullptr;
 				{
 					std::scoped_lock lockers{ mutex_udp_address_map_to_handshake, mutex_expiring_handshakes, mutex_udp_seesion_caches };
-					std::shared_ptr<udp::endpoint> local_peer = new_kcp_mappings_ptr->ingress_source_endpoint;
+					std::shared_ptr<udp::endpoint> local_peer = new_kcp_mappings_ptr->get_ingress_source_endpoint();
 					auto iter = udp_address_map_to_handshake.find(*local_peer);
 					if (iter == udp_address_map_to_handshake.end())
 						return;
@@ -1289,7 +1300,7 @@ void client_mode::cleanup_expiring_data_connections()
 		if (kcp_mappings_ptr->connection_protocol == protocol_type::udp)
 		{
 			std::scoped_lock locker_udp_session_map_to_kcp {mutex_udp_local_session_map_to_kcp};
-			udp_local_session_map_to_kcp.erase(*kcp_mappings_ptr->ingress_source_endpoint);
+			udp_local_session_map_to_kcp.erase(*kcp_mappings_ptr->get_ingress_source_endpoint());
 		}
 		
 		kcp_updater.remove(kcp_ptr);
@@ -1557,6 +1568,7 @@ void client_mode::loop_get_status()
 		", send (inner): " << forwarder_send_inner << ", send (raw): " << forwarder_send_raw << ", fec recover: " << forwarder_fec_recovery << "\n";
 	output_text += oss.str();
 #endif
+	output_text += "task queue depth: local [" + task_pool_depths(sequence_task_pool_local) + "], peer [" + task_pool_depths(sequence_task_pool_peer) + "]\n";
 
 	std::shared_lock locker{ mutex_kcp_channels };
 	for (auto &[conv, kcp_mappings_pr] : kcp_channels)
@@ -1607,7 +1619,7 @@ std::shared_ptr<kcp_mappings> client_mode::create_handshake(udp::endpoint local_
 {
 	std::shared_ptr<kcp_mappings> handshake_kcp_mappings = create_handshake(feature::initialise, protocol_type::udp, remote_output_address, remote_output_port);
 	if (handshake_kcp_mappings != nullptr)
-		handshake_kcp_mappings->ingress_source_endpoint = std::make_shared<udp::endpoint>(local_endpoint);
+		handshake_kcp_mappings->set_ingress_source_endpoint(std::make_shared<udp::endpoint>(local_endpoint));
 	return handshake_kcp_mappings;
 }
 
@@ -1660,7 +1672,8 @@ std::shared_ptr<kcp_mappings> client_mode::create_handshake(feature ftr, protoco
 			if (handshake_timeout_detection((kcp_mappings *)user))
 				return 0;
 			return kcp_sender(buf, len, user);
-		});
+		},
+		[this](void *user) { kcp_sender_flush(user); });
 
 	asio::error_code ec;
 	if (current_settings.ip_version_only == ip_only_options::ipv4)
@@ -1845,11 +1858,12 @@ void client_mode::on_handshake_success(kcp_mappings *handshake_ptr, const packet
 		}
 
 		kcp_mappings_ptr->local_tcp = incoming_session;
-		kcp_ptr->SetOutput([this](const char *buf, int len, void *user) -> int { return kcp_sender(buf, len, user); });
+		kcp_ptr->SetOutput([this](const char *buf, int len, void *user) -> int { return kcp_sender(buf, len, user); },
+			[this](void *user) { kcp_sender_flush(user); });
 		kcp_ptr->SetPostUpdate([this](void *user) { resume_tcp((kcp_mappings *)user); });
 
 		std::weak_ptr<KCP::KCP> kcp_ptr_weak = kcp_ptr;
-		bool replaced = incoming_session->replace_callback([this, kcp_ptr_weak](std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session) mutable
+		bool replaced = incoming_session->replace_callback([this, kcp_ptr_weak](packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session) mutable
 			{
 				tcp_listener_incoming(std::move(data), data_size, incoming_session, kcp_ptr_weak);
 			});
@@ -1862,21 +1876,23 @@ void client_mode::on_handshake_success(kcp_mappings *handshake_ptr, const packet
 	if (ptrcl == protocol_type::udp)
 	{
 		std::scoped_lock handshake_lockers{ mutex_udp_address_map_to_handshake, mutex_expiring_handshakes, mutex_udp_seesion_caches, mutex_udp_local_session_map_to_kcp };
-		udp::endpoint local_peer = *handshake_ptr->ingress_source_endpoint;
+		udp::endpoint local_peer = *handshake_ptr->get_ingress_source_endpoint();
 		std::shared_ptr<kcp_mappings> handshake_mappings_ptr = udp_address_map_to_handshake[local_peer];
 		expiring_handshakes.insert({ handshake_mappings_ptr, timestamp });
 
-		kcp_mappings_ptr->ingress_source_endpoint = handshake_ptr->ingress_source_endpoint;
+		kcp_mappings_ptr->set_ingress_source_endpoint(handshake_ptr->get_ingress_source_endpoint());
 		kcp_mappings_ptr->ingress_listen_port = handshake_ptr->ingress_listen_port;
 		kcp_ptr->SetOutput([this](const char *buf, int len, void *user) -> int
 			{
 				return kcp_sender(buf, len, user);
-			});
+			},
+			[this](void *user) { kcp_sender_flush(user); });
 
+		packet::data_layer data_header{ .feature_value = feature::raw_data, .protocol_value = protocol_type::udp, .data = {} };
 		for (auto &data : udp_seesion_caches[handshake_mappings_ptr])
 		{
-			std::vector<uint8_t> new_data = packet::create_data_packet(protocol_type::udp, data);
-			kcp_ptr->Send((const char *)new_data.data(), new_data.size());
+			std::span<const char> buffers[] = { { (const char *)&data_header, sizeof(packet::data_layer) - 1 }, { (const char *)data.data(), data.size() } };
+			kcp_ptr->Send(buffers);
 		}
 
 		udp_address_map_to_handshake.erase(local_peer);
@@ -1931,7 +1947,7 @@ void client_mode::on_handshake_failure(kcp_mappings *handshake_ptr, const std::s
 	if (handshake_ptr->connection_protocol == protocol_type::udp)
 	{
 		std::scoped_lock lockers{ mutex_udp_address_map_to_handshake, mutex_expiring_handshakes, mutex_udp_seesion_caches };
-		std::shared_ptr<udp::endpoint> local_peer = handshake_ptr->ingress_source_endpoint;
+		std::shared_ptr<udp::endpoint> local_peer = handshake_ptr->get_ingress_source_endpoint();
 		auto iter = udp_address_map_to_handshake.find(*local_peer);
 		if (iter == udp_address_map_to_handshake.end())
 			return;
@@ -1966,7 +1982,7 @@ void client_mode::on_handshake_test_success(kcp_mappings *handshake_ptr)
 	handshakes.erase(session_iter);
 }
 
-void client_mode::handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void client_mode::handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	if (data == nullptr || data_size == 0 || kcp_ptr == nullptr)
 		return;
@@ -2001,25 +2017,16 @@ void client_mode::handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::uniqu
 	if (kcp_mappings_ptr == nullptr)
 		return;
 
-	while (true)
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr->ReceiveAll())
 	{
-		int buffer_size = kcp_ptr->PeekSize();
-		if (buffer_size <= 0)
-			break;
-
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
 		auto [ftr, prtcl, unbacked_data_ptr, unbacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
 		switch (ftr)
 		{
 		case feature::initialise:
 		{
-			std::unique_ptr<uint8_t[]> settings_data_ptr = std::make_unique<uint8_t[]>(unbacked_data_size);
+			packet_buffer settings_data_ptr = std::make_unique<uint8_t[]>(unbacked_data_size);
 			packet::convert_wrapper_byte_order(unbacked_data_ptr, settings_data_ptr.get(), unbacked_data_size);
 			const packet::settings_wrapper *basic_settings = packet::get_initialise_details_from_unpacked_data(settings_data_ptr.get());
 			if (basic_settings->inbound_bandwidth > 0 && current_settings.outbound_bandwidth > basic_settings->inbound_bandwidth)
@@ -49,6 +49,7 @@ class client_mode
 
 	status_records status_counters;
 
+	asio::strand<asio::io_context::executor_type> timer_strand;
 	asio::steady_timer timer_find_expires;
 	asio::steady_timer timer_expiring_kcp;
 	asio::steady_timer timer_keep_alive;
@@ -61,17 +62,18 @@ class client_mode
 	void multiple_listening_udp(user_settings::user_input_address_mapping &user_input_mappings, bool mux_enabled);
 
 	void tcp_listener_accept_incoming(std::shared_ptr<tcp_session> incoming_session, const std::string &remote_output_address, asio::ip::port_type remote_output_port);
-	void tcp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_ptr_weak);
-	void udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port);
+	void tcp_listener_incoming(packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_ptr_weak);
+	void udp_listener_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port);
 
-	void udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
-	void udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number);
-	void udp_forwarder_to_disconnecting_tcp(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void udp_forwarder_to_disconnecting_tcp(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
 
 	std::shared_ptr<KCP::KCP> pick_one_from_kcp_channels(protocol_type prtcl);
 	std::shared_ptr<KCP::KCP> verify_kcp_conv(std::shared_ptr<KCP::KCP> kcp_ptr, uint32_t conv, const udp::endpoint &peer);
 	int kcp_sender(const char *buf, int len, void *user);
-	void data_sender(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size);
+	void kcp_sender_flush(void *user);
+	void data_sender(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size);
 	void fec_maker(kcp_mappings *kcp_mappings_ptr, const uint8_t *input_data, int data_size);
 	std::tuple<uint8_t*, size_t> fec_unpack(std::shared_ptr<KCP::KCP> &kcp_ptr, uint8_t *original_data_ptr, size_t plain_size, const udp::endpoint &peer);
 	bool fec_find_missings(KCP::KCP *kcp_ptr, fec_control_data &fec_controllor, uint32_t fec_sn, uint8_t max_fec_data_count);
@@ -107,7 +109,7 @@ class client_mode
 	void on_handshake_success(kcp_mappings *handshake_ptr, const packet::settings_wrapper &basic_settings);
 	void on_handshake_failure(kcp_mappings *handshake_ptr, const std::string &error_message);
 	void on_handshake_test_success(kcp_mappings *handshake_ptr);
-	void handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
 
 public:
 	client_mode() = delete;
@@ -119,23 +121,35 @@ public:
 		io_context(io_context_ref),
 		kcp_updater(kcp_updater_ref),
 		kcp_data_sender(kcp_data_sender_ref),
-		timer_find_expires(io_context),
-		timer_expiring_kcp(io_context),
-		timer_keep_alive(io_context),
-		timer_status_log(io_context),
+		timer_strand(asio::make_strand(io_context)),
+		timer_find_expires(timer_strand),
+		timer_expiring_kcp(timer_strand),
+		timer_keep_alive(timer_strand),
+		timer_status_log(timer_strand),
 		sequence_task_pool_local(seq_task_pool_local),
 		sequence_task_pool_peer(seq_task_pool_peer),
 		task_limit(task_count_limit),
 		current_settings(settings),
 		conn_options{ .ip_version_only = current_settings.ip_version_only,
 		              .fib_ingress = current_settings.fib_ingress,
-		              .fib_egress = current_settings.fib_egress }
+		              .fib_egress = current_settings.fib_egress,
+		              .udp_receive_batch = current_settings.udp_receive_batch,
+		              .udp_send_batch = current_settings.udp_send_batch,
+		              .udp_send_latency = current_settings.udp_send_latency,
+		              .udp_gso = current_settings.udp_gso,
+		              .udp_gro = current_settings.udp_gro,
+		              .udp_listen_shards = current_settings.udp_listen_shards,
+		              .udp_shard_by_cpu = current_settings.udp_shard_by_cpu,
+		              .udp_io_uring = current_settings.udp_io_uring,
+		              .run_to_completion = current_settings.run_to_completion,
+		              .udp_busy_poll = current_settings.busy_poll }
 	{}
 
 	client_mode(client_mode &&existing_client) noexcept :
 		io_context(existing_client.io_context),
 		kcp_updater(existing_client.kcp_updater),
 		kcp_data_sender(existing_client.kcp_data_sender),
+		timer_strand(existing_client.timer_strand),
 		timer_find_expires(std::move(existing_client.timer_find_expires)),
 		timer_expiring_kcp(std::move(existing_client.timer_expiring_kcp)),
 		timer_keep_alive(std::move(existing_client.timer_keep_alive)),
@@ -146,7 +160,17 @@ public:
 		current_settings(std::move(existing_client.current_settings)),
 		conn_options{ .ip_version_only = current_settings.ip_version_only,
 					  .fib_ingress = current_settings.fib_ingress,
-					  .fib_egress = current_settings.fib_egress }
+					  .fib_egress = current_settings.fib_egress,
+					  .udp_receive_batch = current_settings.udp_receive_batch,
+					  .udp_send_batch = current_settings.udp_send_batch,
+					  .udp_send_latency = current_settings.udp_send_latency,
+					  .udp_gso = current_settings.udp_gso,
+					  .udp_gro = current_settings.udp_gro,
+					  .udp_listen_shards = current_settings.udp_listen_shards,
+					  .udp_shard_by_cpu = current_settings.udp_shard_by_cpu,
+					  .udp_io_uring = current_settings.udp_io_uring,
+					  .run_to_completion = current_settings.run_to_completion,
+					  .udp_busy_poll = current_settings.busy_poll }
 	{}
 
 	~client_mode();
@@ -60,7 +60,17 @@ bool relay_mode::start()
 			{
 				.ip_version_only = current_settings.ingress->ip_version_only,
 				.fib_ingress = current_settings.fib_ingress,
-				.fib_egress = current_settings.fib_egress
+				.fib_egress = current_settings.fib_egress,
+				.udp_receive_batch = current_settings.ingress->udp_receive_batch,
+				.udp_send_batch = current_settings.ingress->udp_send_batch,
+				.udp_send_latency = current_settings.ingress->udp_send_latency,
+				.udp_gso = current_settings.ingress->udp_gso,
+				.udp_gro = current_settings.ingress->udp_gro,
+				.udp_listen_shards = current_settings.ingress->udp_listen_shards,
+				.udp_shard_by_cpu = current_settings.ingress->udp_shard_by_cpu,
+				.udp_io_uring = current_settings.ingress->udp_io_uring,
+				.run_to_completion = current_settings.run_to_completion,
+				.udp_busy_poll = current_settings.ingress->busy_poll
 			};
 			udp_servers.insert({ port_number, std::make_unique<udp_server>(io_context, sequence_task_pool_peer, task_limit, listen_on_ep, func, conn_options) });
 		}
@@ -120,7 +130,7 @@ bool relay_mode::start()
 	return running_well;
 }
 
-void relay_mode::udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number)
+void relay_mode::udp_listener_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number)
 {
 	if (data == nullptr || data_size == 0)
 		return;
@@ -147,7 +157,7 @@ void relay_mode::udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t d
 	udp_listener_incoming_unpack(std::move(data), plain_size, peer, server_port_number);
 }
 
-void relay_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number)
+void relay_mode::udp_listener_incoming_unpack(packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number)
 {
 	if (data == nullptr)
 		return;
@@ -162,7 +172,7 @@ void relay_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, s
 	std::shared_ptr<kcp_mappings> kcp_mappings_ptr;
 	std::shared_ptr<KCP::KCP> kcp_ptr_ingress;
 	std::shared_ptr<KCP::KCP> kcp_ptr_egress;
-	std::pair<std::unique_ptr<uint8_t[]>, size_t> original_data;
+	std::pair<packet_buffer, size_t> original_data;
 	uint32_t fec_sn = 0;
 	uint8_t fec_sub_sn = 0;
 	if (current_settings.ingress->fec_data > 0 && current_settings.ingress->fec_redundant > 0)
@@ -226,8 +236,7 @@ void relay_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, s
 				return;
 		}
 
-		if (kcp_mappings_ptr->ingress_source_endpoint == nullptr || *kcp_mappings_ptr->ingress_source_endpoint != peer)
-			kcp_mappings_ptr->ingress_source_endpoint = std::make_shared<udp::endpoint>(peer);
+		kcp_mappings_ptr->update_ingress_source_endpoint(peer);
 
 		kcp_ptr_ingress = kcp_mappings_ptr->ingress_kcp;
 		kcp_ptr_egress = kcp_mappings_ptr->egress_kcp;
@@ -240,21 +249,14 @@ void relay_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, s
 		}
 
 		kcp_ptr_ingress->Input((const char *)data_ptr, (long)packet_data_size);
+		if (current_settings.run_to_completion)
+			kcp_ptr_ingress->Flush();	// send ACKs now instead of waiting for the next update
 	}
 
-	while (true)
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr_ingress->ReceiveAll())
 	{
-		int buffer_size = kcp_ptr_ingress->PeekSize();
-		if (buffer_size <= 0)
-			break;
-
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr_ingress->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
 		kcp_mappings_ptr->ingress_listener.store(udp_servers[server_port_number].get());
 
 		auto [ftr, prtcl, unpacked_data_ptr, unpacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
@@ -306,7 +308,7 @@ void relay_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, s
 	}
 }
 
-void relay_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
+void relay_mode::udp_listener_incoming_new_connection(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
 {
 	if (data_size == 0)
 		return;
@@ -338,7 +340,7 @@ void relay_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]>
 			std::shared_ptr<kcp_mappings> handshake_kcp_mappings_ptr = std::make_shared<kcp_mappings>();
 			handshake_ingress_map_to_channels[peer] = handshake_kcp_mappings_ptr;
 			kcp_mappings *handshake_kcp_mappings = handshake_kcp_mappings_ptr.get();
-			handshake_kcp_mappings->ingress_source_endpoint = std::make_shared<udp::endpoint>(peer);
+			handshake_kcp_mappings->set_ingress_source_endpoint(std::make_shared<udp::endpoint>(peer));
 			handshake_kcp_mappings->ingress_listener.store(udp_servers[port_number].get());
 			if (current_settings.ingress->fec_data > 0 && current_settings.ingress->fec_redundant > 0)
 			{
@@ -356,7 +358,8 @@ void relay_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]>
 			handshake_kcp_ingress->SetOutput([this](const char *buf, int len, void *user) -> int
 				{
 					return kcp_sender_via_listener(buf, len, user);
-				});
+				},
+				[this](void *user) { kcp_sender_flush_via_listener(user); });
 
 			if (handshake_kcp_ingress->Input((const char *)data_ptr, (long)packet_data_size) < 0)
 				return;
@@ -374,7 +377,7 @@ void relay_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]>
 			{
 			case feature::initialise:
 			{
-				std::unique_ptr<uint8_t[]> settings_data_ptr = std::make_unique<uint8_t[]>(unpacked_data_size);
+				packet_buffer settings_data_ptr = std::make_unique<uint8_t[]>(unpacked_data_size);
 				packet::convert_wrapper_byte_order(unpacked_data_ptr, settings_data_ptr.get(), unpacked_data_size);
 				const packet::settings_wrapper *basic_settings_ptr = packet::get_initialise_details_from_unpacked_data(settings_data_ptr.get());
 				packet::settings_wrapper basic_settings = *basic_settings_ptr;
@@ -399,7 +402,17 @@ void relay_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]>
 					{
 						.ip_version_only = current_settings.egress->ip_version_only,
 						.fib_ingress = current_settings.fib_ingress,
-						.fib_egress = current_settings.fib_egress
+						.fib_egress = current_settings.fib_egress,
+						.udp_receive_batch = current_settings.egress->udp_receive_batch,
+						.udp_send_batch = current_settings.egress->udp_send_batch,
+						.udp_send_latency = current_settings.egress->udp_send_latency,
+						.udp_gso = current_settings.egress->udp_gso,
+						.udp_gro = current_settings.egress->udp_gro,
+						.udp_listen_shards = current_settings.egress->udp_listen_shards,
+						.udp_shard_by_cpu = current_settings.egress->udp_shard_by_cpu,
+						.udp_io_uring = current_settings.egress->udp_io_uring,
+						.run_to_completion = current_settings.run_to_completion,
+						.udp_busy_poll = current_settings.egress->busy_poll
 					};
 					auto udp_func = std::bind(&relay_mode::udp_forwarder_incoming, this, _1, _2, _3, _4, _5);
 					udp_forwarder = std::make_shared<forwarder>(io_context, sequence_task_pool_local, task_limit, handshake_kcp_egress, udp_func, conn_options);
@@ -436,7 +449,8 @@ void relay_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]>
 				handshake_kcp_egress->SetOutput([this](const char *buf, int len, void *user) -> int
 					{
 						return kcp_sender_via_forwarder(buf, len, user);
-					});
+					},
+					[this](void *user) { kcp_sender_flush_via_forwarder(user); });
 
 				bool connect_success = get_udp_target(udp_forwarder, handshake_kcp_mappings->egress_target_endpoint);
 				if (current_settings.egress->ip_version_only == ip_only_options::ipv4)
@@ -514,7 +528,7 @@ void relay_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]>
 	}
 }
 
-void relay_mode::udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void relay_mode::udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	if (data == nullptr || data_size == 0 || kcp_ptr == nullptr)
 		return;
@@ -530,7 +544,7 @@ void relay_mode::udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, std::
 	udp_forwarder_incoming_unpack(kcp_ptr, std::move(data), plain_size, peer, local_port_number);
 }
 
-void relay_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void relay_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	auto [packet_timestamp, data_ptr, packet_data_size] = packet::unpack(data.get(), plain_size);
 	auto timestamp = packet::right_now();
@@ -539,7 +553,7 @@ void relay_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr
 
 	uint32_t conv = 0;
 	kcp_mappings *kcp_mappings_ptr = nullptr;
-	std::pair<std::unique_ptr<uint8_t[]>, size_t> original_data;
+	std::pair<packet_buffer, size_t> original_data;
 	uint32_t fec_sn = 0;
 	uint8_t fec_sub_sn = 0;
 	if (current_settings.egress->fec_data > 0 && current_settings.egress->fec_redundant > 0)
@@ -591,21 +605,16 @@ void relay_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr
 	}
 
 	if (data_ptr != nullptr && packet_data_size != 0)
+	{
 		kcp_ptr->Input((const char *)data_ptr, (long)packet_data_size);
+		if (current_settings.run_to_completion)
+			kcp_ptr->Flush();
+	}
 
-	while (true)
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr->ReceiveAll())
 	{
-		int buffer_size = kcp_ptr->PeekSize();
-		if (buffer_size <= 0)
-			break;
-
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
 		auto [ftr, prtcl, unbacked_data_ptr, unbacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
 		switch (ftr)
 		{
@@ -613,7 +622,7 @@ void relay_mode::udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr
 		{
 			if (conv == 0)
 			{
-				std::unique_ptr<uint8_t[]> settings_data_ptr = std::make_unique<uint8_t[]>(unbacked_data_size);
+				packet_buffer settings_data_ptr = std::make_unique<uint8_t[]>(unbacked_data_size);
 				packet::convert_wrapper_byte_order(unbacked_data_ptr, settings_data_ptr.get(), unbacked_data_size);
 				const packet::settings_wrapper *basic_settings_ptr = packet::get_initialise_details_from_unpacked_data(settings_data_ptr.get());
 				packet::settings_wrapper basic_settings = *basic_settings_ptr;
@@ -749,7 +758,17 @@ void relay_mode::switch_new_port(kcp_mappings * kcp_mappings_ptr)
 		{
 			.ip_version_only = current_settings.egress->ip_version_only,
 			.fib_ingress = current_settings.fib_ingress,
-			.fib_egress = current_settings.fib_egress
+			.fib_egress = current_settings.fib_egress,
+			.udp_receive_batch = current_settings.egress->udp_receive_batch,
+			.udp_send_batch = current_settings.egress->udp_send_batch,
+			.udp_send_latency = current_settings.egress->udp_send_latency,
+			.udp_gso = current_settings.egress->udp_gso,
+			.udp_gro = current_settings.egress->udp_gro,
+			.udp_listen_shards = current_settings.egress->udp_listen_shards,
+			.udp_shard_by_cpu = current_settings.egress->udp_shard_by_cpu,
+			.udp_io_uring = current_settings.egress->udp_io_uring,
+			.run_to_completion = current_settings.run_to_completion,
+			.udp_busy_poll = current_settings.egress->busy_poll
 		};
 		auto udp_func = std::bind(&relay_mode::udp_forwarder_incoming, this, _1, _2, _3, _4, _5);
 		udp_forwarder = std::make_shared<forwarder>(io_context, sequence_task_pool_local, task_limit, kcp_ptr_egress, udp_func, conn_options);
@@ -837,7 +856,8 @@ void relay_mode::create_kcp_bidirections(uint32_t new_id, kcp_mappings *handshak
 	kcp_ptr_ingress->SetOutput([this](const char *buf, int len, void *user) -> int
 		{
 			return kcp_sender_via_listener(buf, len, user);
-		});
+		},
+		[this](void *user) { kcp_sender_flush_via_listener(user); });
 	kcp_ptr_ingress->SetUserData(kcp_mappings_ptr);
 	kcp_ptr_ingress->keep_alive_send_time.store(timestamp);
 	kcp_ptr_ingress->keep_alive_response_time.store(timestamp);
@@ -850,7 +870,17 @@ void relay_mode::create_kcp_bidirections(uint32_t new_id, kcp_mappings *handshak
 		{
 			.ip_version_only = current_settings.egress->ip_version_only,
 			.fib_ingress = current_settings.fib_ingress,
-			.fib_egress = current_settings.fib_egress
+			.fib_egress = current_settings.fib_egress,
+			.udp_receive_batch = current_settings.egress->udp_receive_batch,
+			.udp_send_batch = current_settings.egress->udp_send_batch,
+			.udp_send_latency = current_settings.egress->udp_send_latency,
+			.udp_gso = current_settings.egress->udp_gso,
+			.udp_gro = current_settings.egress->udp_gro,
+			.udp_listen_shards = current_settings.egress->udp_listen_shards,
+			.udp_shard_by_cpu = current_settings.egress->udp_shard_by_cpu,
+			.udp_io_uring = current_settings.egress->udp_io_uring,
+			.run_to_completion = current_settings.run_to_completion,
+			.udp_busy_poll = current_settings.egress->busy_poll
 		};
 		auto udp_func = std::bind(&relay_mode::udp_forwarder_incoming, this, _1, _2, _3, _4, _5);
 		udp_forwarder = std::make_shared<forwarder>(io_context, sequence_task_pool_peer, task_limit, kcp_ptr_egress, udp_func, conn_options);
@@ -887,7 +917,8 @@ void relay_mode::create_kcp_bidirections(uint32_t new_id, kcp_mappings *handshak
 	kcp_ptr_egress->SetOutput([this](const char *buf, int len, void *user) -> int
 		{
 			return kcp_sender_via_forwarder(buf, len, user);
-		});
+		},
+		[this](void *user) { kcp_sender_flush_via_forwarder(user); });
 	kcp_ptr_egress->Update();
 	kcp_ptr_egress->SetUserData(kcp_mappings_ptr);
 	kcp_ptr_ingress->keep_alive_send_time.store(timestamp);
@@ -956,7 +987,17 @@ std::shared_ptr<kcp_mappings> relay_mode::create_test_handshake()
 		{
 			.ip_version_only = current_settings.egress->ip_version_only,
 			.fib_ingress = current_settings.fib_ingress,
-			.fib_egress = current_settings.fib_egress
+			.fib_egress = current_settings.fib_egress,
+			.udp_receive_batch = current_settings.egress->udp_receive_batch,
+			.udp_send_batch = current_settings.egress->udp_send_batch,
+			.udp_send_latency = current_settings.egress->udp_send_latency,
+			.udp_gso = current_settings.egress->udp_gso,
+			.udp_gro = current_settings.egress->udp_gro,
+			.udp_listen_shards = current_settings.egress->udp_listen_shards,
+			.udp_shard_by_cpu = current_settings.egress->udp_shard_by_cpu,
+			.udp_io_uring = current_settings.egress->udp_io_uring,
+			.run_to_completion = current_settings.run_to_completion,
+			.udp_busy_poll = current_settings.egress->busy_poll
 		};
 		auto udp_func = std::bind(&relay_mode::handle_test_handshake, this, _1, _2, _3, _4, _5);
 		udp_forwarder = std::make_shared<forwarder>(io_context, sequence_task_pool_peer, task_limit, handshake_kcp, udp_func, conn_options);
@@ -992,7 +1033,8 @@ std::shared_ptr<kcp_mappings> relay_mode::create_test_handshake()
 			if (handshake_timeout_detection((kcp_mappings *)user))
 				return 0;
 			return kcp_sender_via_forwarder(buf, len, user);
-		});
+		},
+		[this](void *user) { kcp_sender_flush_via_forwarder(user); });
 
 	asio::error_code ec;
 	if (current_settings.ip_version_only == ip_only_options::ipv4)
@@ -1010,7 +1052,7 @@ std::shared_ptr<kcp_mappings> relay_mode::create_test_handshake()
 	return handshake_kcp_mappings;
 }
 
-void relay_mode::handle_test_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void relay_mode::handle_test_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	if (data == nullptr || data_size == 0 || kcp_ptr == nullptr)
 		return;
@@ -1045,19 +1087,10 @@ void relay_mode::handle_test_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::u
 	if (kcp_mappings_ptr == nullptr)
 		return;
 
-	while (true)
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr->ReceiveAll())
 	{
-		int buffer_size = kcp_ptr->PeekSize();
-		if (buffer_size <= 0)
-			break;
-
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
 		auto [ftr, prtcl, unbacked_data_ptr, unbacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
 		switch (ftr)
 		{
@@ -1132,13 +1165,13 @@ int relay_mode::kcp_sender_via_listener(const char *buf, int len, void *user)
 		return 0;
 
 	kcp_mappings *kcp_mappings_ptr = (kcp_mappings *)user;
-	if (kcp_mappings_ptr->ingress_source_endpoint == nullptr)
+	if (kcp_mappings_ptr->get_ingress_source_endpoint() == nullptr)
 		return 0;
 
 	if (current_settings.fec_data == 0 || current_settings.fec_redundant == 0)
 	{
 		int buffer_size = 0;
-		std::unique_ptr<uint8_t[]> new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
+		packet_buffer new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
 		data_sender_via_listener(kcp_mappings_ptr, std::move(new_buffer), buffer_size);
 	}
 	else
@@ -1157,7 +1190,7 @@ int relay_mode::kcp_sender_via_forwarder(const char *buf, int len, void *user)
 	if (current_settings.fec_data == 0 || current_settings.fec_redundant == 0)
 	{
 		int buffer_size = 0;
-		std::unique_ptr<uint8_t[]> new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
+		packet_buffer new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
 		data_sender_via_forwarder(kcp_mappings_ptr, std::move(new_buffer), buffer_size);
 	}
 	else
@@ -1167,6 +1200,46 @@ int relay_mode::kcp_sender_via_forwarder(const char *buf, int len, void *user)
 	return 0;
 }
 
+void relay_mode::kcp_sender_flush_via_listener(void *user)
+{
+	if (user == nullptr)
+		return;
+
+	kcp_mappings *kcp_mappings_ptr = (kcp_mappings *)user;
+	if (kcp_data_sender != nullptr)
+	{
+		// behind the sending tasks of this round
+		kcp_data_sender->push_task((size_t)kcp_mappings_ptr->ingress_kcp.get(), [kcp_mappings_ptr]()
+			{
+				kcp_mappings_ptr->ingress_listener.load()->flush_send_queue();
+			});
+		return;
+	}
+
+	kcp_mappings_ptr->ingress_listener.load()->flush_send_queue();
+}
+
+void relay_mode::kcp_sender_flush_via_forwarder(void *user)
+{
+	if (user == nullptr)
+		return;
+
+	kcp_mappings *kcp_mappings_ptr = (kcp_mappings *)user;
+	if (kcp_data_sender != nullptr)
+	{
+		// behind the sending tasks of this round
+		kcp_data_sender->push_task((size_t)kcp_mappings_ptr->egress_kcp.get(), [kcp_mappings_ptr]()
+			{
+				if (kcp_mappings_ptr->egress_forwarder != nullptr)
+					kcp_mappings_ptr->egress_forwarder->flush_send_queue();
+			});
+		return;
+	}
+
+	if (kcp_mappings_ptr->egress_forwarder != nullptr)
+		kcp_mappings_ptr->egress_forwarder->flush_send_queue();
+}
+
 std::shared_ptr<KCP::KCP> relay_mode::verify_kcp_conv(std::shared_ptr<KCP::KCP> kcp_ptr, uint32_t conv, const udp::endpoint & peer)
 {
 	if (kcp_ptr->GetConv() != conv)
@@ -1188,16 +1261,16 @@ std::shared_ptr<KCP::KCP> relay_mode::verify_kcp_conv(std::shared_ptr<KCP::KCP>
 	return kcp_ptr;
 }
 
-void relay_mode::data_sender_via_listener(kcp_mappings * kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size)
+void relay_mode::data_sender_via_listener(kcp_mappings * kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size)
 {
 	if (kcp_data_sender != nullptr)
 	{
-		auto func = [this, kcp_mappings_ptr, buffer_size](std::unique_ptr<uint8_t[]> new_buffer)
+		auto func = [this, kcp_mappings_ptr, buffer_size](packet_buffer new_buffer)
 			{
 				auto [error_message, cipher_size] = encrypt_data(current_settings.ingress->encryption_password, current_settings.ingress->encryption, new_buffer.get(), (int)buffer_size);
 				if (!error_message.empty() || cipher_size == 0)
 					return;
-				std::shared_ptr<udp::endpoint> ingress_source_endpoint = kcp_mappings_ptr->ingress_source_endpoint;
+				std::shared_ptr<udp::endpoint> ingress_source_endpoint = kcp_mappings_ptr->get_ingress_source_endpoint();
 				kcp_mappings_ptr->ingress_listener.load()->async_send_out(std::move(new_buffer), cipher_size, *ingress_source_endpoint);
 				change_new_port(kcp_mappings_ptr);
 				listener_status_counters.egress_raw_traffic += buffer_size;
@@ -1209,17 +1282,17 @@ void relay_mode::data_sender_via_listener(kcp_mappings * kcp_mappings_ptr, std::
 	auto [error_message, cipher_size] = encrypt_data(current_settings.ingress->encryption_password, current_settings.ingress->encryption, new_buffer.get(), (int)buffer_size);
 	if (!error_message.empty() || cipher_size == 0)
 		return;
-	std::shared_ptr<udp::endpoint> ingress_source_endpoint = kcp_mappings_ptr->ingress_source_endpoint;
+	std::shared_ptr<udp::endpoint> ingress_source_endpoint = kcp_mappings_ptr->get_ingress_source_endpoint();
 	kcp_mappings_ptr->ingress_listener.load()->async_send_out(std::move(new_buffer), cipher_size, *ingress_source_endpoint);
 	change_new_port(kcp_mappings_ptr);
 	listener_status_counters.egress_raw_traffic += buffer_size;
 }
 
-void relay_mode::data_sender_via_forwarder(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size)
+void relay_mode::data_sender_via_forwarder(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size)
 {
 	if (kcp_data_sender != nullptr)
 	{
-		auto func = [this, kcp_mappings_ptr, buffer_size](std::unique_ptr<uint8_t[]> new_buffer)
+		auto func = [this, kcp_mappings_ptr, buffer_size](packet_buffer new_buffer)
 			{
 				auto [error_message, cipher_size] = encrypt_data(current_settings.ingress->encryption_password, current_settings.ingress->encryption, new_buffer.get(), (int)buffer_size);
 				if (kcp_mappings_ptr->egress_forwarder == nullptr || !error_message.empty() || cipher_size == 0)
@@ -1300,7 +1373,7 @@ void relay_mode::fec_maker_via_listener(kcp_mappings *kcp_mappings_ptr, const ui
 
 	int conv = kcp_mappings_ptr->ingress_kcp->GetConv();
 	int fec_data_buffer_size = 0;
-	std::unique_ptr<uint8_t[]> fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
+	packet_buffer fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
 		fec_controllor.fec_snd_sn.load(), fec_controllor.fec_snd_sub_sn++);
 	data_sender_via_listener(kcp_mappings_ptr, std::move(fec_data_buffer), fec_data_buffer_size);
 
@@ -1335,7 +1408,7 @@ void relay_mode::fec_maker_via_forwarder(kcp_mappings *kcp_mappings_ptr, const u
 
 	int conv = kcp_mappings_ptr->egress_kcp->GetConv();
 	int fec_data_buffer_size = 0;
-	std::unique_ptr<uint8_t[]> fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
+	packet_buffer fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
 		fec_controllor.fec_snd_sn.load(), fec_controllor.fec_snd_sub_sn++);
 	data_sender_via_forwarder(kcp_mappings_ptr, std::move(fec_data_buffer), fec_data_buffer_size);
 
@@ -1510,7 +1583,7 @@ void relay_mode::cleanup_expiring_handshake_connections()
 		handshakes_kcp_mappings_ptr->egress_kcp->SetUserData(nullptr);
 		kcp_updater.remove(handshakes_kcp_mappings_ptr->ingress_kcp);
 		kcp_updater.remove(handshakes_kcp_mappings_ptr->egress_kcp);
-		handshake_ingress_map_to_channels.erase(*handshakes_kcp_mappings_ptr->ingress_source_endpoint);
+		handshake_ingress_map_to_channels.erase(*handshakes_kcp_mappings_ptr->get_ingress_source_endpoint());
 		expiring_handshakes.erase(iter);
 	}
 }
@@ -1794,6 +1867,7 @@ void relay_mode::loop_get_status()
 		", send (inner): " << forwarder_send_inner << ", send (raw): " << forwarder_send_raw << ", fec recover: " << forwarder_fec_recovery << "\n";
 	output_text += oss.str();
 #endif
+	output_text += "task queue depth: local [" + task_pool_depths(sequence_task_pool_local) + "], peer [" + task_pool_depths(sequence_task_pool_peer) + "]\n";
 
 	std::shared_lock locker{ mutex_id_map_to_both_sides };
 	for (auto &[conv, kcp_mappings_pr] : id_map_to_both_sides)
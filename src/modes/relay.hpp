@@ -44,6 +44,7 @@ class relay_mode
 	status_records listener_status_counters;
 	status_records forwarder_status_counters;
 
+	asio::strand<asio::io_context::executor_type> timer_strand;
 	asio::steady_timer timer_find_expires;
 	asio::steady_timer timer_expiring_kcp;
 	asio::steady_timer timer_stun;
@@ -57,23 +58,25 @@ class relay_mode
 	std::shared_mutex mutex_egress_target_address;
 	std::unique_ptr<asio::ip::address> target_address;
 
-	void udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number);
-	void udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number);
-	void udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number);
-	void udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
-	void udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void udp_listener_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number);
+	void udp_listener_incoming_unpack(packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number);
+	void udp_listener_incoming_new_connection(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number);
+	void udp_forwarder_incoming(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void udp_forwarder_incoming_unpack(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type local_port_number);
 	void change_new_port(kcp_mappings *kcp_mappings_ptr);
 	void test_before_change(kcp_mappings *kcp_mappings_ptr);
 	void switch_new_port(kcp_mappings *kcp_mappings_ptr);
 	void create_kcp_bidirections(uint32_t new_id, kcp_mappings *handshake_kcp_mappings_ptr);
 	std::shared_ptr<kcp_mappings> create_test_handshake();
-	void handle_test_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void handle_test_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
 	bool handshake_timeout_detection(kcp_mappings *kcp_mappings_ptr);
 	int kcp_sender_via_listener(const char *buf, int len, void *user);
 	int kcp_sender_via_forwarder(const char *buf, int len, void *user);
+	void kcp_sender_flush_via_listener(void *user);
+	void kcp_sender_flush_via_forwarder(void *user);
 	std::shared_ptr<KCP::KCP> verify_kcp_conv(std::shared_ptr<KCP::KCP> kcp_ptr, uint32_t conv, const udp::endpoint &peer);
-	void data_sender_via_listener(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size);
-	void data_sender_via_forwarder(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size);
+	void data_sender_via_listener(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size);
+	void data_sender_via_forwarder(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size);
 	std::pair<bool, size_t> fec_find_missings(KCP::KCP *kcp_ptr, fec_control_data &fec_controllor, uint32_t fec_sn, uint8_t max_fec_data_count);
 	void fec_maker_via_listener(kcp_mappings *kcp_mappings_ptr, const uint8_t *input_data, int data_size);
 	void fec_maker_via_forwarder(kcp_mappings *kcp_mappings_ptr, const uint8_t *input_data, int data_size);
@@ -106,10 +109,11 @@ public:
 		ttp::task_group_pool &seq_task_pool_local, ttp::task_group_pool &seq_task_pool_peer, size_t task_count_limit, const user_settings &settings)
 		: io_context(io_context_ref), kcp_updater(kcp_updater_ref),
 		kcp_data_sender(kcp_data_sender_ref),
-		timer_find_expires(io_context), timer_expiring_kcp(io_context),
-		timer_stun(io_context),
-		timer_keep_alive_ingress(io_context), timer_keep_alive_egress(io_context),
-		timer_status_log(io_context),
+		timer_strand(asio::make_strand(io_context)),
+		timer_find_expires(timer_strand), timer_expiring_kcp(timer_strand),
+		timer_stun(timer_strand),
+		timer_keep_alive_ingress(timer_strand), timer_keep_alive_egress(timer_strand),
+		timer_status_log(timer_strand),
 		sequence_task_pool_local(seq_task_pool_local),
 		sequence_task_pool_peer(seq_task_pool_peer),
 		task_limit(task_count_limit),
@@ -124,6 +128,7 @@ public:
 		: io_context(existing_relay.io_context),
 		kcp_updater(existing_relay.kcp_updater),
 		kcp_data_sender(existing_relay.kcp_data_sender),
+		timer_strand(existing_relay.timer_strand),
 		timer_find_expires(std::move(existing_relay.timer_find_expires)),
 		timer_expiring_kcp(std::move(existing_relay.timer_expiring_kcp)),
 		timer_stun(std::move(existing_relay.timer_stun)),
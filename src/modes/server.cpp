@@ -117,7 +117,7 @@ bool server_mode::start()
 	return running_well;
 }
 
-void server_mode::udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number)
+void server_mode::udp_listener_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number)
 {
 	if (data == nullptr || data_size == 0)
 		return;
@@ -144,7 +144,7 @@ void server_mode::udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t
 	udp_listener_incoming_unpack(std::move(data), plain_size, peer, server_port_number);
 }
 
-void server_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number)
+void server_mode::udp_listener_incoming_unpack(packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number)
 {
 	if (data == nullptr)
 		return;
@@ -158,7 +158,7 @@ void server_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data,
 	uint32_t conv = 0;
 	std::shared_ptr<kcp_mappings> kcp_mappings_ptr;
 	std::shared_ptr<KCP::KCP> kcp_ptr;
-	std::pair<std::unique_ptr<uint8_t[]>, size_t> original_data;
+	std::pair<packet_buffer, size_t> original_data;
 	uint32_t fec_sn = 0;
 	uint8_t fec_sub_sn = 0;
 	if (current_settings.fec_data > 0 && current_settings.fec_redundant > 0)
@@ -217,8 +217,7 @@ void server_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data,
 				return;
 		}
 
-		if (kcp_mappings_ptr->ingress_source_endpoint == nullptr || *kcp_mappings_ptr->ingress_source_endpoint != peer)
-			kcp_mappings_ptr->ingress_source_endpoint = std::make_shared<udp::endpoint>(peer);
+		kcp_mappings_ptr->update_ingress_source_endpoint(peer);
 
 		kcp_ptr = kcp_mappings_ptr->ingress_kcp;
 
@@ -229,23 +228,19 @@ void server_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data,
 		}
 
 		kcp_ptr->Input((const char *)data_ptr, (long)packet_data_size);
+		if (current_settings.run_to_completion)
+			kcp_ptr->Flush();	// send ACKs now instead of waiting for the next update
 	}
 
 	resume_tcp(kcp_mappings_ptr.get());
 
-	while (kcp_ptr != nullptr)
-	{
-		int buffer_size = kcp_ptr->PeekSize();
-		if (buffer_size <= 0)
-			break;
+	if (kcp_ptr == nullptr)
+		return;
 
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr->ReceiveAll())
+	{
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
 		kcp_mappings_ptr->ingress_listener.store(udp_servers[server_port_number].get());
 
 		auto [ftr, prtcl, unpacked_data_ptr, unpacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
@@ -328,7 +323,7 @@ void server_mode::udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data,
 	}
 }
 
-void server_mode::tcp_connector_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_session_weak)
+void server_mode::tcp_connector_incoming(packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_session_weak)
 {
 	if (data == nullptr || incoming_session == nullptr)
 		return;
@@ -344,14 +339,14 @@ void server_mode::tcp_connector_incoming(std::unique_ptr<uint8_t[]> data, size_t
 
 	uint8_t *data_ptr = data.get();
 	size_t new_data_size = packet::create_data_packet(protocol_type::tcp, data_ptr, data_size);
-	kcp_session->Send((const char *)data_ptr, new_data_size);
+	kcp_session->Send(std::move(data), (const char *)data_ptr, new_data_size);
 	uint32_t next_update_time = current_settings.blast ? kcp_session->Refresh() : kcp_session->Check();
 	kcp_updater.submit(kcp_session, next_update_time);
 
 	status_counters.egress_inner_traffic += data_size;
 }
 
-void server_mode::udp_connector_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak)
+void server_mode::udp_connector_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak)
 {
 	if (data == nullptr)
 		return;
@@ -366,14 +361,14 @@ void server_mode::udp_connector_incoming(std::unique_ptr<uint8_t[]> data, size_t
 	uint8_t *data_ptr = data.get();
 	size_t new_data_size = packet::create_data_packet(protocol_type::udp, data_ptr, data_size);
 
-	kcp_session->Send((const char *)data_ptr, new_data_size);
+	kcp_session->Send(std::move(data), (const char *)data_ptr, new_data_size);
 	uint32_t next_update_time = kcp_session->Check();
 	kcp_updater.submit(kcp_session, next_update_time);
 
 	status_counters.egress_inner_traffic += data_size;
 }
 
-void server_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
+void server_mode::udp_listener_incoming_new_connection(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
 {
 	if (data_size == 0)
 		return;
@@ -403,7 +398,7 @@ void server_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]
 			std::shared_ptr<kcp_mappings> handshake_kcp_mappings = std::make_shared<kcp_mappings>();
 			kcp_mappings *handshake_kcp_mappings_ptr = handshake_kcp_mappings.get();
 			handshake_kcp_mappings_ptr->ingress_kcp = handshake_kcp;
-			handshake_kcp_mappings_ptr->ingress_source_endpoint = std::make_shared<udp::endpoint>(peer);
+			handshake_kcp_mappings_ptr->set_ingress_source_endpoint(std::make_shared<udp::endpoint>(peer));
 			handshake_kcp_mappings_ptr->ingress_listener.store(udp_servers[port_number].get());
 
 			if (current_settings.fec_data > 0 && current_settings.fec_redundant > 0)
@@ -422,7 +417,8 @@ void server_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]
 			handshake_kcp->SetOutput([this](const char *buf, int len, void *user) -> int
 				{
 					return kcp_sender(buf, len, user);
-				});
+				},
+				[this](void *user) { kcp_sender_flush(user); });
 
 			if (handshake_kcp->Input((const char *)data_ptr, (long)packet_data_size) < 0)
 				return;
@@ -450,7 +446,7 @@ void server_mode::udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]
 				}
 				locker_kcp_channels.unlock();
 
-				std::unique_ptr<uint8_t[]> settings_data_ptr = std::make_unique<uint8_t[]>(unbacked_data_size);
+				packet_buffer settings_data_ptr = std::make_unique<uint8_t[]>(unbacked_data_size);
 				packet::convert_wrapper_byte_order(unbacked_data_ptr, settings_data_ptr.get(), unbacked_data_size);
 				const packet::settings_wrapper *basic_settings = packet::get_initialise_details_from_unpacked_data(settings_data_ptr.get());
 				uint64_t outbound_bandwidth = current_settings.outbound_bandwidth;
@@ -579,7 +575,7 @@ bool server_mode::create_new_tcp_connection(std::shared_ptr<KCP::KCP> handshake_
 {
 	bool connect_success = false;
 	std::weak_ptr<KCP::KCP> weak_data_kcp = data_kcp;
-	auto callback_function = [weak_data_kcp, this](std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> target_session)
+	auto callback_function = [weak_data_kcp, this](packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> target_session)
 	{
 		tcp_connector_incoming(std::move(data), data_size, target_session, weak_data_kcp);
 	};
@@ -610,7 +606,8 @@ bool server_mode::create_new_tcp_connection(std::shared_ptr<KCP::KCP> handshake_
 		connect_success = true;
 		local_session->when_disconnect([weak_data_kcp, this](std::shared_ptr<tcp_session> session) { process_tcp_disconnect(session.get(), weak_data_kcp); });
 		std::weak_ptr weak_session = local_session;
-		data_kcp->SetOutput([this](const char *buf, int len, void *user) -> int { return kcp_sender(buf, len, user); });
+		data_kcp->SetOutput([this](const char *buf, int len, void *user) -> int { return kcp_sender(buf, len, user); },
+			[this](void *user) { kcp_sender_flush(user); });
 		data_kcp->SetPostUpdate([this](void *user) { resume_tcp((kcp_mappings*)user); });
 
 		kcp_mappings *kcp_mappings_ptr = (kcp_mappings*)data_kcp->GetUserData();
@@ -637,7 +634,7 @@ bool server_mode::create_new_udp_connection(std::shared_ptr<KCP::KCP> handshake_
 	bool connect_success = false;
 	std::weak_ptr<KCP::KCP> weak_data_kcp = data_kcp;
 
-	udp_callback_t udp_func_ap = [weak_data_kcp, this](std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
+	udp_callback_t udp_func_ap = [weak_data_kcp, this](packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
 	{
 		udp_connector_incoming(std::move(data), data_size, peer, port_number, weak_data_kcp);
 	};
@@ -678,7 +675,8 @@ bool server_mode::create_new_udp_connection(std::shared_ptr<KCP::KCP> handshake_
 	data_kcp->SetOutput([this](const char *buf, int len, void *user) -> int
 		{
 			return kcp_sender(buf, len, user);
-		});
+		},
+		[this](void *user) { kcp_sender_flush(user); });
 	
 	bool resolve_completed = false;
 	if (current_settings.ignore_destination_address || current_settings.ignore_destination_port)
@@ -715,7 +713,7 @@ bool server_mode::create_new_udp_connection(std::shared_ptr<KCP::KCP> handshake_
 		kcp_mappings *kcp_mappings_ptr = (kcp_mappings*)data_kcp->GetUserData();
 		if (kcp_mappings_ptr == nullptr)
 			return false;
-		kcp_mappings_ptr->ingress_source_endpoint = std::make_shared<udp::endpoint>(peer);
+		kcp_mappings_ptr->set_ingress_source_endpoint(std::make_shared<udp::endpoint>(peer));
 		kcp_mappings_ptr->local_udp = target_connector;
 		data_kcp->Flush();
 		connect_success = true;
@@ -767,7 +765,7 @@ std::shared_ptr<mux_records> server_mode::create_mux_data_tcp_connection(uint32_
 {
 	std::shared_ptr<mux_records> mux_records_ptr = std::make_shared<mux_records>();
 	std::weak_ptr<mux_records> mux_records_ptr_weak = mux_records_ptr;
-	auto callback_function = [this, kcp_session_weak, mux_records_ptr_weak](std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> target_session)
+	auto callback_function = [this, kcp_session_weak, mux_records_ptr_weak](packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> target_session)
 		{
 			mux_tunnels->read_tcp_data_to_cache(std::move(data), data_size, target_session, kcp_session_weak, mux_records_ptr_weak);
 		};
@@ -812,7 +810,7 @@ std::shared_ptr<mux_records> server_mode::create_mux_data_udp_connection(uint32_
 	std::shared_ptr<mux_records> mux_records_ptr = std::make_shared<mux_records>();
 	std::weak_ptr<mux_records> mux_records_ptr_weak = mux_records_ptr;
 
-	udp_callback_t udp_func_ap = [this, kcp_session_weak, mux_records_ptr_weak](std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
+	udp_callback_t udp_func_ap = [this, kcp_session_weak, mux_records_ptr_weak](packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number)
 	{
 		mux_tunnels->server_udp_data_to_cache(std::move(data), data_size, peer, port_number, kcp_session_weak, mux_records_ptr_weak);
 	};
@@ -863,13 +861,13 @@ int server_mode::kcp_sender(const char *buf, int len, void *user)
 		return 0;
 
 	kcp_mappings *kcp_mappings_ptr = (kcp_mappings *)user;
-	if (kcp_mappings_ptr->ingress_source_endpoint == nullptr)
+	if (kcp_mappings_ptr->get_ingress_source_endpoint() == nullptr)
 		return 0;
 
 	if (current_settings.fec_data == 0 || current_settings.fec_redundant == 0)
 	{
 		int buffer_size = 0;
-		std::unique_ptr<uint8_t[]> new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
+		packet_buffer new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
 		data_sender(kcp_mappings_ptr, std::move(new_buffer), buffer_size);
 	}
 	else
@@ -879,16 +877,35 @@ int server_mode::kcp_sender(const char *buf, int len, void *user)
 	return 0;
 }
 
-void server_mode::data_sender(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size)
+void server_mode::kcp_sender_flush(void *user)
+{
+	if (user == nullptr)
+		return;
+
+	kcp_mappings *kcp_mappings_ptr = (kcp_mappings *)user;
+	if (kcp_data_sender != nullptr)
+	{
+		// behind the sending tasks of this round
+		kcp_data_sender->push_task((size_t)kcp_mappings_ptr, [kcp_mappings_ptr]()
+			{
+				kcp_mappings_ptr->ingress_listener.load()->flush_send_queue();
+			});
+		return;
+	}
+
+	kcp_mappings_ptr->ingress_listener.load()->flush_send_queue();
+}
+
+void server_mode::data_sender(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size)
 {
 	if (kcp_data_sender != nullptr)
 	{
-		auto func = [this, kcp_mappings_ptr, buffer_size](std::unique_ptr<uint8_t[]> new_buffer)
+		auto func = [this, kcp_mappings_ptr, buffer_size](packet_buffer new_buffer)
 			{
 				auto [error_message, cipher_size] = encrypt_data(current_settings.encryption_password, current_settings.encryption, new_buffer.get(), (int)buffer_size);
 				if (!error_message.empty() || cipher_size == 0)
 					return;
-				udp::endpoint ingress_source_endpoint = *kcp_mappings_ptr->ingress_source_endpoint;
+				udp::endpoint ingress_source_endpoint = *kcp_mappings_ptr->get_ingress_source_endpoint();
 				kcp_mappings_ptr->ingress_listener.load()->async_send_out(std::move(new_buffer), cipher_size, ingress_source_endpoint);
 				status_counters.egress_raw_traffic += cipher_size;
 			};
@@ -899,7 +916,7 @@ void server_mode::data_sender(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<ui
 	auto [error_message, cipher_size] = encrypt_data(current_settings.encryption_password, current_settings.encryption, new_buffer.get(), (int)buffer_size);
 	if (!error_message.empty() || cipher_size == 0)
 		return;
-	udp::endpoint ingress_source_endpoint = *kcp_mappings_ptr->ingress_source_endpoint;
+	udp::endpoint ingress_source_endpoint = *kcp_mappings_ptr->get_ingress_source_endpoint();
 	kcp_mappings_ptr->ingress_listener.load()->async_send_out(std::move(new_buffer), cipher_size, ingress_source_endpoint);
 	status_counters.egress_raw_traffic += cipher_size;
 	return;
@@ -911,7 +928,7 @@ void server_mode::fec_maker(kcp_mappings *kcp_mappings_ptr, const uint8_t *input
 
 	int conv = kcp_mappings_ptr->ingress_kcp->GetConv();
 	int fec_data_buffer_size = 0;
-	std::unique_ptr<uint8_t[]> fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
+	packet_buffer fec_data_buffer = packet::create_fec_data_packet(input_data, data_size, fec_data_buffer_size,
 		fec_controllor.fec_snd_sn.load(), fec_controllor.fec_snd_sub_sn++);
 	data_sender(kcp_mappings_ptr, std::move(fec_data_buffer), fec_data_buffer_size);
 
@@ -1041,7 +1058,7 @@ void server_mode::process_tcp_disconnect(tcp_session *session, std::weak_ptr<KCP
 	std::unique_lock locker{ mux_tunnels->mutex_mux_tcp_cache};
 	if (auto iter = mux_tunnels->mux_tcp_cache.find(kcp_ptr); iter != mux_tunnels->mux_tcp_cache.end())
 	{
-		std::unique_ptr<uint8_t[]> data = std::make_unique<uint8_t[]>(mux_cancel_data.size());
+		packet_buffer data = std::make_unique<uint8_t[]>(mux_cancel_data.size());
 		uint8_t *data_ptr = data.get();
 		std::copy(mux_cancel_data.begin(), mux_cancel_data.end(), data_ptr);
 		mux_data_cache data_cache = { std::move(data), data_ptr, mux_cancel_data.size() };
@@ -1049,8 +1066,8 @@ void server_mode::process_tcp_disconnect(tcp_session *session, std::weak_ptr<KCP
 	}
 	locker.unlock();
 
-	std::unique_ptr<uint8_t[]> empty_ptr;
-	auto func = [this, kcp_ptr_weak](std::unique_ptr<uint8_t[]> data) mutable { mux_tunnels->refresh_mux_queue(kcp_ptr_weak); };
+	packet_buffer empty_ptr;
+	auto func = [this, kcp_ptr_weak](packet_buffer data) mutable { mux_tunnels->refresh_mux_queue(kcp_ptr_weak); };
 	sequence_task_pool_local.push_task((size_t)this, func, std::move(empty_ptr));
 
 	session->session_is_ending(true);
@@ -1159,7 +1176,7 @@ void server_mode::cleanup_expiring_handshake_connections()
 		kcp_ptr->SetPostUpdate(empty_kcp_postupdate);
 		kcp_ptr->SetUserData(nullptr);
 		kcp_updater.remove(kcp_ptr);
-		udp::endpoint ep = *kcp_mappings_ptr->ingress_source_endpoint;
+		udp::endpoint ep = *kcp_mappings_ptr->get_ingress_source_endpoint();
 		handshake_channels.erase(ep);
 		expiring_handshakes.erase(iter);
 	}
@@ -1405,6 +1422,7 @@ void server_mode::loop_get_status()
 		", send (inner): " << listener_send_inner << ", send (raw): " << listener_send_raw << ", fec recover: " << listener_fec_recovery << "\n";
 	output_text += oss.str();
 #endif
+	output_text += "task queue depth: local [" + task_pool_depths(sequence_task_pool_local) + "], peer [" + task_pool_depths(sequence_task_pool_peer) + "]\n";
 
 	std::shared_lock locker{ mutex_kcp_channels };
 	for (auto &[conv, kcp_mappings_pr] : kcp_channels)
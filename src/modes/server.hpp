@@ -42,6 +42,7 @@ class server_mode
 
 	status_records status_counters;
 
+	asio::strand<asio::io_context::executor_type> timer_strand;	// timer loops of this mode never run concurrently, even with several io threads
 	asio::steady_timer timer_find_expires;
 	asio::steady_timer timer_expiring_kcp;
 	asio::steady_timer timer_stun;
@@ -53,12 +54,12 @@ class server_mode
 
 	std::unique_ptr<udp::endpoint> udp_target;
 
-	void udp_listener_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number);
-	void udp_listener_incoming_unpack(std::unique_ptr<uint8_t[]> data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number);
-	void tcp_connector_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_session_weak);
-	void udp_connector_incoming(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak);
+	void udp_listener_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type server_port_number);
+	void udp_listener_incoming_unpack(packet_buffer data, size_t plain_size, udp::endpoint peer, asio::ip::port_type server_port_number);
+	void tcp_connector_incoming(packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_session_weak);
+	void udp_connector_incoming(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak);
 
-	void udp_listener_incoming_new_connection(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number);
+	void udp_listener_incoming_new_connection(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number);
 
 	bool create_new_tcp_connection(std::shared_ptr<KCP::KCP> handshake_kcp, std::shared_ptr<KCP::KCP> data_kcp, const std::string &user_input_address, asio::ip::port_type user_input_port);
 	bool create_new_udp_connection(std::shared_ptr<KCP::KCP> handshake_kcp, std::shared_ptr<KCP::KCP> data_kcp, const udp::endpoint &peer, const std::string &user_input_address, asio::ip::port_type user_input_port);
@@ -68,7 +69,8 @@ class server_mode
 	std::shared_ptr<mux_records> create_mux_data_udp_connection(uint32_t connection_id, std::weak_ptr<KCP::KCP> kcp_session_weak);
 
 	int kcp_sender(const char *buf, int len, void *user);
-	void data_sender(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size);
+	void kcp_sender_flush(void *user);
+	void data_sender(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size);
 	void fec_maker(kcp_mappings *kcp_mappings_ptr, const uint8_t *input_data, int data_size);
 	bool fec_find_missings(KCP::KCP *kcp_ptr, fec_control_data &fec_controllor, uint32_t fec_sn, uint8_t max_fec_data_count);
 
@@ -98,9 +100,10 @@ public:
 		ttp::task_group_pool &seq_task_pool_local,ttp::task_group_pool &seq_task_pool_peer, size_t task_count_limit, const user_settings &settings)
 		: io_context(io_context_ref), kcp_updater(kcp_updater_ref),
 		kcp_data_sender(kcp_data_sender_ref),
-		timer_find_expires(io_context), timer_expiring_kcp(io_context),
-		timer_stun(io_context), timer_keep_alive(io_context),
-		timer_status_log(io_context),
+		timer_strand(asio::make_strand(io_context)),
+		timer_find_expires(timer_strand), timer_expiring_kcp(timer_strand),
+		timer_stun(timer_strand), timer_keep_alive(timer_strand),
+		timer_status_log(timer_strand),
 		sequence_task_pool_local(seq_task_pool_local),
 		sequence_task_pool_peer(seq_task_pool_peer),
 		task_limit(task_count_limit),
@@ -112,13 +115,24 @@ public:
 		current_settings(settings),
 		conn_options{ .ip_version_only = current_settings.ip_version_only,
 					  .fib_ingress = current_settings.fib_ingress,
-					  .fib_egress = current_settings.fib_egress }
+					  .fib_egress = current_settings.fib_egress,
+					  .udp_receive_batch = current_settings.udp_receive_batch,
+					  .udp_send_batch = current_settings.udp_send_batch,
+					  .udp_send_latency = current_settings.udp_send_latency,
+					  .udp_gso = current_settings.udp_gso,
+					  .udp_gro = current_settings.udp_gro,
+					  .udp_listen_shards = current_settings.udp_listen_shards,
+					  .udp_shard_by_cpu = current_settings.udp_shard_by_cpu,
+					  .udp_io_uring = current_settings.udp_io_uring,
+					  .run_to_completion = current_settings.run_to_completion,
+					  .udp_busy_poll = current_settings.busy_poll }
 	{}
 
 	server_mode(server_mode &&existing_server) noexcept
 		: io_context(existing_server.io_context),
 		kcp_updater(existing_server.kcp_updater),
 		kcp_data_sender(existing_server.kcp_data_sender),
+		timer_strand(existing_server.timer_strand),
 		timer_find_expires(std::move(existing_server.timer_find_expires)),
 		timer_expiring_kcp(std::move(existing_server.timer_expiring_kcp)),
 		timer_stun(std::move(existing_server.timer_stun)),
@@ -135,7 +149,17 @@ public:
 		current_settings(std::move(existing_server.current_settings)),
 		conn_options{ .ip_version_only = current_settings.ip_version_only,
 					  .fib_ingress = current_settings.fib_ingress,
-					  .fib_egress = current_settings.fib_egress }
+					  .fib_egress = current_settings.fib_egress,
+					  .udp_receive_batch = current_settings.udp_receive_batch,
+					  .udp_send_batch = current_settings.udp_send_batch,
+					  .udp_send_latency = current_settings.udp_send_latency,
+					  .udp_gso = current_settings.udp_gso,
+					  .udp_gro = current_settings.udp_gro,
+					  .udp_listen_shards = current_settings.udp_listen_shards,
+					  .udp_shard_by_cpu = current_settings.udp_shard_by_cpu,
+					  .udp_io_uring = current_settings.udp_io_uring,
+					  .run_to_completion = current_settings.run_to_completion,
+					  .udp_busy_poll = current_settings.busy_poll }
 	{}
 
 	~server_mode();
@@ -95,7 +95,7 @@ int test_mode::kcp_sender(const char *buf, int len, void *user)
 	if (current_settings.fec_data == 0 || current_settings.fec_redundant == 0)
 	{
 		int buffer_size = 0;
-		std::unique_ptr<uint8_t[]> new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
+		packet_buffer new_buffer = packet::create_packet((const uint8_t *)buf, len, buffer_size);
 		data_sender(kcp_mappings_ptr, std::move(new_buffer), buffer_size);
 	}
 	else
@@ -103,7 +103,7 @@ int test_mode::kcp_sender(const char *buf, int len, void *user)
 		fec_control_data &fec_controllor = kcp_mappings_ptr->fec_egress_control;
 		int conv = kcp_mappings_ptr->egress_kcp->GetConv();
 		int fec_data_buffer_size = 0;
-		std::unique_ptr<uint8_t[]> fec_data_buffer = packet::create_fec_data_packet((const uint8_t *)buf, len, fec_data_buffer_size,
+		packet_buffer fec_data_buffer = packet::create_fec_data_packet((const uint8_t *)buf, len, fec_data_buffer_size,
 			fec_controllor.fec_snd_sn.load(), fec_controllor.fec_snd_sub_sn.load());
 		data_sender(kcp_mappings_ptr, std::move(fec_data_buffer), fec_data_buffer_size);
 	}
@@ -111,11 +111,30 @@ int test_mode::kcp_sender(const char *buf, int len, void *user)
 	return 0;
 }
 
-void test_mode::data_sender(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size)
+void test_mode::kcp_sender_flush(void *user)
 {
+	if (user == nullptr)
+		return;
+
+	kcp_mappings *kcp_mappings_ptr = (kcp_mappings *)user;
 	if (kcp_data_sender != nullptr)
 	{
-		auto func = [this, kcp_mappings_ptr, buffer_size](std::unique_ptr<uint8_t[]> new_buffer)
+		// behind the sending tasks of this round
+		kcp_data_sender->push_task((size_t)kcp_mappings_ptr, [kcp_mappings_ptr]()
+			{
+				kcp_mappings_ptr->egress_forwarder->flush_send_queue();
+			});
+		return;
+	}
+
+	kcp_mappings_ptr->egress_forwarder->flush_send_queue();
+}
+
+void test_mode::data_sender(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size)
+{
+	if (kcp_data_sender != nullptr)
+	{
+		auto func = [this, kcp_mappings_ptr, buffer_size](packet_buffer new_buffer)
 			{
 				auto [error_message, cipher_size] = encrypt_data(current_settings.encryption_password, current_settings.encryption, new_buffer.get(), (int)buffer_size);
 				if (!error_message.empty() || cipher_size == 0)
@@ -248,7 +267,8 @@ std::shared_ptr<kcp_mappings> test_mode::create_handshake(asio::ip::port_type te
 			if (handshake_timeout_detection((kcp_mappings *)user))
 				return 0;
 			return kcp_sender(buf, len, user);
-		});
+		},
+		[this](void *user) { kcp_sender_flush(user); });
 
 	asio::error_code ec;
 	if (current_settings.ip_version_only == ip_only_options::ipv4)
@@ -294,7 +314,7 @@ void test_mode::handshake_test_cleanup(kcp_mappings *handshake_ptr)
 	handshakes.erase(session_iter);
 }
 
-void test_mode::handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+void test_mode::handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 {
 	if (data == nullptr || data_size == 0 || kcp_ptr == nullptr)
 		return;
@@ -329,19 +349,10 @@ void test_mode::handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_
 	if (kcp_mappings_ptr == nullptr)
 		return;
 
-	while (true)
+	for (auto &[buffer_cache, kcp_data_size] : kcp_ptr->ReceiveAll())
 	{
-		int buffer_size = kcp_ptr->PeekSize();
-		if (buffer_size <= 0)
-			break;
-
-		std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(buffer_size);
 		uint8_t *buffer_ptr = buffer_cache.get();
 
-		int kcp_data_size = 0;
-		if (kcp_data_size = kcp_ptr->Receive((char *)buffer_ptr, buffer_size); kcp_data_size < 0)
-			break;
-
 		auto [ftr, prtcl, unbacked_data_ptr, unbacked_data_size] = packet::unpack_inner(buffer_ptr, kcp_data_size);
 		switch (ftr)
 		{
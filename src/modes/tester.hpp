@@ -33,7 +33,8 @@ class test_mode
 	const size_t task_limit;
 
 	int kcp_sender(const char *buf, int len, void *user);
-	void data_sender(kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> new_buffer, size_t buffer_size);
+	void kcp_sender_flush(void *user);
+	void data_sender(kcp_mappings *kcp_mappings_ptr, packet_buffer new_buffer, size_t buffer_size);
 
 	bool get_udp_target(std::shared_ptr<forwarder> target_connector, udp::endpoint &udp_target);
 	bool update_udp_target(std::shared_ptr<forwarder> target_connector, udp::endpoint &udp_target);
@@ -43,7 +44,7 @@ class test_mode
 	void on_handshake_test_success(kcp_mappings *handshake_ptr);
 	void handshake_test_failure(kcp_mappings *handshake_ptr);
 	void handshake_test_cleanup(kcp_mappings *handshake_ptr);
-	void handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
+	void handle_handshake(std::shared_ptr<KCP::KCP> kcp_ptr, packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number);
 	void PrintResults();
 	void find_expires(const asio::error_code &e);
 
@@ -64,7 +65,17 @@ public:
 		current_settings(settings),
 		conn_options{ .ip_version_only = current_settings.ip_version_only,
 					  .fib_ingress = current_settings.fib_ingress,
-					  .fib_egress = current_settings.fib_egress }
+					  .fib_egress = current_settings.fib_egress,
+					  .udp_receive_batch = current_settings.udp_receive_batch,
+					  .udp_send_batch = current_settings.udp_send_batch,
+					  .udp_send_latency = current_settings.udp_send_latency,
+					  .udp_gso = current_settings.udp_gso,
+					  .udp_gro = current_settings.udp_gro,
+					  .udp_listen_shards = current_settings.udp_listen_shards,
+					  .udp_shard_by_cpu = current_settings.udp_shard_by_cpu,
+					  .udp_io_uring = current_settings.udp_io_uring,
+					  .run_to_completion = current_settings.run_to_completion,
+					  .udp_busy_poll = current_settings.busy_poll }
 	{}
 
 	test_mode(test_mode &&existing_client) noexcept :
@@ -78,7 +89,17 @@ public:
 		current_settings(std::move(existing_client.current_settings)),
 		conn_options{ .ip_version_only = current_settings.ip_version_only,
 					  .fib_ingress = current_settings.fib_ingress,
-					  .fib_egress = current_settings.fib_egress }
+					  .fib_egress = current_settings.fib_egress,
+					  .udp_receive_batch = current_settings.udp_receive_batch,
+					  .udp_send_batch = current_settings.udp_send_batch,
+					  .udp_send_latency = current_settings.udp_send_latency,
+					  .udp_gso = current_settings.udp_gso,
+					  .udp_gro = current_settings.udp_gro,
+					  .udp_listen_shards = current_settings.udp_listen_shards,
+					  .udp_shard_by_cpu = current_settings.udp_shard_by_cpu,
+					  .udp_io_uring = current_settings.udp_io_uring,
+					  .run_to_completion = current_settings.run_to_completion,
+					  .udp_busy_poll = current_settings.busy_poll }
 	{}
 
 	~test_mode();
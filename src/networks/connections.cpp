@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <bit>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <memory>
 #include <limits>
 #include <random>
@@ -10,11 +12,11 @@
 using namespace std::chrono;
 using namespace std::literals;
 
-void empty_tcp_callback(std::unique_ptr<uint8_t[]> tmp1, size_t tmps, std::shared_ptr<tcp_session> tmp2)
+void empty_tcp_callback(packet_buffer tmp1, size_t tmps, std::shared_ptr<tcp_session> tmp2)
 {
 }
 
-void empty_udp_callback(std::unique_ptr<uint8_t[]> tmp1, size_t tmps, udp::endpoint tmp2, asio::ip::port_type tmp3)
+void empty_udp_callback(packet_buffer tmp1, size_t tmps, udp::endpoint tmp2, asio::ip::port_type tmp3)
 {
 }
 
@@ -31,10 +33,22 @@ void empty_kcp_postupdate(void *)
 {
 }
 
-void empty_task_callback(std::unique_ptr<uint8_t[]> null_data)
+void empty_task_callback(packet_buffer null_data)
 {
 }
 
+std::string task_pool_depths(const ttp::task_group_pool &task_pool)
+{
+	std::string depths;
+	for (ttp::concurrency_t i = 0; i < task_pool.get_thread_count(); ++i)
+	{
+		if (i > 0)
+			depths += " ";
+		depths += std::to_string(task_pool.get_thread_depth(i));
+	}
+	return depths;
+}
+
 
 std::unique_ptr<rfc3489::stun_header> send_stun_3489_request(udp_server &sender, const std::string &stun_host, ip_only_options ip_version_only)
 {
@@ -254,10 +268,10 @@ namespace packet
 		return duration_cast<seconds>(right_now.time_since_epoch()).count();
 	}
 
-	std::unique_ptr<uint8_t[]> create_packet(const uint8_t *input_data, int data_size, int &new_size)
+	packet_buffer create_packet(const uint8_t *input_data, int data_size, int &new_size)
 	{
 		int64_t timestamp = right_now();
-		std::unique_ptr<uint8_t[]> new_buffer = std::make_unique<uint8_t[]>(data_size + gbv_buffer_expand_size);
+		packet_buffer new_buffer = std::make_unique<uint8_t[]>(data_size + gbv_buffer_expand_size);
 		packet_layer *ptr = (packet_layer *)new_buffer.get();
 		ptr->timestamp = htonl((uint32_t)timestamp);
 		uint8_t *data_ptr = ptr->data;
@@ -268,10 +282,10 @@ namespace packet
 		return new_buffer;
 	}
 
-	std::unique_ptr<uint8_t[]> create_fec_data_packet(const uint8_t *input_data, int data_size, int &new_size, uint32_t fec_sn, uint8_t fec_sub_sn)
+	packet_buffer create_fec_data_packet(const uint8_t *input_data, int data_size, int &new_size, uint32_t fec_sn, uint8_t fec_sub_sn)
 	{
 		int64_t timestamp = right_now();
-		std::unique_ptr<uint8_t[]> new_buffer = std::make_unique<uint8_t[]>(data_size + sizeof(packet_layer_fec) + gbv_buffer_expand_size);
+		packet_buffer new_buffer = std::make_unique<uint8_t[]>(data_size + sizeof(packet_layer_fec) + gbv_buffer_expand_size);
 		packet_layer_data *pkt_data_ptr = (packet_layer_data *)new_buffer.get();
 		uint8_t *data_ptr = pkt_data_ptr->data;
 
@@ -286,10 +300,10 @@ namespace packet
 		return new_buffer;
 	}
 
-	std::unique_ptr<uint8_t[]> create_fec_redundant_packet(const uint8_t * input_data, int data_size, int & new_size, uint32_t fec_sn, uint8_t fec_sub_sn, uint32_t kcp_conv)
+	packet_buffer create_fec_redundant_packet(const uint8_t * input_data, int data_size, int & new_size, uint32_t fec_sn, uint8_t fec_sub_sn, uint32_t kcp_conv)
 	{
 		int64_t timestamp = right_now();
-		std::unique_ptr<uint8_t[]> new_buffer = std::make_unique<uint8_t[]>(data_size + sizeof(packet_layer_fec) + gbv_buffer_expand_size);
+		packet_buffer new_buffer = std::make_unique<uint8_t[]>(data_size + sizeof(packet_layer_fec) + gbv_buffer_expand_size);
 		packet_layer_fec *pkt_fec_ptr = (packet_layer_fec *)new_buffer.get();
 		uint8_t *data_ptr = pkt_fec_ptr->data;
 
@@ -337,17 +351,14 @@ namespace packet
 	size_t create_inner_packet(feature ftr, protocol_type prtcl, uint8_t *input_data, size_t data_size)
 	{
 		size_t new_size = sizeof(data_layer) - 1 + data_size;
-		uint8_t new_data[gbv_buffer_size + gbv_buffer_expand_size] = {};
-
-		data_layer *ptr = (data_layer *)new_data;
-		ptr->feature_value = ftr;
-		ptr->protocol_value = prtcl;
 
-		uint8_t *data_ptr = ptr->data;
+		// move the payload behind the header in place
 		if (data_size > 0)
-			std::copy_n(input_data, data_size, data_ptr);
+			std::copy_backward(input_data, input_data + data_size, input_data + new_size);
 
-		std::copy_n(new_data, new_size, input_data);
+		data_layer *ptr = (data_layer *)input_data;
+		ptr->feature_value = ftr;
+		ptr->protocol_value = prtcl;
 
 		return new_size;
 	}
@@ -552,19 +563,17 @@ namespace packet
 	size_t create_mux_data_packet(protocol_type prtcl, uint32_t connection_id, uint8_t *input_data, size_t data_size)
 	{
 		const auto new_size = sizeof(data_layer) - 1 + sizeof(mux_data_wrapper) - 1 + data_size;
-		uint8_t new_data[gbv_buffer_size + gbv_buffer_expand_size] = {};
 
-		data_layer *ptr = (data_layer *)new_data;
+		// move the payload behind the headers in place
+		if (data_size > 0)
+			std::copy_backward(input_data, input_data + data_size, input_data + new_size);
+
+		data_layer *ptr = (data_layer *)input_data;
 		ptr->feature_value = feature::mux_transfer;
 		ptr->protocol_value = prtcl;
 
 		mux_data_wrapper *mux_data_ptr = (mux_data_wrapper *)ptr->data;
 		mux_data_ptr->connection_id = htonl(connection_id);
-		uint8_t *data_ptr = mux_data_ptr->data;
-		if (data_size > 0)
-			std::copy_n(input_data, data_size, data_ptr);
-
-		std::copy_n(new_data, new_size, input_data);
 		return new_size;
 	}
 
@@ -700,7 +709,7 @@ void tcp_session::async_read_data()
 	if (paused.load() || stopped.load())
 		return;
 
-	std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(gbv_buffer_size);
+	packet_buffer buffer_cache = make_packet_buffer(gbv_buffer_size + gbv_buffer_expand_size);
 	auto asio_buffer = asio::buffer(buffer_cache.get(), gbv_buffer_size);
 	asio::async_read(connection_socket, asio_buffer, asio::transfer_at_least(1),
 		[data = std::move(buffer_cache), this, sptr = shared_from_this()](const asio::error_code &error, std::size_t bytes_transferred) mutable
@@ -763,7 +772,7 @@ void tcp_session::async_send_data(std::vector<uint8_t> &&data)
 		{ after_write_completed(error, bytes_transferred); });
 }
 
-void tcp_session::async_send_data(std::unique_ptr<uint8_t[]> buffer_data, size_t size_in_bytes)
+void tcp_session::async_send_data(packet_buffer buffer_data, size_t size_in_bytes)
 {
 	if (stopped.load() || buffer_data == nullptr || size_in_bytes == 0)
 		return;
@@ -774,7 +783,7 @@ void tcp_session::async_send_data(std::unique_ptr<uint8_t[]> buffer_data, size_t
 		{ after_write_completed(error, bytes_transferred); });
 }
 
-void tcp_session::async_send_data(std::unique_ptr<uint8_t[]> buffer_data, uint8_t *start_pos, size_t size_in_bytes)
+void tcp_session::async_send_data(packet_buffer buffer_data, uint8_t *start_pos, size_t size_in_bytes)
 {
 	if (stopped.load() || buffer_data == nullptr || start_pos == nullptr || size_in_bytes == 0)
 		return;
@@ -831,7 +840,7 @@ void tcp_session::after_write_completed(const asio::error_code &error, size_t by
 	last_send_time.store(packet::right_now());
 }
 
-void tcp_session::after_read_completed(std::unique_ptr<uint8_t[]> buffer_cache, const asio::error_code &error, size_t bytes_transferred)
+void tcp_session::after_read_completed(packet_buffer buffer_cache, const asio::error_code &error, size_t bytes_transferred)
 {
 	if (session_ending.load())
 		return;
@@ -870,28 +879,21 @@ void tcp_session::after_read_completed(std::unique_ptr<uint8_t[]> buffer_cache,
 	async_read_data();
 }
 
-void tcp_session::transfer_data_to_next_function(std::unique_ptr<uint8_t[]> buffer_cache, size_t bytes_transferred)
+void tcp_session::transfer_data_to_next_function(packet_buffer buffer_cache, size_t bytes_transferred)
 {
 	if (buffer_cache == nullptr || bytes_transferred == 0)
 		return;
 
-	if (gbv_buffer_size - bytes_transferred < gbv_buffer_expand_size)
-	{
-		std::unique_ptr<uint8_t[]> new_buffer = std::make_unique<uint8_t[]>(gbv_buffer_size + gbv_buffer_expand_size);
-		std::copy_n(buffer_cache.get(), bytes_transferred, new_buffer.get());
-		buffer_cache.swap(new_buffer);
-	}
-
 	if (sequence_task_pool != nullptr)
 	{
 		size_t pointer_to_number = (size_t)this;
-		sequence_task_pool->push_task(pointer_to_number, [this, bytes_transferred, self_shared = shared_from_this()](std::unique_ptr<uint8_t[]> data) mutable
+		sequence_task_pool->push_task(pointer_to_number, [this, bytes_transferred, self_shared = shared_from_this()](packet_buffer data) mutable
 			{ callback(std::move(data), bytes_transferred, self_shared); },
 			std::move(buffer_cache));
 	}
 	else if (task_assigner != nullptr)
 	{
-		task_assigner->push_task([this, bytes_transferred, self_shared = shared_from_this()](std::unique_ptr<uint8_t[]> data) mutable
+		task_assigner->push_task([this, bytes_transferred, self_shared = shared_from_this()](packet_buffer data) mutable
 			{ callback(std::move(data), bytes_transferred, self_shared); },
 			std::move(buffer_cache));
 	}
@@ -1011,6 +1013,436 @@ bool tcp_client::set_remote_hostname(const std::string &remote_address, const st
 
 
 
+#ifdef __linux__
+void set_busy_poll(int socket_fd, uint32_t busy_poll_us)
+{
+	int busy_poll_option = (int)std::min<uint32_t>(busy_poll_us, INT_MAX);
+	setsockopt(socket_fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_option, sizeof(busy_poll_option));
+}
+
+udp_receive_slots::udp_receive_slots(size_t slot_count, bool gro_mode)
+	: gro_enabled(gro_mode), buffers(slot_count), addresses(slot_count), iovecs(slot_count), headers(slot_count), controls(gro_mode ? slot_count : 0)
+{
+	size_t buffer_size = gro_enabled ? gbv_gro_buffer_size : gbv_buffer_size + gbv_buffer_expand_size;
+	for (size_t i = 0; i < slot_count; i++)
+	{
+		buffers[i] = gro_enabled ? std::make_unique<uint8_t[]>(buffer_size) : make_packet_buffer(buffer_size);
+		headers[i] = {};
+		headers[i].msg_hdr.msg_iov = &iovecs[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+std::vector<udp_datagram> udp_receive_slots::receive(int socket_fd)
+{
+	std::vector<udp_datagram> datagrams;
+	std::scoped_lock locker{ mutex_slots };
+
+	for (size_t i = 0; i < headers.size(); i++)
+	{
+		if (buffers[i] == nullptr)
+			buffers[i] = make_packet_buffer(gbv_buffer_size + gbv_buffer_expand_size);
+		iovecs[i].iov_base = buffers[i].get();
+		iovecs[i].iov_len = gro_enabled ? gbv_gro_buffer_size : gbv_buffer_size;
+		headers[i].msg_hdr.msg_name = &addresses[i];
+		headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+		headers[i].msg_hdr.msg_flags = 0;
+		headers[i].msg_len = 0;
+		if (gro_enabled)
+		{
+			headers[i].msg_hdr.msg_control = controls[i].data();
+			headers[i].msg_hdr.msg_controllen = controls[i].size();
+		}
+	}
+
+	int received = recvmmsg(socket_fd, headers.data(), (unsigned int)headers.size(), MSG_DONTWAIT, nullptr);
+	if (received <= 0)
+		return datagrams;
+
+	datagrams.reserve(received);
+	for (int i = 0; i < received; i++)
+	{
+		if (headers[i].msg_len == 0)
+			continue;
+		udp::endpoint peer;
+		std::memcpy(peer.data(), &addresses[i], headers[i].msg_hdr.msg_namelen);
+		peer.resize(headers[i].msg_hdr.msg_namelen);
+		if (gro_enabled)
+			split_segments(i, datagrams, peer);
+		else
+			datagrams.push_back({ std::move(buffers[i]), headers[i].msg_len, peer });
+	}
+
+	return datagrams;
+}
+
+void udp_receive_slots::split_segments(size_t slot_index, std::vector<udp_datagram> &datagrams, const udp::endpoint &peer)
+{
+	msghdr &message = headers[slot_index].msg_hdr;
+	size_t total_size = headers[slot_index].msg_len;
+	size_t segment_size = total_size;
+	for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+		{
+			int gro_size = 0;
+			std::memcpy(&gro_size, CMSG_DATA(cmsg), sizeof(gro_size));
+			if (gro_size > 0)
+				segment_size = gro_size;
+			break;
+		}
+	}
+
+	// Every segment gets its own buffer with expand headroom, because the handlers keep and grow it in place
+	const uint8_t *slot_buffer = buffers[slot_index].get();
+	for (size_t offset = 0; offset < total_size; offset += segment_size)
+	{
+		size_t data_size = std::min(segment_size, total_size - offset);
+		if (data_size > gbv_buffer_size)
+			data_size = gbv_buffer_size;
+		packet_buffer segment_buffer = make_packet_buffer(gbv_buffer_size + gbv_buffer_expand_size);
+		std::copy_n(slot_buffer + offset, data_size, segment_buffer.get());
+		datagrams.push_back({ std::move(segment_buffer), data_size, peer });
+	}
+}
+
+udp_send_queue::push_result udp_send_queue::push(udp_outgoing_datagram &&datagram)
+{
+	std::scoped_lock locker{ mutex_pending };
+	pending.emplace_back(std::move(datagram));
+	if (pending.size() >= max_batch_size)
+		return push_result::batch_full;
+	if (timer_started)
+		return push_result::queued;
+	timer_started = true;
+	return push_result::start_timer;
+}
+
+std::vector<udp_outgoing_datagram> udp_send_queue::take_all(bool from_timer)
+{
+	std::vector<udp_outgoing_datagram> datagrams;
+	std::scoped_lock locker{ mutex_pending };
+	if (from_timer)
+		timer_started = false;
+	if (waiting_writable)
+		return datagrams;
+	datagrams.swap(pending);
+	pending.reserve(max_batch_size);
+	return datagrams;
+}
+
+void udp_send_queue::keep_unsent(std::vector<udp_outgoing_datagram> &datagrams, size_t sent)
+{
+	std::scoped_lock locker{ mutex_pending };
+	pending.insert(pending.begin(), std::make_move_iterator(datagrams.begin() + sent), std::make_move_iterator(datagrams.end()));
+	waiting_writable = true;
+}
+
+void udp_send_queue::resume()
+{
+	std::scoped_lock locker{ mutex_pending };
+	waiting_writable = false;
+}
+
+size_t udp_send_queue::send(int socket_fd, std::vector<udp_outgoing_datagram> &datagrams)
+{
+	if (gso_enabled.load())
+		return send_segmented(socket_fd, datagrams);
+	return send_each(socket_fd, datagrams, 0);
+}
+
+size_t udp_send_queue::send_each(int socket_fd, std::vector<udp_outgoing_datagram> &datagrams, size_t start)
+{
+	std::vector<mmsghdr> headers(datagrams.size() - start);
+	std::vector<iovec> iovecs(datagrams.size() - start);
+	for (size_t i = 0; i < headers.size(); i++)
+	{
+		udp_outgoing_datagram &datagram = datagrams[start + i];
+		iovecs[i].iov_base = (void *)datagram.start_pos;
+		iovecs[i].iov_len = datagram.data_size;
+		headers[i].msg_hdr.msg_name = datagram.peer.data();
+		headers[i].msg_hdr.msg_namelen = (socklen_t)datagram.peer.size();
+		headers[i].msg_hdr.msg_iov = &iovecs[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	size_t sent = 0;
+	while (sent < headers.size())
+	{
+		int result = sendmmsg(socket_fd, headers.data() + sent, (unsigned int)(headers.size() - sent), MSG_DONTWAIT);
+		if (result > 0)
+		{
+			sent += result;
+			continue;
+		}
+
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		sent++;	// drop the datagram that caused the error, as async_send_to would do
+	}
+
+	return start + sent;
+}
+
+size_t udp_send_queue::send_segmented(int socket_fd, std::vector<udp_outgoing_datagram> &datagrams)
+{
+	struct segment_group
+	{
+		size_t first;
+		size_t count;
+		alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(uint16_t))];
+	};
+
+	// A group is a run of same-size datagrams to the same peer; only the last one may be shorter
+	std::vector<segment_group> groups;
+	for (size_t i = 0; i < datagrams.size(); i++)
+	{
+		if (!groups.empty())
+		{
+			segment_group &group = groups.back();
+			udp_outgoing_datagram &first_datagram = datagrams[group.first];
+			udp_outgoing_datagram &last_datagram = datagrams[group.first + group.count - 1];
+			if (datagrams[i].peer == first_datagram.peer &&
+				last_datagram.data_size == first_datagram.data_size &&
+				datagrams[i].data_size <= first_datagram.data_size &&
+				group.count < gbv_gso_segments_max &&
+				first_datagram.data_size * (group.count + 1) <= gbv_gso_bytes_max)
+			{
+				group.count++;
+				continue;
+			}
+		}
+		groups.push_back({ i, 1, {} });
+	}
+
+	std::vector<mmsghdr> headers(groups.size());
+	std::vector<iovec> iovecs(datagrams.size());
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		segment_group &group = groups[i];
+		udp_outgoing_datagram &first_datagram = datagrams[group.first];
+		for (size_t j = group.first; j < group.first + group.count; j++)
+		{
+			iovecs[j].iov_base = (void *)datagrams[j].start_pos;
+			iovecs[j].iov_len = datagrams[j].data_size;
+		}
+		headers[i].msg_hdr.msg_name = first_datagram.peer.data();
+		headers[i].msg_hdr.msg_namelen = (socklen_t)first_datagram.peer.size();
+		headers[i].msg_hdr.msg_iov = &iovecs[group.first];
+		headers[i].msg_hdr.msg_iovlen = group.count;
+		if (group.count > 1)
+		{
+			headers[i].msg_hdr.msg_control = group.control;
+			headers[i].msg_hdr.msg_controllen = sizeof(group.control);
+			cmsghdr *cmsg = CMSG_FIRSTHDR(&headers[i].msg_hdr);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t segment_size = (uint16_t)first_datagram.data_size;
+			std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+		}
+	}
+
+	size_t sent_groups = 0;
+	while (sent_groups < groups.size())
+	{
+		int result = sendmmsg(socket_fd, headers.data() + sent_groups, (unsigned int)(groups.size() - sent_groups), MSG_DONTWAIT);
+		if (result > 0)
+		{
+			sent_groups += result;
+			continue;
+		}
+
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+
+		if (groups[sent_groups].count > 1 &&
+			(errno == EIO || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT))
+		{
+			// GSO itself is rejected by this socket or device, send the rest one by one from now on
+			gso_enabled.store(false);
+			return send_each(socket_fd, datagrams, groups[sent_groups].first);
+		}
+		sent_groups++;	// drop the group that caused the error (e.g. unreachable peer), as async_send_to would do
+	}
+
+	if (sent_groups == groups.size())
+		return datagrams.size();
+	return groups[sent_groups].first;
+}
+
+#ifdef KCPTUBE_IO_URING
+constexpr size_t gbv_uring_slot_size = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage) + gbv_buffer_size;
+
+udp_uring::~udp_uring()
+{
+	if (buffer_ring != nullptr)
+		io_uring_free_buf_ring(&ring, buffer_ring, gbv_uring_buffer_count, 0);
+	if (ring_ready)
+		io_uring_queue_exit(&ring);
+}
+
+bool udp_uring::start()
+{
+	io_uring_params params = {};
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = gbv_uring_queue_depth * 4;
+	if (io_uring_queue_init_params(gbv_uring_queue_depth, &ring, &params) < 0)
+		return false;
+	ring_ready = true;
+
+	// The ring keeps its own reference of the socket, so a closed and reused fd number can never be hit
+	if (io_uring_register_files(&ring, &socket_fd, 1) < 0)
+		return false;
+
+	int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (event_fd < 0)
+		return false;
+	asio::error_code ec;
+	completion_event.assign(event_fd, ec);
+	if (ec)
+	{
+		::close(event_fd);
+		return false;
+	}
+	if (io_uring_register_eventfd(&ring, event_fd) < 0)
+		return false;
+
+	int result = 0;
+	buffer_ring = io_uring_setup_buf_ring(&ring, gbv_uring_buffer_count, 0, 0, &result);
+	if (buffer_ring == nullptr)
+		return false;
+
+	receive_buffers = std::make_unique<uint8_t[]>(gbv_uring_slot_size * gbv_uring_buffer_count);
+	for (unsigned i = 0; i < gbv_uring_buffer_count; i++)
+		io_uring_buf_ring_add(buffer_ring, receive_buffers.get() + gbv_uring_slot_size * i, gbv_uring_slot_size, i, io_uring_buf_ring_mask(gbv_uring_buffer_count), i);
+	io_uring_buf_ring_advance(buffer_ring, gbv_uring_buffer_count);
+
+	receive_message.msg_namelen = sizeof(sockaddr_storage);
+
+	std::scoped_lock locker{ mutex_ring };
+	if (!arm_receive() || io_uring_submit(&ring) < 0)
+		return false;
+
+	// Kernels without multishot recvmsg reject the request while it is being submitted
+	io_uring_cqe *cqe = nullptr;
+	if (io_uring_peek_cqe(&ring, &cqe) == 0 && io_uring_cqe_get_data64(cqe) == 0 && cqe->res < 0 && cqe->res != -ENOBUFS)
+		return false;
+
+	return true;
+}
+
+bool udp_uring::arm_receive()
+{
+	io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+	if (sqe == nullptr)
+		return false;
+	io_uring_prep_recvmsg_multishot(sqe, 0, &receive_message, 0);
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	io_uring_sqe_set_data64(sqe, 0);
+	return true;
+}
+
+std::vector<udp_datagram> udp_uring::reap()
+{
+	std::vector<udp_datagram> datagrams;
+	uint64_t event_count = 0;
+	[[maybe_unused]] auto read_size = read(completion_event.native_handle(), &event_count, sizeof(event_count));
+
+	std::scoped_lock locker{ mutex_ring };
+	bool receive_stopped = false;
+	unsigned recycled = 0;
+	io_uring_cqe *cqe = nullptr;
+	while (io_uring_peek_cqe(&ring, &cqe) == 0)
+	{
+		uint64_t request_id = io_uring_cqe_get_data64(cqe);
+		if (request_id != 0)
+		{
+			in_flight.erase(request_id);
+			io_uring_cqe_seen(&ring, cqe);
+			continue;
+		}
+
+		if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+			receive_stopped = true;
+
+		if ((cqe->flags & IORING_CQE_F_BUFFER) != 0)
+		{
+			unsigned buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			uint8_t *slot_buffer = receive_buffers.get() + gbv_uring_slot_size * buffer_id;
+			io_uring_recvmsg_out *message_out = cqe->res > 0 ? io_uring_recvmsg_validate(slot_buffer, cqe->res, &receive_message) : nullptr;
+			if (message_out != nullptr && (message_out->flags & MSG_TRUNC) == 0)
+			{
+				size_t data_size = io_uring_recvmsg_payload_length(message_out, cqe->res, &receive_message);
+				if (data_size > 0)
+				{
+					udp::endpoint peer;
+					size_t name_size = std::min<size_t>(message_out->namelen, sizeof(sockaddr_storage));
+					std::memcpy(peer.data(), io_uring_recvmsg_name(message_out), name_size);
+					peer.resize(name_size);
+					packet_buffer data = make_packet_buffer(gbv_buffer_size + gbv_buffer_expand_size);
+					std::copy_n((const uint8_t *)io_uring_recvmsg_payload(message_out, &receive_message), data_size, data.get());
+					datagrams.push_back({ std::move(data), data_size, peer });
+				}
+			}
+			io_uring_buf_ring_add(buffer_ring, slot_buffer, gbv_uring_slot_size, buffer_id, io_uring_buf_ring_mask(gbv_uring_buffer_count), recycled);
+			recycled++;
+		}
+		io_uring_cqe_seen(&ring, cqe);
+	}
+
+	if (recycled > 0)
+		io_uring_buf_ring_advance(buffer_ring, recycled);
+
+	// Multishot receive ends when the buffer ring runs dry, the buffers are back now so it can be armed again
+	if (receive_stopped && arm_receive())
+		io_uring_submit(&ring);
+
+	return datagrams;
+}
+
+size_t udp_uring::send(std::vector<udp_outgoing_datagram> &datagrams)
+{
+	std::scoped_lock locker{ mutex_ring };
+	size_t queued = 0;
+	for (; queued < datagrams.size(); queued++)
+	{
+		io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+		if (sqe == nullptr)
+		{
+			io_uring_submit(&ring);
+			sqe = io_uring_get_sqe(&ring);
+			if (sqe == nullptr)
+				break;
+		}
+
+		std::unique_ptr<send_slot> slot = std::make_unique<send_slot>();
+		slot->datagram = std::move(datagrams[queued]);
+		slot->buffer.iov_base = (void *)slot->datagram.start_pos;
+		slot->buffer.iov_len = slot->datagram.data_size;
+		slot->message = {};
+		slot->message.msg_name = slot->datagram.peer.data();
+		slot->message.msg_namelen = (socklen_t)slot->datagram.peer.size();
+		slot->message.msg_iov = &slot->buffer;
+		slot->message.msg_iovlen = 1;
+		io_uring_prep_sendmsg(sqe, 0, &slot->message, 0);
+		sqe->flags |= IOSQE_FIXED_FILE;
+		io_uring_sqe_set_data64(sqe, next_send_id);
+		in_flight[next_send_id] = std::move(slot);
+		next_send_id++;
+	}
+
+	io_uring_submit(&ring);
+	return queued;
+}
+#endif
+#endif
+
 void udp_server::continue_receive()
 {
 	start_receive();
@@ -1020,23 +1452,47 @@ void udp_server::async_send_out(std::unique_ptr<std::vector<uint8_t>> data, cons
 {
 	if (data == nullptr)
 		return;
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		const uint8_t *start_pos = data->data();
+		size_t data_size = data->size();
+		queue_send_out({ nullptr, std::move(data), start_pos, data_size, client_endpoint });
+		return;
+	}
+#endif
 	auto asio_buffer = asio::buffer(*data);
 	connection_socket.async_send_to(asio_buffer, client_endpoint,
 		[data_ = std::move(data)](const asio::error_code &error, size_t bytes_transferred) {});
 }
 
-void udp_server::async_send_out(std::unique_ptr<uint8_t[]> data, uint8_t *start_pos, size_t data_size, const udp::endpoint &client_endpoint)
+void udp_server::async_send_out(packet_buffer data, uint8_t *start_pos, size_t data_size, const udp::endpoint &client_endpoint)
 {
 	if (data == nullptr)
 		return;
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		queue_send_out({ std::move(data), nullptr, start_pos, data_size, client_endpoint });
+		return;
+	}
+#endif
 	connection_socket.async_send_to(asio::buffer(start_pos, data_size), client_endpoint,
 		[data_ = std::move(data)](const asio::error_code &error, size_t bytes_transferred) {});
 }
 
-void udp_server::async_send_out(std::unique_ptr<uint8_t[]> data, size_t data_size, const udp::endpoint &client_endpoint)
+void udp_server::async_send_out(packet_buffer data, size_t data_size, const udp::endpoint &client_endpoint)
 {
 	if (data == nullptr)
 		return;
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		const uint8_t *start_pos = data.get();
+		queue_send_out({ std::move(data), nullptr, start_pos, data_size, client_endpoint });
+		return;
+	}
+#endif
 	auto asio_buffer = asio::buffer(data.get(), data_size);
 	connection_socket.async_send_to(asio_buffer, client_endpoint,
 		[data_ = std::move(data)](const asio::error_code &error, size_t bytes_transferred) {});
@@ -1044,11 +1500,28 @@ void udp_server::async_send_out(std::unique_ptr<uint8_t[]> data, size_t data_siz
 
 void udp_server::async_send_out(std::vector<uint8_t> &&data, const udp::endpoint &client_endpoint)
 {
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		auto data_ptr = std::make_unique<std::vector<uint8_t>>(std::move(data));
+		const uint8_t *start_pos = data_ptr->data();
+		size_t data_size = data_ptr->size();
+		queue_send_out({ nullptr, std::move(data_ptr), start_pos, data_size, client_endpoint });
+		return;
+	}
+#endif
 	auto asio_buffer = asio::buffer(data);
 	connection_socket.async_send_to(asio_buffer, client_endpoint,
 		[data_ = std::move(data)](const asio::error_code &error, size_t bytes_transferred) {});
 }
 
+void udp_server::flush_send_queue()
+{
+#ifdef __linux__
+	if (send_queue != nullptr)
+		send_batch_out(false);
+#endif
+}
 
 void udp_server::initialise(const udp::endpoint &ep)
 {
@@ -1065,12 +1538,78 @@ void udp_server::initialise(const udp::endpoint &ep)
 	}
 #endif
 
+#ifdef __linux__
+	if (listen_shards > 1)
+		connection_socket.set_option(asio::detail::socket_option::boolean<ASIO_OS_DEF(SOL_SOCKET), SO_REUSEPORT>(true));
+#endif
+
 	connection_socket.bind(ep);
+
+#ifdef __linux__
+	if (listen_shards > 1 && shard_by_cpu && !is_shard)
+		attach_shard_steering();
+
+	if (busy_poll > 0)
+		set_busy_poll(connection_socket.native_handle(), busy_poll);
+
+	bool uring_in_use = false;
+#ifdef KCPTUBE_IO_URING
+	if (udp_io_uring)
+	{
+		uring_io = std::make_unique<udp_uring>(connection_socket.get_executor(), connection_socket.native_handle());
+		uring_in_use = uring_io->start();
+		if (!uring_in_use)
+			uring_io.reset();
+	}
+#endif
+
+	if (udp_gro && !uring_in_use)
+	{
+		int gro_option = 1;
+		if (setsockopt(connection_socket.native_handle(), SOL_UDP, UDP_GRO, &gro_option, sizeof(gro_option)) == 0)
+			receive_slots = std::make_unique<udp_receive_slots>(std::clamp<size_t>(receive_batch, 1, gbv_receive_batch_max), true);
+	}
+
+	if (receive_slots == nullptr && receive_batch > 1 && !uring_in_use)
+		receive_slots = std::make_unique<udp_receive_slots>(std::min<size_t>(receive_batch, gbv_receive_batch_max), false);
+
+	if (send_batch > 1 || udp_gso || (uring_in_use && !is_shard))
+	{
+		size_t batch_size = send_batch > 1 ? std::min<size_t>(send_batch, gbv_send_batch_max) : gbv_gso_segments_max;
+		std::chrono::microseconds latency_cap = send_latency > 0 ? std::chrono::microseconds(send_latency) : gbv_send_latency_default;
+		send_queue = std::make_unique<udp_send_queue>(connection_socket.get_executor(), batch_size, latency_cap, udp_gso);
+	}
+#endif
+}
+
+void udp_server::create_shards(asio::io_context &io_context, const udp::endpoint &ep)
+{
+#ifdef __linux__
+	size_t shard_count = std::min<size_t>(listen_shards, gbv_listen_shards_max);
+	for (size_t i = 1; i < shard_count; i++)
+		shards.emplace_back(new udp_server(io_context, *this, ep));
+#endif
 }
 
 void udp_server::start_receive()
 {
-	std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(gbv_buffer_size);
+#ifdef KCPTUBE_IO_URING
+	if (uring_io != nullptr)
+	{
+		start_uring_receive();
+		return;
+	}
+#endif
+
+#ifdef __linux__
+	if (receive_slots != nullptr)
+	{
+		start_batch_receive();
+		return;
+	}
+#endif
+
+	packet_buffer buffer_cache = make_packet_buffer(gbv_buffer_size + gbv_buffer_expand_size);
 	auto asio_buffer = asio::buffer(buffer_cache.get(), gbv_buffer_size);
 	connection_socket.async_receive_from(asio_buffer, incoming_endpoint,
 		[buffer_ptr = std::move(buffer_cache), this](const asio::error_code &error, std::size_t bytes_transferred) mutable
@@ -1079,7 +1618,7 @@ void udp_server::start_receive()
 		});
 }
 
-void udp_server::handle_receive(std::unique_ptr<uint8_t[]> buffer_cache, const asio::error_code &error, std::size_t bytes_transferred)
+void udp_server::handle_receive(packet_buffer buffer_cache, const asio::error_code &error, std::size_t bytes_transferred)
 {
 	if (error)
 	{
@@ -1088,41 +1627,210 @@ void udp_server::handle_receive(std::unique_ptr<uint8_t[]> buffer_cache, const a
 	}
 
 	udp::endpoint copy_of_incoming_endpoint = incoming_endpoint;
-	start_receive();
+	if (run_to_completion)
+	{
+		// The next packet of this socket is not taken until the current one has been processed and sent on
+		if (buffer_cache != nullptr && bytes_transferred > 0)
+			callback(std::move(buffer_cache), bytes_transferred, copy_of_incoming_endpoint, port_number);
+		start_receive();
+		return;
+	}
 
 	if (buffer_cache == nullptr || bytes_transferred == 0)
+	{
+		start_receive();
+		return;
+	}
+
+	if (sequence_task_pool != nullptr)
+	{
+		// Queue the packet before the next receive starts, otherwise another io thread could queue the next packet first
+		size_t pointer_to_number = (size_t)this;
+		if (task_limit == 0 || sequence_task_pool->get_task_count(pointer_to_number) <= task_limit)
+		{
+			sequence_task_pool->push_task(pointer_to_number, [this, bytes_transferred, copy_of_incoming_endpoint](packet_buffer data) mutable
+				{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, port_number); },
+				std::move(buffer_cache));
+		}
+		start_receive();
 		return;
+	}
+
+	start_receive();
+
+	if (task_assigner != nullptr)
+	{
+		if (task_limit > 0 && task_assigner->get_task_count() > task_limit)
+			return;
+		task_assigner->push_task([this, bytes_transferred, copy_of_incoming_endpoint](packet_buffer data) mutable
+			{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, port_number); },
+			std::move(buffer_cache));
+	}
+	else
+	{
+		callback(std::move(buffer_cache), bytes_transferred, copy_of_incoming_endpoint, port_number);
+	}
+}
+
+#ifdef __linux__
+void udp_server::start_batch_receive()
+{
+	connection_socket.async_wait(udp::socket::wait_read,
+		[this](const asio::error_code &error)
+		{
+			handle_batch_receive(error);
+		});
+}
+
+void udp_server::handle_batch_receive(const asio::error_code &error)
+{
+	if (error)
+	{
+		if (!connection_socket.is_open())
+			return;
+		start_batch_receive();
+		return;
+	}
 
-	if (gbv_buffer_size - bytes_transferred < gbv_buffer_expand_size)
+	std::vector<udp_datagram> datagrams = receive_slots->receive(connection_socket.native_handle());
+	// A sequenced pool gets the batch before the next receive starts, otherwise another io thread could queue a later batch first
+	if (run_to_completion || sequence_task_pool != nullptr)
 	{
-		std::unique_ptr<uint8_t[]> new_buffer = std::make_unique<uint8_t[]>(gbv_buffer_size + gbv_buffer_expand_size);
-		std::copy_n(buffer_cache.get(), bytes_transferred, new_buffer.get());
-		buffer_cache.swap(new_buffer);
+		dispatch_datagrams(std::move(datagrams));
+		start_batch_receive();
+		return;
 	}
+	start_batch_receive();
+	dispatch_datagrams(std::move(datagrams));
+}
+
+void udp_server::dispatch_datagrams(std::vector<udp_datagram> &&datagrams)
+{
+	if (datagrams.empty())
+		return;
 
 	if (sequence_task_pool != nullptr)
 	{
 		size_t pointer_to_number = (size_t)this;
 		if (task_limit > 0 && sequence_task_pool->get_task_count(pointer_to_number) > task_limit)
 			return;
-		sequence_task_pool->push_task(pointer_to_number, [this, bytes_transferred, copy_of_incoming_endpoint](std::unique_ptr<uint8_t[]> data) mutable
-			{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, port_number); },
-			std::move(buffer_cache));
+		sequence_task_pool->push_task(pointer_to_number, [this, datagrams = std::move(datagrams)]() mutable
+			{
+				for (udp_datagram &datagram : datagrams)
+					callback(std::move(datagram.data), datagram.data_size, datagram.peer, port_number);
+			});
 	}
 	else if (task_assigner != nullptr)
 	{
 		if (task_limit > 0 && task_assigner->get_task_count() > task_limit)
 			return;
-		task_assigner->push_task([this, bytes_transferred, copy_of_incoming_endpoint](std::unique_ptr<uint8_t[]> data) mutable
-			{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, port_number); },
-			std::move(buffer_cache));
+		for (udp_datagram &datagram : datagrams)
+		{
+			task_assigner->push_task([this, data_size = datagram.data_size, peer = datagram.peer](packet_buffer data) mutable
+				{ callback(std::move(data), data_size, peer, port_number); },
+				std::move(datagram.data));
+		}
 	}
 	else
 	{
-		callback(std::move(buffer_cache), bytes_transferred, copy_of_incoming_endpoint, port_number);
+		for (udp_datagram &datagram : datagrams)
+			callback(std::move(datagram.data), datagram.data_size, datagram.peer, port_number);
 	}
 }
 
+// Every socket of the SO_REUSEPORT group is chosen by the CPU that received the packet.
+// Without this program the kernel hashes the source endpoint, which already keeps a peer on one shard.
+void udp_server::attach_shard_steering()
+{
+	uint32_t shard_count = (uint32_t)std::min<size_t>(listen_shards, gbv_listen_shards_max);
+	sock_filter steering_code[] =
+	{
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, shard_count },
+		{ BPF_RET | BPF_A, 0, 0, 0 }
+	};
+	sock_fprog steering_program = { (unsigned short)(sizeof(steering_code) / sizeof(steering_code[0])), steering_code };
+	setsockopt(connection_socket.native_handle(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &steering_program, sizeof(steering_program));
+}
+
+void udp_server::queue_send_out(udp_outgoing_datagram &&datagram)
+{
+	switch (send_queue->push(std::move(datagram)))
+	{
+	case udp_send_queue::push_result::batch_full:
+		send_batch_out(false);
+		break;
+	case udp_send_queue::push_result::start_timer:
+		send_queue->flush_timer.expires_after(send_queue->flush_latency);
+		send_queue->flush_timer.async_wait([this](const asio::error_code &error)
+			{
+				if (error == asio::error::operation_aborted)
+					return;
+				send_batch_out(true);
+			});
+		break;
+	default:
+		break;
+	}
+}
+
+void udp_server::send_batch_out(bool from_timer)
+{
+	bool socket_full = send_queue->flush(from_timer, [this](std::vector<udp_outgoing_datagram> &datagrams) -> size_t
+		{
+#ifdef KCPTUBE_IO_URING
+			if (uring_io != nullptr)
+				return uring_io->send(datagrams);
+#endif
+			return send_queue->send(connection_socket.native_handle(), datagrams);
+		});
+	if (!socket_full)
+		return;
+
+	// The unsent datagrams stay queued in order, later ones must not overtake them
+	connection_socket.async_wait(udp::socket::wait_write, [this](const asio::error_code &error)
+		{
+			if (error == asio::error::operation_aborted)
+				return;
+			send_queue->resume();
+			send_batch_out(false);
+		});
+}
+#endif
+
+#ifdef KCPTUBE_IO_URING
+void udp_server::start_uring_receive()
+{
+	uring_io->completion_event.async_wait(asio::posix::stream_descriptor::wait_read,
+		[this](const asio::error_code &error)
+		{
+			handle_uring_receive(error);
+		});
+}
+
+void udp_server::handle_uring_receive(const asio::error_code &error)
+{
+	if (error)
+	{
+		if (error == asio::error::operation_aborted || !connection_socket.is_open())
+			return;
+		start_uring_receive();
+		return;
+	}
+
+	std::vector<udp_datagram> datagrams = uring_io->reap();
+	// A sequenced pool gets the batch before the next receive starts, otherwise another io thread could queue a later batch first
+	if (run_to_completion || sequence_task_pool != nullptr)
+	{
+		dispatch_datagrams(std::move(datagrams));
+		start_uring_receive();
+		return;
+	}
+	start_uring_receive();
+	dispatch_datagrams(std::move(datagrams));
+}
+#endif
+
 asio::ip::port_type udp_server::get_port_number()
 {
 	return port_number;
@@ -1177,6 +1885,10 @@ void udp_client::disconnect()
 {
 	asio::error_code ec;
 	connection_socket.close(ec);
+#ifdef KCPTUBE_IO_URING
+	if (uring_io != nullptr)
+		uring_io->completion_event.close(ec);
+#endif
 }
 
 void udp_client::async_receive()
@@ -1210,6 +1922,15 @@ void udp_client::async_send_out(std::unique_ptr<std::vector<uint8_t>> data, cons
 {
 	if (stopped.load() || data == nullptr || data->empty())
 		return;
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		const uint8_t *start_pos = data->data();
+		size_t data_size = data->size();
+		queue_send_out({ nullptr, std::move(data), start_pos, data_size, peer_endpoint });
+		return;
+	}
+#endif
 
 	auto asio_buffer = asio::buffer(*data);
 	connection_socket.async_send_to(asio_buffer, peer_endpoint,
@@ -1217,10 +1938,18 @@ void udp_client::async_send_out(std::unique_ptr<std::vector<uint8_t>> data, cons
 	last_send_time.store(packet::right_now());
 }
 
-void udp_client::async_send_out(std::unique_ptr<uint8_t[]> data, size_t data_size, const udp::endpoint &peer_endpoint)
+void udp_client::async_send_out(packet_buffer data, size_t data_size, const udp::endpoint &peer_endpoint)
 {
 	if (stopped.load() || data == nullptr || data_size == 0)
 		return;
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		const uint8_t *start_pos = data.get();
+		queue_send_out({ std::move(data), nullptr, start_pos, data_size, peer_endpoint });
+		return;
+	}
+#endif
 
 	auto asio_buffer = asio::buffer(data.get(), data_size);
 	connection_socket.async_send_to(asio_buffer, peer_endpoint,
@@ -1228,10 +1957,17 @@ void udp_client::async_send_out(std::unique_ptr<uint8_t[]> data, size_t data_siz
 	last_send_time.store(packet::right_now());
 }
 
-void udp_client::async_send_out(std::unique_ptr<uint8_t[]> data, uint8_t *start_pos, size_t data_size, const udp::endpoint &peer_endpoint)
+void udp_client::async_send_out(packet_buffer data, uint8_t *start_pos, size_t data_size, const udp::endpoint &peer_endpoint)
 {
 	if (stopped.load() || data == nullptr || data_size == 0)
 		return;
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		queue_send_out({ std::move(data), nullptr, start_pos, data_size, peer_endpoint });
+		return;
+	}
+#endif
 
 	connection_socket.async_send_to(asio::buffer(start_pos, data_size), peer_endpoint,
 		[data_ = std::move(data)](const asio::error_code &error, size_t bytes_transferred) {});
@@ -1242,6 +1978,16 @@ void udp_client::async_send_out(std::vector<uint8_t> &&data, const udp::endpoint
 {
 	if (stopped.load() || data.empty())
 		return;
+#ifdef __linux__
+	if (send_queue != nullptr)
+	{
+		auto data_ptr = std::make_unique<std::vector<uint8_t>>(std::move(data));
+		const uint8_t *start_pos = data_ptr->data();
+		size_t data_size = data_ptr->size();
+		queue_send_out({ nullptr, std::move(data_ptr), start_pos, data_size, peer_endpoint });
+		return;
+	}
+#endif
 
 	auto asio_buffer = asio::buffer(data);
 	connection_socket.async_send_to(asio_buffer, peer_endpoint,
@@ -1249,6 +1995,14 @@ void udp_client::async_send_out(std::vector<uint8_t> &&data, const udp::endpoint
 	last_send_time.store(packet::right_now());
 }
 
+void udp_client::flush_send_queue()
+{
+#ifdef __linux__
+	if (send_queue != nullptr)
+		send_batch_out(false);
+#endif
+}
+
 int64_t udp_client::time_gap_of_receive()
 {
 	return calculate_difference(packet::right_now(), last_receive_time.load());
@@ -1278,6 +2032,32 @@ void udp_client::initialise()
 		connection_socket.set_option(fib_option);
 	}
 #endif
+
+#ifdef __linux__
+	if (busy_poll > 0)
+		set_busy_poll(connection_socket.native_handle(), busy_poll);
+
+	bool uring_in_use = false;
+#ifdef KCPTUBE_IO_URING
+	if (udp_io_uring)
+	{
+		uring_io = std::make_unique<udp_uring>(connection_socket.get_executor(), connection_socket.native_handle());
+		uring_in_use = uring_io->start();
+		if (!uring_in_use)
+			uring_io.reset();
+	}
+#endif
+
+	if (receive_batch > 1 && !uring_in_use)
+		receive_slots = std::make_unique<udp_receive_slots>(std::min<size_t>(receive_batch, gbv_receive_batch_max), false);
+
+	if (send_batch > 1 || udp_gso || uring_in_use)
+	{
+		size_t batch_size = send_batch > 1 ? std::min<size_t>(send_batch, gbv_send_batch_max) : gbv_gso_segments_max;
+		std::chrono::microseconds latency_cap = send_latency > 0 ? std::chrono::microseconds(send_latency) : gbv_send_latency_default;
+		send_queue = std::make_unique<udp_send_queue>(connection_socket.get_executor(), batch_size, latency_cap, udp_gso);
+	}
+#endif
 }
 
 void udp_client::start_receive()
@@ -1285,7 +2065,23 @@ void udp_client::start_receive()
 	if (paused.load() || stopped.load())
 		return;
 
-	std::unique_ptr<uint8_t[]> buffer_cache = std::make_unique<uint8_t[]>(gbv_buffer_size);
+#ifdef KCPTUBE_IO_URING
+	if (uring_io != nullptr)
+	{
+		start_uring_receive();
+		return;
+	}
+#endif
+
+#ifdef __linux__
+	if (receive_slots != nullptr)
+	{
+		start_batch_receive();
+		return;
+	}
+#endif
+
+	packet_buffer buffer_cache = make_packet_buffer(gbv_buffer_size + gbv_buffer_expand_size);
 	uint8_t *buffer_cache_ptr = buffer_cache.get();
 	auto asio_buffer = asio::buffer(buffer_cache_ptr, gbv_buffer_size);
 	connection_socket.async_receive_from(asio_buffer, incoming_endpoint,
@@ -1295,7 +2091,7 @@ void udp_client::start_receive()
 		});
 }
 
-void udp_client::handle_receive(std::unique_ptr<uint8_t[]> buffer_cache, const asio::error_code &error, std::size_t bytes_transferred)
+void udp_client::handle_receive(packet_buffer buffer_cache, const asio::error_code &error, std::size_t bytes_transferred)
 {
 	if (stopped.load() || buffer_cache == nullptr)
 		return;
@@ -1311,37 +2107,200 @@ void udp_client::handle_receive(std::unique_ptr<uint8_t[]> buffer_cache, const a
 	udp::endpoint copy_of_incoming_endpoint = incoming_endpoint;
 	asio::error_code ec;
 
-	start_receive();
+	if (run_to_completion)
+	{
+		if (bytes_transferred > 0)
+			callback(std::move(buffer_cache), bytes_transferred, copy_of_incoming_endpoint, 0);
+		start_receive();
+		return;
+	}
 
 	if (bytes_transferred == 0)
+	{
+		start_receive();
+		return;
+	}
+
+	if (sequence_task_pool != nullptr)
+	{
+		// Queue the packet before the next receive starts, otherwise another io thread could queue the next packet first
+		size_t pointer_to_number = (size_t)this;
+		if (task_limit == 0 || sequence_task_pool->get_task_count(pointer_to_number) <= task_limit)
+		{
+			sequence_task_pool->push_task(pointer_to_number, [this, bytes_transferred, copy_of_incoming_endpoint, sptr = shared_from_this()](packet_buffer data) mutable
+				{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, 0); },
+				std::move(buffer_cache));
+		}
+		start_receive();
+		return;
+	}
+
+	start_receive();
+
+	if (task_assigner != nullptr)
+	{
+		if (task_limit > 0 && task_assigner->get_task_count() > task_limit)
+			return;
+		task_assigner->push_task([this, bytes_transferred, copy_of_incoming_endpoint, sptr = shared_from_this()](packet_buffer data) mutable
+			{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, 0); },
+			std::move(buffer_cache));
+	}
+	else
+	{
+		callback(std::move(buffer_cache), bytes_transferred, copy_of_incoming_endpoint, 0);
+	}
+}
+
+#ifdef __linux__
+void udp_client::start_batch_receive()
+{
+	connection_socket.async_wait(udp::socket::wait_read,
+		[this, sptr = shared_from_this()](const asio::error_code &error)
+		{
+			handle_batch_receive(error);
+		});
+}
+
+void udp_client::handle_batch_receive(const asio::error_code &error)
+{
+	if (stopped.load())
+		return;
+
+	if (error)
+	{
+		if (connection_socket.is_open())
+			start_receive();
 		return;
+	}
 
-	if (gbv_buffer_size - bytes_transferred < gbv_buffer_expand_size)
+	std::vector<udp_datagram> datagrams = receive_slots->receive(connection_socket.native_handle());
+	// A sequenced pool gets the batch before the next receive starts, otherwise another io thread could queue a later batch first
+	if (run_to_completion || sequence_task_pool != nullptr)
 	{
-		std::unique_ptr<uint8_t[]> new_buffer = std::make_unique<uint8_t[]>(gbv_buffer_size + gbv_buffer_expand_size);
-		std::copy_n(buffer_cache.get(), bytes_transferred, new_buffer.get());
-		buffer_cache.swap(new_buffer);
+		dispatch_datagrams(std::move(datagrams));
+		start_receive();
+		return;
 	}
+	start_receive();
+	dispatch_datagrams(std::move(datagrams));
+}
+
+void udp_client::dispatch_datagrams(std::vector<udp_datagram> &&datagrams)
+{
+	if (datagrams.empty())
+		return;
+
+	last_receive_time.store(packet::right_now());
 
 	if (sequence_task_pool != nullptr)
 	{
 		size_t pointer_to_number = (size_t)this;
 		if (task_limit > 0 && sequence_task_pool->get_task_count(pointer_to_number) > task_limit)
 			return;
-		sequence_task_pool->push_task(pointer_to_number, [this, bytes_transferred, copy_of_incoming_endpoint, sptr = shared_from_this()](std::unique_ptr<uint8_t[]> data) mutable
-			{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, 0); },
-			std::move(buffer_cache));
+		sequence_task_pool->push_task(pointer_to_number, [this, datagrams = std::move(datagrams), sptr = shared_from_this()]() mutable
+			{
+				for (udp_datagram &datagram : datagrams)
+					callback(std::move(datagram.data), datagram.data_size, datagram.peer, 0);
+			});
 	}
 	else if (task_assigner != nullptr)
 	{
 		if (task_limit > 0 && task_assigner->get_task_count() > task_limit)
 			return;
-		task_assigner->push_task([this, bytes_transferred, copy_of_incoming_endpoint, sptr = shared_from_this()](std::unique_ptr<uint8_t[]> data) mutable
-			{ callback(std::move(data), bytes_transferred, copy_of_incoming_endpoint, 0); },
-			std::move(buffer_cache));
+		for (udp_datagram &datagram : datagrams)
+		{
+			task_assigner->push_task([this, data_size = datagram.data_size, peer = datagram.peer, sptr = shared_from_this()](packet_buffer data) mutable
+				{ callback(std::move(data), data_size, peer, 0); },
+				std::move(datagram.data));
+		}
 	}
 	else
 	{
-		callback(std::move(buffer_cache), bytes_transferred, copy_of_incoming_endpoint, 0);
+		for (udp_datagram &datagram : datagrams)
+			callback(std::move(datagram.data), datagram.data_size, datagram.peer, 0);
 	}
 }
+
+void udp_client::queue_send_out(udp_outgoing_datagram &&datagram)
+{
+	last_send_time.store(packet::right_now());
+	switch (send_queue->push(std::move(datagram)))
+	{
+	case udp_send_queue::push_result::batch_full:
+		send_batch_out(false);
+		break;
+	case udp_send_queue::push_result::start_timer:
+		send_queue->flush_timer.expires_after(send_queue->flush_latency);
+		send_queue->flush_timer.async_wait([this, sptr = shared_from_this()](const asio::error_code &error)
+			{
+				if (error == asio::error::operation_aborted)
+					return;
+				send_batch_out(true);
+			});
+		break;
+	default:
+		break;
+	}
+}
+
+void udp_client::send_batch_out(bool from_timer)
+{
+	if (stopped.load())
+		return;
+
+	bool socket_full = send_queue->flush(from_timer, [this](std::vector<udp_outgoing_datagram> &datagrams) -> size_t
+		{
+#ifdef KCPTUBE_IO_URING
+			if (uring_io != nullptr)
+				return uring_io->send(datagrams);
+#endif
+			return send_queue->send(connection_socket.native_handle(), datagrams);
+		});
+	if (!socket_full)
+		return;
+
+	// The unsent datagrams stay queued in order, later ones must not overtake them
+	connection_socket.async_wait(udp::socket::wait_write, [this, sptr = shared_from_this()](const asio::error_code &error)
+		{
+			if (error == asio::error::operation_aborted)
+				return;
+			send_queue->resume();
+			send_batch_out(false);
+		});
+}
+#endif
+
+#ifdef KCPTUBE_IO_URING
+void udp_client::start_uring_receive()
+{
+	uring_io->completion_event.async_wait(asio::posix::stream_descriptor::wait_read,
+		[this, sptr = shared_from_this()](const asio::error_code &error)
+		{
+			handle_uring_receive(error);
+		});
+}
+
+void udp_client::handle_uring_receive(const asio::error_code &error)
+{
+	if (stopped.load())
+		return;
+
+	if (error)
+	{
+		if (error != asio::error::operation_aborted && connection_socket.is_open())
+			start_receive();
+		return;
+	}
+
+	std::vector<udp_datagram> datagrams = uring_io->reap();
+	// A sequenced pool gets the batch before the next receive starts, otherwise another io thread could queue a later batch first
+	if (run_to_completion || sequence_task_pool != nullptr)
+	{
+		dispatch_datagrams(std::move(datagrams));
+		start_receive();
+		return;
+	}
+	start_receive();
+	dispatch_datagrams(std::move(datagrams));
+}
+#endif
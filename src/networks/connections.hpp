@@ -17,6 +17,22 @@
 #include <vector>
 #include <deque>
 #include <asio.hpp>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifdef KCPTUBE_IO_URING
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <liburing.h>
+#endif
+#endif
 
 #include "../shares/share_defines.hpp"
 #include "../3rd_party/thread_pool.hpp"
@@ -35,6 +51,16 @@ constexpr uint32_t gbv_half_time = 2u;
 constexpr uint16_t gbv_fec_waits = 3u;
 constexpr size_t gbv_buffer_size = 2048u;
 constexpr size_t gbv_buffer_expand_size = 128u;
+static_assert(gbv_buffer_size + gbv_buffer_expand_size <= packet_buffer_block_size);
+constexpr size_t gbv_receive_batch_max = 256u;
+constexpr size_t gbv_send_batch_max = 256u;
+constexpr auto gbv_send_latency_default = std::chrono::microseconds(100);
+constexpr size_t gbv_gso_segments_max = 64u;
+constexpr size_t gbv_gso_bytes_max = 65000u;
+constexpr size_t gbv_gro_buffer_size = 65536u;
+constexpr size_t gbv_listen_shards_max = 256u;
+constexpr unsigned gbv_uring_queue_depth = 1024u;
+constexpr unsigned gbv_uring_buffer_count = 512u;	// must be a power of 2
 constexpr size_t gbv_retry_times = 30u;
 constexpr size_t gbv_retry_waits = 2u;
 constexpr size_t gbv_cleanup_waits = 15;	// second
@@ -53,6 +79,16 @@ struct connection_options
 	ip_only_options ip_version_only = ip_only_options::not_set;
 	int fib_ingress = 0;
 	int fib_egress = 0;
+	uint16_t udp_receive_batch = 0;
+	uint16_t udp_send_batch = 0;
+	uint32_t udp_send_latency = 0;	// microseconds
+	bool udp_gso = false;
+	bool udp_gro = false;
+	uint16_t udp_listen_shards = 0;
+	bool udp_shard_by_cpu = false;
+	bool udp_io_uring = false;
+	bool run_to_completion = false;
+	uint32_t udp_busy_poll = 0;	// microseconds
 };
 
 enum class feature : uint8_t
@@ -143,9 +179,9 @@ namespace packet
 
 	int64_t right_now();
 
-	std::unique_ptr<uint8_t[]> create_packet(const uint8_t *input_data, int data_size, int &new_size);
-	std::unique_ptr<uint8_t[]> create_fec_data_packet(const uint8_t *input_data, int data_size, int &new_size, uint32_t fec_sn, uint8_t fec_sub_sn);
-	std::unique_ptr<uint8_t[]> create_fec_redundant_packet(const uint8_t *input_data, int data_size, int &new_size, uint32_t fec_sn, uint8_t fec_sub_sn, uint32_t kcp_conv);
+	packet_buffer create_packet(const uint8_t *input_data, int data_size, int &new_size);
+	packet_buffer create_fec_data_packet(const uint8_t *input_data, int data_size, int &new_size, uint32_t fec_sn, uint8_t fec_sub_sn);
+	packet_buffer create_fec_redundant_packet(const uint8_t *input_data, int data_size, int &new_size, uint32_t fec_sn, uint8_t fec_sub_sn, uint32_t kcp_conv);
 	std::vector<uint8_t> create_inner_packet(feature ftr, protocol_type prtcl, const std::vector<uint8_t> &data);
 	std::vector<uint8_t> create_inner_packet(feature ftr, protocol_type prtcl, const uint8_t *input_data, size_t data_size);
 	size_t create_inner_packet(feature ftr, protocol_type prtcl, uint8_t *input_data, size_t data_size);
@@ -202,15 +238,16 @@ using asio::ip::udp;
 
 class tcp_session;
 
-using tcp_callback_t = std::function<void(std::unique_ptr<uint8_t[]>, size_t, std::shared_ptr<tcp_session>)>;
-using udp_callback_t = std::function<void(std::unique_ptr<uint8_t[]>, size_t, udp::endpoint, asio::ip::port_type)>;
+using tcp_callback_t = std::function<void(packet_buffer, size_t, std::shared_ptr<tcp_session>)>;
+using udp_callback_t = std::function<void(packet_buffer, size_t, udp::endpoint, asio::ip::port_type)>;
 
-void empty_tcp_callback(std::unique_ptr<uint8_t[]> tmp1, size_t tmps, std::shared_ptr<tcp_session> tmp2);
-void empty_udp_callback(std::unique_ptr<uint8_t[]> tmp1, size_t tmps, udp::endpoint tmp2, asio::ip::port_type tmp3);
+void empty_tcp_callback(packet_buffer tmp1, size_t tmps, std::shared_ptr<tcp_session> tmp2);
+void empty_udp_callback(packet_buffer tmp1, size_t tmps, udp::endpoint tmp2, asio::ip::port_type tmp3);
 void empty_tcp_disconnect(std::shared_ptr<tcp_session> tmp);
 int empty_kcp_output(const char *, int, void *);
 void empty_kcp_postupdate(void *);
-void empty_task_callback(std::unique_ptr<uint8_t[]> null_data);
+void empty_task_callback(packet_buffer null_data);
+std::string task_pool_depths(const ttp::task_group_pool &task_pool);	// unfinished tasks of each thread, separated by spaces
 
 class tcp_session : public std::enable_shared_from_this<tcp_session>
 {
@@ -255,8 +292,8 @@ public:
 
 	void async_send_data(std::unique_ptr<std::vector<uint8_t>> data);
 	void async_send_data(std::vector<uint8_t> &&data);
-	void async_send_data(std::unique_ptr<uint8_t[]> buffer_data, size_t size_in_bytes);
-	void async_send_data(std::unique_ptr<uint8_t[]> buffer_data, uint8_t *start_pos, size_t size_in_bytes);
+	void async_send_data(packet_buffer buffer_data, size_t size_in_bytes);
+	void async_send_data(packet_buffer buffer_data, uint8_t *start_pos, size_t size_in_bytes);
 	void async_send_data(const uint8_t *buffer_data, size_t size_in_bytes);
 
 	void when_disconnect(std::function<void(std::shared_ptr<tcp_session>)> callback_before_disconnect);
@@ -272,9 +309,9 @@ public:
 private:
 	void after_write_completed(const asio::error_code &error, size_t bytes_transferred);
 
-	void after_read_completed(std::unique_ptr<uint8_t[]> buffer_cache, const asio::error_code &error, size_t bytes_transferred);
+	void after_read_completed(packet_buffer buffer_cache, const asio::error_code &error, size_t bytes_transferred);
 
-	void transfer_data_to_next_function(std::unique_ptr<uint8_t[]> buffer_cache, size_t bytes_transferred);
+	void transfer_data_to_next_function(packet_buffer buffer_cache, size_t bytes_transferred);
 
 	asio::io_context &network_io;
 	ttp::task_thread_pool *task_assigner;
@@ -382,6 +419,139 @@ private:
 
 
 
+struct udp_datagram
+{
+	packet_buffer data;
+	size_t data_size;
+	udp::endpoint peer;
+};
+
+struct udp_outgoing_datagram
+{
+	packet_buffer data;
+	std::unique_ptr<std::vector<uint8_t>> vector_data;
+	const uint8_t *start_pos;
+	size_t data_size;
+	udp::endpoint peer;
+};
+
+#ifdef __linux__
+// SO_BUSY_POLL: a blocking read polls the device queue for up to this many microseconds before sleeping.
+// Values above net.core.busy_read need CAP_NET_ADMIN, a refused value is ignored.
+void set_busy_poll(int socket_fd, uint32_t busy_poll_us);
+
+// Preallocated recvmmsg() slots, every slot already carries gbv_buffer_expand_size of headroom
+// In GRO mode the slots are large and kept, coalesced datagrams are split by the UDP_GRO segment size
+class udp_receive_slots
+{
+public:
+	udp_receive_slots() = delete;
+	udp_receive_slots(size_t slot_count, bool gro_mode);
+
+	std::vector<udp_datagram> receive(int socket_fd);
+
+private:
+	void split_segments(size_t slot_index, std::vector<udp_datagram> &datagrams, const udp::endpoint &peer);
+
+	const bool gro_enabled;
+	std::mutex mutex_slots;
+	std::vector<packet_buffer> buffers;
+	std::vector<sockaddr_storage> addresses;
+	std::vector<iovec> iovecs;
+	std::vector<mmsghdr> headers;
+	std::vector<std::array<uint8_t, CMSG_SPACE(sizeof(int))>> controls;
+};
+
+// Collects outgoing datagrams of one socket and sends them with sendmmsg()
+// With GSO enabled, consecutive same-size datagrams to the same peer are sent as one UDP_SEGMENT message
+class udp_send_queue
+{
+public:
+	enum class push_result { queued, start_timer, batch_full };
+
+	udp_send_queue() = delete;
+	udp_send_queue(const asio::any_io_executor &executor, size_t batch_size, std::chrono::microseconds latency_cap, bool enable_gso)
+		: max_batch_size(batch_size), flush_latency(latency_cap), flush_timer(executor), timer_started(false), waiting_writable(false), gso_enabled(enable_gso) {}
+
+	push_result push(udp_outgoing_datagram &&datagram);
+	size_t send(int socket_fd, std::vector<udp_outgoing_datagram> &datagrams);
+
+	// Hands the pending datagrams to send_function in order, one caller at a time; send_function returns how many went out
+	// Returns true if the socket is full: the rest stays in front of the queue, nothing is sent until resume() is called
+	template<typename F>
+	bool flush(bool from_timer, F &&send_function)
+	{
+		std::scoped_lock sending_locker{ mutex_sending };
+		std::vector<udp_outgoing_datagram> datagrams = take_all(from_timer);
+		if (datagrams.empty())
+			return false;
+		size_t sent = send_function(datagrams);
+		if (sent >= datagrams.size())
+			return false;
+		keep_unsent(datagrams, sent);
+		return true;
+	}
+	// The socket is writable again
+	void resume();
+
+	const size_t max_batch_size;
+	const std::chrono::microseconds flush_latency;
+	asio::steady_timer flush_timer;
+
+private:
+	std::vector<udp_outgoing_datagram> take_all(bool from_timer);
+	void keep_unsent(std::vector<udp_outgoing_datagram> &datagrams, size_t sent);
+	static size_t send_each(int socket_fd, std::vector<udp_outgoing_datagram> &datagrams, size_t start);
+	size_t send_segmented(int socket_fd, std::vector<udp_outgoing_datagram> &datagrams);
+
+	std::mutex mutex_sending;
+	std::mutex mutex_pending;
+	std::vector<udp_outgoing_datagram> pending;
+	bool timer_started;
+	bool waiting_writable;
+	std::atomic<bool> gso_enabled;
+};
+
+#ifdef KCPTUBE_IO_URING
+// io_uring path of one socket: a multishot recvmsg fed by a provided buffer ring, sends are submitted as batches of SQEs
+// Completions are signalled through an eventfd, so the asio reactor only wakes up when there is something to reap
+class udp_uring
+{
+public:
+	udp_uring() = delete;
+	udp_uring(const asio::any_io_executor &executor, int socket_fd)
+		: completion_event(executor), ring{}, buffer_ring(nullptr), receive_message{}, next_send_id(1), socket_fd(socket_fd), ring_ready(false) {}
+	~udp_uring();
+
+	bool start();
+	std::vector<udp_datagram> reap();
+	size_t send(std::vector<udp_outgoing_datagram> &datagrams);
+
+	asio::posix::stream_descriptor completion_event;
+
+private:
+	struct send_slot
+	{
+		udp_outgoing_datagram datagram;
+		iovec buffer;
+		msghdr message;
+	};
+
+	bool arm_receive();
+
+	std::mutex mutex_ring;
+	io_uring ring;
+	io_uring_buf_ring *buffer_ring;
+	packet_buffer receive_buffers;
+	msghdr receive_message;
+	std::unordered_map<uint64_t, std::unique_ptr<send_slot>> in_flight;
+	uint64_t next_send_id;
+	const int socket_fd;
+	bool ring_ready;
+};
+#endif
+#endif
+
 class udp_server
 {
 public:
@@ -389,40 +559,83 @@ public:
 
 	udp_server(asio::io_context &io_context, const udp::endpoint &ep, udp_callback_t callback_func, connection_options conn_options)
 		: task_assigner(nullptr), sequence_task_pool(nullptr), task_limit(0), port_number(ep.port()), resolver(io_context), connection_socket(io_context), callback(callback_func),
-		ip_version_only(conn_options.ip_version_only), fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress)
+		ip_version_only(conn_options.ip_version_only), fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress),
+		receive_batch(conn_options.udp_receive_batch), send_batch(conn_options.udp_send_batch), send_latency(conn_options.udp_send_latency),
+		udp_gso(conn_options.udp_gso), udp_gro(conn_options.udp_gro),
+		listen_shards(conn_options.udp_listen_shards), shard_by_cpu(conn_options.udp_shard_by_cpu), is_shard(false),
+		udp_io_uring(conn_options.udp_io_uring), run_to_completion(conn_options.run_to_completion), busy_poll(conn_options.udp_busy_poll)
 	{
 		initialise(ep);
+		create_shards(io_context, ep);
 		start_receive();
 	}
 
 	udp_server(asio::io_context &io_context, ttp::task_group_pool &group_pool, size_t task_count_limit, const udp::endpoint &ep, udp_callback_t callback_func, connection_options conn_options)
-		: task_assigner(nullptr), sequence_task_pool(&group_pool), task_limit(task_count_limit), port_number(ep.port()), resolver(io_context), connection_socket(io_context),
-		callback(callback_func), ip_version_only(conn_options.ip_version_only), fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress)
+		: task_assigner(nullptr), sequence_task_pool(conn_options.run_to_completion ? nullptr : &group_pool), task_limit(task_count_limit), port_number(ep.port()), resolver(io_context), connection_socket(io_context),
+		callback(callback_func), ip_version_only(conn_options.ip_version_only), fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress),
+		receive_batch(conn_options.udp_receive_batch), send_batch(conn_options.udp_send_batch), send_latency(conn_options.udp_send_latency),
+		udp_gso(conn_options.udp_gso), udp_gro(conn_options.udp_gro),
+		listen_shards(conn_options.udp_listen_shards), shard_by_cpu(conn_options.udp_shard_by_cpu), is_shard(false),
+		udp_io_uring(conn_options.udp_io_uring), run_to_completion(conn_options.run_to_completion), busy_poll(conn_options.udp_busy_poll)
 	{
 		initialise(ep);
+		create_shards(io_context, ep);
 		start_receive();
 	}
 
 	udp_server(asio::io_context &io_context, ttp::task_thread_pool &task_pool, size_t task_count_limit, const udp::endpoint &ep, udp_callback_t callback_func, connection_options conn_options)
-		: task_assigner(&task_pool), sequence_task_pool(nullptr), task_limit(task_count_limit), port_number(ep.port()), resolver(io_context), connection_socket(io_context),
-		callback(callback_func), ip_version_only(conn_options.ip_version_only), fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress)
+		: task_assigner(conn_options.run_to_completion ? nullptr : &task_pool), sequence_task_pool(nullptr), task_limit(task_count_limit), port_number(ep.port()), resolver(io_context), connection_socket(io_context),
+		callback(callback_func), ip_version_only(conn_options.ip_version_only), fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress),
+		receive_batch(conn_options.udp_receive_batch), send_batch(conn_options.udp_send_batch), send_latency(conn_options.udp_send_latency),
+		udp_gso(conn_options.udp_gso), udp_gro(conn_options.udp_gro),
+		listen_shards(conn_options.udp_listen_shards), shard_by_cpu(conn_options.udp_shard_by_cpu), is_shard(false),
+		udp_io_uring(conn_options.udp_io_uring), run_to_completion(conn_options.run_to_completion), busy_poll(conn_options.udp_busy_poll)
 	{
 		initialise(ep);
+		create_shards(io_context, ep);
 		start_receive();
 	}
 
 	void continue_receive();
 
 	void async_send_out(std::unique_ptr<std::vector<uint8_t>> data, const udp::endpoint &client_endpoint);
-	void async_send_out(std::unique_ptr<uint8_t[]> data, size_t data_size, const udp::endpoint &client_endpoint);
-	void async_send_out(std::unique_ptr<uint8_t[]> data, uint8_t *start_pos, size_t data_size, const udp::endpoint &client_endpoint);
+	void async_send_out(packet_buffer data, size_t data_size, const udp::endpoint &client_endpoint);
+	void async_send_out(packet_buffer data, uint8_t *start_pos, size_t data_size, const udp::endpoint &client_endpoint);
 	void async_send_out(std::vector<uint8_t> &&data, const udp::endpoint &client_endpoint);
+	// Sends the queued datagrams now instead of waiting for a full batch or the latency cap
+	void flush_send_queue();
 	udp::resolver& get_resolver() { return resolver; }
 
 private:
+	// Receive-only SO_REUSEPORT sibling of a sharded listener, sends always go through the primary socket
+	udp_server(asio::io_context &io_context, const udp_server &primary, const udp::endpoint &ep)
+		: task_assigner(primary.task_assigner), sequence_task_pool(primary.sequence_task_pool), task_limit(primary.task_limit), port_number(ep.port()),
+		resolver(io_context), connection_socket(io_context), callback(primary.callback),
+		ip_version_only(primary.ip_version_only), fib_ingress(primary.fib_ingress), fib_egress(primary.fib_egress),
+		receive_batch(primary.receive_batch), send_batch(0), send_latency(0), udp_gso(false), udp_gro(primary.udp_gro),
+		listen_shards(primary.listen_shards), shard_by_cpu(primary.shard_by_cpu), is_shard(true),
+		udp_io_uring(primary.udp_io_uring), run_to_completion(primary.run_to_completion), busy_poll(primary.busy_poll)
+	{
+		initialise(ep);
+		start_receive();
+	}
+
 	void initialise(const udp::endpoint &ep);
+	void create_shards(asio::io_context &io_context, const udp::endpoint &ep);
 	void start_receive();
-	void handle_receive(std::unique_ptr<uint8_t[]> buffer_cache, const asio::error_code &error, std::size_t bytes_transferred);
+	void handle_receive(packet_buffer buffer_cache, const asio::error_code &error, std::size_t bytes_transferred);
+#ifdef __linux__
+	void start_batch_receive();
+	void handle_batch_receive(const asio::error_code &error);
+	void queue_send_out(udp_outgoing_datagram &&datagram);
+	void send_batch_out(bool from_timer);
+	void dispatch_datagrams(std::vector<udp_datagram> &&datagrams);
+	void attach_shard_steering();
+#endif
+#ifdef KCPTUBE_IO_URING
+	void start_uring_receive();
+	void handle_uring_receive(const asio::error_code &error);
+#endif
 
 	asio::ip::port_type get_port_number();
 
@@ -437,6 +650,25 @@ private:
 	const ip_only_options ip_version_only;
 	int fib_ingress;
 	int fib_egress;
+	const uint16_t receive_batch;
+	const uint16_t send_batch;
+	const uint32_t send_latency;
+	const bool udp_gso;
+	const bool udp_gro;
+	const uint16_t listen_shards;
+	const bool shard_by_cpu;
+	const bool is_shard;
+	const bool udp_io_uring;
+	const bool run_to_completion;	// process each packet on the receiving thread before the next receive is armed
+	const uint32_t busy_poll;
+#ifdef __linux__
+	std::unique_ptr<udp_receive_slots> receive_slots;
+	std::unique_ptr<udp_send_queue> send_queue;
+#endif
+#ifdef KCPTUBE_IO_URING
+	std::unique_ptr<udp_uring> uring_io;
+#endif
+	std::vector<std::unique_ptr<udp_server>> shards;
 };
 
 class udp_client : public std::enable_shared_from_this<udp_client>
@@ -449,27 +681,36 @@ public:
 		connection_socket(io_context), resolver(io_context), callback(callback_func),
 		last_receive_time(packet::right_now()), last_send_time(packet::right_now()),
 		paused(false), stopped(false), ip_version_only(conn_options.ip_version_only),
-		fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress)
+		fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress), receive_batch(conn_options.udp_receive_batch),
+		send_batch(conn_options.udp_send_batch), send_latency(conn_options.udp_send_latency),
+		udp_gso(conn_options.udp_gso), udp_io_uring(conn_options.udp_io_uring), run_to_completion(conn_options.run_to_completion),
+		busy_poll(conn_options.udp_busy_poll)
 	{
 		initialise();
 	}
 
 	udp_client(asio::io_context &io_context, ttp::task_group_pool &group_pool, size_t task_count_limit, udp_callback_t callback_func, connection_options conn_options)
-		: task_assigner(nullptr), sequence_task_pool(&group_pool), task_limit(task_count_limit),
+		: task_assigner(nullptr), sequence_task_pool(conn_options.run_to_completion ? nullptr : &group_pool), task_limit(task_count_limit),
 		connection_socket(io_context), resolver(io_context), callback(callback_func),
 		last_receive_time(packet::right_now()), last_send_time(packet::right_now()),
 		paused(false), stopped(false), ip_version_only(conn_options.ip_version_only),
-		fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress)
+		fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress), receive_batch(conn_options.udp_receive_batch),
+		send_batch(conn_options.udp_send_batch), send_latency(conn_options.udp_send_latency),
+		udp_gso(conn_options.udp_gso), udp_io_uring(conn_options.udp_io_uring), run_to_completion(conn_options.run_to_completion),
+		busy_poll(conn_options.udp_busy_poll)
 	{
 		initialise();
 	}
 
 	udp_client(asio::io_context &io_context, ttp::task_thread_pool &task_pool, size_t task_count_limit, udp_callback_t callback_func, connection_options conn_options)
-		: task_assigner(&task_pool), sequence_task_pool(nullptr), task_limit(task_count_limit),
+		: task_assigner(conn_options.run_to_completion ? nullptr : &task_pool), sequence_task_pool(nullptr), task_limit(task_count_limit),
 		connection_socket(io_context), resolver(io_context), callback(callback_func),
 		last_receive_time(packet::right_now()), last_send_time(packet::right_now()),
 		paused(false), stopped(false), ip_version_only(conn_options.ip_version_only),
-		fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress)
+		fib_ingress(conn_options.fib_ingress), fib_egress(conn_options.fib_egress), receive_batch(conn_options.udp_receive_batch),
+		send_batch(conn_options.udp_send_batch), send_latency(conn_options.udp_send_latency),
+		udp_gso(conn_options.udp_gso), udp_io_uring(conn_options.udp_io_uring), run_to_completion(conn_options.run_to_completion),
+		busy_poll(conn_options.udp_busy_poll)
 	{
 		initialise();
 	}
@@ -490,9 +731,11 @@ public:
 	size_t send_out(const uint8_t *data, size_t size, const udp::endpoint &peer_endpoint, asio::error_code &ec);
 
 	void async_send_out(std::unique_ptr<std::vector<uint8_t>> data, const udp::endpoint &peer_endpoint);
-	void async_send_out(std::unique_ptr<uint8_t[]> data, size_t data_size, const udp::endpoint &peer_endpoint);
-	void async_send_out(std::unique_ptr<uint8_t[]> data, uint8_t *start_pos, size_t data_size, const udp::endpoint &peer_endpoint);
+	void async_send_out(packet_buffer data, size_t data_size, const udp::endpoint &peer_endpoint);
+	void async_send_out(packet_buffer data, uint8_t *start_pos, size_t data_size, const udp::endpoint &peer_endpoint);
 	void async_send_out(std::vector<uint8_t> &&data, const udp::endpoint &peer_endpoint);
+	// Sends the queued datagrams now instead of waiting for a full batch or the latency cap
+	void flush_send_queue();
 
 	int64_t time_gap_of_receive();
 	int64_t time_gap_of_send();
@@ -502,7 +745,18 @@ protected:
 
 	void start_receive();
 
-	void handle_receive(std::unique_ptr<uint8_t[]> buffer_cache, const asio::error_code &error, std::size_t bytes_transferred);
+	void handle_receive(packet_buffer buffer_cache, const asio::error_code &error, std::size_t bytes_transferred);
+#ifdef __linux__
+	void start_batch_receive();
+	void handle_batch_receive(const asio::error_code &error);
+	void queue_send_out(udp_outgoing_datagram &&datagram);
+	void send_batch_out(bool from_timer);
+	void dispatch_datagrams(std::vector<udp_datagram> &&datagrams);
+#endif
+#ifdef KCPTUBE_IO_URING
+	void start_uring_receive();
+	void handle_uring_receive(const asio::error_code &error);
+#endif
 
 	ttp::task_thread_pool *task_assigner;
 	ttp::task_group_pool *sequence_task_pool;
@@ -518,12 +772,26 @@ protected:
 	const ip_only_options ip_version_only;
 	int fib_ingress;
 	int fib_egress;
+	const uint16_t receive_batch;
+	const uint16_t send_batch;
+	const uint32_t send_latency;
+	const bool udp_gso;
+	const bool udp_io_uring;
+	const bool run_to_completion;
+	const uint32_t busy_poll;
+#ifdef __linux__
+	std::unique_ptr<udp_receive_slots> receive_slots;
+	std::unique_ptr<udp_send_queue> send_queue;
+#endif
+#ifdef KCPTUBE_IO_URING
+	std::unique_ptr<udp_uring> uring_io;
+#endif
 };
 
 class forwarder : public udp_client
 {
 public:
-	using process_data_t = std::function<void(std::shared_ptr<KCP::KCP>, std::unique_ptr<uint8_t[]>, size_t, udp::endpoint, asio::ip::port_type)>;
+	using process_data_t = std::function<void(std::shared_ptr<KCP::KCP>, packet_buffer, size_t, udp::endpoint, asio::ip::port_type)>;
 
 	forwarder() = delete;
 
@@ -548,11 +816,11 @@ public:
 	void remove_callback()
 	{
 		kcp.reset();
-		callback = [](std::shared_ptr<KCP::KCP> kcp, std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint ep, asio::ip::port_type num) {};
+		callback = [](std::shared_ptr<KCP::KCP> kcp, packet_buffer data, size_t data_size, udp::endpoint ep, asio::ip::port_type num) {};
 	}
 
 private:
-	void handle_receive(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
+	void handle_receive(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type local_port_number)
 	{
 		if (paused.load() || stopped.load())
 			return;
@@ -575,8 +843,8 @@ struct fec_control_data
 {
 	alignas(64) std::atomic<uint32_t> fec_snd_sn;
 	alignas(64) std::atomic<uint32_t> fec_snd_sub_sn;
-	std::vector<std::pair<std::unique_ptr<uint8_t[]>, size_t>> fec_snd_cache;
-	std::map<uint32_t, std::map<uint16_t, std::pair<std::unique_ptr<uint8_t[]>, size_t>>> fec_rcv_cache;	// uint32_t = snd_sn, uint16_t = sub_sn
+	std::vector<std::pair<packet_buffer, size_t>> fec_snd_cache;
+	std::map<uint32_t, std::map<uint16_t, std::pair<packet_buffer, size_t>>> fec_rcv_cache;	// uint32_t = snd_sn, uint16_t = sub_sn
 	std::unordered_set<uint32_t> fec_rcv_restored;
 	fecpp::fec_code fecc;
 };
@@ -584,6 +852,7 @@ struct fec_control_data
 struct kcp_mappings : public std::enable_shared_from_this<kcp_mappings>
 {
 	protocol_type connection_protocol;
+	std::shared_mutex mutex_ingress_endpoint;
 	std::shared_ptr<udp::endpoint> ingress_source_endpoint;
 	std::shared_mutex mutex_egress_endpoint;
 	udp::endpoint egress_target_endpoint;
@@ -607,6 +876,30 @@ struct kcp_mappings : public std::enable_shared_from_this<kcp_mappings>
 	fec_control_data fec_egress_control;
 
 	std::shared_ptr<kcp_mappings> self_share() { return shared_from_this(); }
+
+	// The source endpoint is replaced by the receiving threads and read by the sending threads
+	std::shared_ptr<udp::endpoint> get_ingress_source_endpoint()
+	{
+		std::shared_lock locker{ mutex_ingress_endpoint };
+		return ingress_source_endpoint;
+	}
+
+	void set_ingress_source_endpoint(std::shared_ptr<udp::endpoint> source_endpoint)
+	{
+		std::unique_lock locker{ mutex_ingress_endpoint };
+		ingress_source_endpoint = std::move(source_endpoint);
+	}
+
+	void update_ingress_source_endpoint(const udp::endpoint &peer)
+	{
+		{
+			std::shared_lock locker{ mutex_ingress_endpoint };
+			if (ingress_source_endpoint != nullptr && *ingress_source_endpoint == peer)
+				return;
+		}
+		std::unique_lock locker{ mutex_ingress_endpoint };
+		ingress_source_endpoint = std::make_shared<udp::endpoint>(peer);
+	}
 };
 
 struct mux_records
@@ -623,7 +916,7 @@ struct mux_records
 
 struct mux_data_cache
 {
-	std::unique_ptr<uint8_t[]> data;
+	packet_buffer data;
 	uint8_t *sending_ptr;
 	size_t data_size;
 };
@@ -24,9 +24,20 @@ int64_t right_now();
 
 namespace KCP
 {
+	// freed by the segments of kcp_core, under the lock of the session
+	struct packet_buffer_owner : payload_owner
+	{
+		packet_buffer buffer;
+	};
+
+	uint64_t MicrosecondsNowForKCP()
+	{
+		return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+	}
+
 	uint32_t TimeNowForKCP()
 	{
-		return static_cast<uint32_t>((duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count()) & 0xFFFF'FFFFul);
+		return TimeForKCP(MicrosecondsNowForKCP());
 	}
 
 	void empty_function(void *) {}
@@ -44,6 +55,7 @@ namespace KCP
 		kcp_ptr = std::move(other.kcp_ptr);
 		last_input_time = other.last_input_time;
 		post_update = other.post_update;
+		output_end = other.output_end;
 	}
 
 	//KCP::KCP(const KCP &other) noexcept
@@ -58,6 +70,7 @@ namespace KCP
 	KCP::~KCP()
 	{
 		post_update = empty_function;
+		output_end = nullptr;
 	}
 
 	void KCP::ResetWindowValues(int32_t srtt)
@@ -90,16 +103,24 @@ namespace KCP
 		return kcp_ptr->rx_srtt;
 	}
 
-	void KCP::SetOutput(std::function<int(const char *, int, void *)> output_func)
+	void KCP::SetOutput(std::function<int(const char *, int, void *)> output_func, std::function<void(void *)> output_end_func)
 	{
 		//output = output_func;
+		output_end = output_end_func;
 		kcp_ptr->set_output([this, output_func](const char *buf, int len, void *user) -> int
 			{
 				sent_data_average_peak = (7 * sent_data_average_peak + len) / 8;
+				output_in_round = true;
 				return output_func(buf, len, user);
 			});
 	}
 
+	void KCP::EndOutputRound(bool has_output)
+	{
+		if (has_output && output_end)
+			output_end(kcp_ptr->user);
+	}
+
 	void KCP::SetPostUpdate(std::function<void(void *)> post_update_func)
 	{
 		post_update = post_update_func;
@@ -117,36 +138,96 @@ namespace KCP
 		return kcp_ptr->receive(buffer.data(), (int)buffer.size());
 	}
 
+	int KCP::Receive(packet_buffer &buffer)
+	{
+		std::scoped_lock locker{ mtx };
+		return ReceiveMessage(buffer);
+	}
+
+	std::vector<received_message> KCP::ReceiveAll()
+	{
+		std::vector<received_message> messages;
+		packet_buffer buffer;
+		std::scoped_lock locker{ mtx };
+		for (int size = ReceiveMessage(buffer); size > 0; size = ReceiveMessage(buffer))
+			messages.push_back({ std::move(buffer), (size_t)size });
+		return messages;
+	}
+
+	int KCP::ReceiveMessage(packet_buffer &buffer)
+	{
+		int size = kcp_ptr->peek_size();
+		if (size <= 0)
+			return size;
+
+		buffer = make_packet_buffer(size);
+		char *output = (char *)buffer.get();
+		return kcp_ptr->receive_fragments([&output](std::span<const char> fragment)
+			{
+				output = std::copy(fragment.begin(), fragment.end(), output);
+			});
+	}
+
 	int KCP::Send(const char *buffer, size_t len)
 	{
 		std::scoped_lock locker{ mtx };
 		return kcp_ptr->send(buffer, (int)len);
 	}
 
+	int KCP::Send(std::span<const std::span<const char>> buffers)
+	{
+		std::scoped_lock locker{ mtx };
+		return kcp_ptr->send(buffers);
+	}
+
+	int KCP::Send(packet_buffer data, const char *send_ptr, size_t len)
+	{
+		auto owner = std::make_unique<packet_buffer_owner>();
+		owner->buffer = std::move(data);
+		std::scoped_lock locker{ mtx };
+		return kcp_ptr->send(std::move(owner), send_ptr, (int)len);
+	}
+
 	void KCP::Update(uint32_t current)
 	{
 		std::unique_lock locker{ mtx };
+		kcp_ptr->set_clock((uint64_t)current * 1000);
 		int ret = kcp_ptr->update(current);
+		bool has_output = TakeOutputRound();
 		locker.unlock();
+		EndOutputRound(has_output);
 		if (ret >= 0)
 			post_update(kcp_ptr->user);
 	}
 
 	void KCP::Update()
 	{
+		uint64_t current_us = MicrosecondsNowForKCP();
 		std::unique_lock locker{ mtx };
-		int ret = kcp_ptr->update(TimeNowForKCP());
+		kcp_ptr->set_clock(current_us);
+		int ret = kcp_ptr->update(TimeForKCP(current_us));
+		bool has_output = TakeOutputRound();
 		locker.unlock();
+		EndOutputRound(has_output);
 		if (ret >= 0)
 			post_update(kcp_ptr->user);
 	}
 
 	uint32_t KCP::UpdateCheck()
 	{
+		return UpdateCheck(MicrosecondsNowForKCP());
+	}
+
+	uint32_t KCP::UpdateCheck(uint64_t current_us)
+	{
+		uint32_t current = TimeForKCP(current_us);
 		std::unique_lock locker{ mtx };
-		int ret = kcp_ptr->update(TimeNowForKCP());
-		uint32_t next_update = kcp_ptr->check(TimeNowForKCP());
+		kcp_ptr->set_clock(current_us);
+		int ret = kcp_ptr->update(current);
+		uint32_t next_update = kcp_ptr->check(current);
+		bool has_output = TakeOutputRound();
 		locker.unlock();
+		EndOutputRound(has_output);
 		if (ret >= 0)
 			post_update(kcp_ptr->user);
 		return next_update;
@@ -166,17 +247,23 @@ namespace KCP
 
 	uint32_t KCP::Refresh()
 	{
+		uint64_t current_us = MicrosecondsNowForKCP();
 		std::unique_lock unique_locker{ mtx };
-		kcp_ptr->flush(TimeNowForKCP());
-		uint32_t ret = kcp_ptr->check(TimeNowForKCP());
+		kcp_ptr->set_clock(current_us);
+		kcp_ptr->flush(TimeForKCP(current_us));
+		uint32_t ret = kcp_ptr->check(TimeForKCP(current_us));
+		bool has_output = TakeOutputRound();
 		unique_locker.unlock();
+		EndOutputRound(has_output);
 		return ret;
 	}
 
 	// when you received a low level packet (eg. UDP packet), call it
 	int KCP::Input(const char *data, long size)
 	{
+		uint64_t current_us = MicrosecondsNowForKCP();
 		std::unique_lock locker{ mtx };
+		kcp_ptr->set_clock(current_us);
 		auto ret = kcp_ptr->input(data, size);
 		locker.unlock();
 		last_input_time = right_now();
@@ -188,9 +275,13 @@ namespace KCP
 	// flush pending data
 	void KCP::Flush()
 	{
+		uint64_t current_us = MicrosecondsNowForKCP();
 		std::unique_lock locker{ mtx };
-		kcp_ptr->flush(TimeNowForKCP());
+		kcp_ptr->set_clock(current_us);
+		kcp_ptr->flush(TimeForKCP(current_us));
+		bool has_output = TakeOutputRound();
 		locker.unlock();
+		EndOutputRound(has_output);
 		post_update(kcp_ptr->user);
 	}
 
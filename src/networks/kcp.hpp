@@ -8,11 +8,13 @@
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <span>
 #include <utility>
 #include <vector>
 #include <deque>
 
 #include "../3rd_party/ikcp.hpp"
+#include "../shares/packet_buffer.hpp"
 
 namespace KCP
 {
@@ -21,7 +23,21 @@ namespace KCP
 	//void proxy_writelog(KCP *kcp, const char *buf);
 	constexpr uint32_t five_minutes_in_ms = 5 * 60 * 1000;
 
+	// Monotonic clock of KCP in microseconds. It does not follow NTP steps or other changes of the wall clock.
+	uint64_t MicrosecondsNowForKCP();
+	// KCP timestamp in milliseconds, taken from the same clock
+	inline uint32_t TimeForKCP(uint64_t time_us) { return static_cast<uint32_t>(time_us / 1000); }
 	uint32_t TimeNowForKCP();
+
+	struct timer_node;
+
+	// a complete message taken from the receive queue
+	struct received_message
+	{
+		packet_buffer data;
+		size_t data_size;
+	};
+	class timer_wheel;
 	//---------------------------------------------------------------------
 	// KCP wrapper
 	//---------------------------------------------------------------------
@@ -29,6 +45,7 @@ namespace KCP
 	{
 		//friend int proxy_output(KCP *kcp, const char *buf, int len);
 		//friend void proxy_writelog(KCP *kcp, const char *buf);
+		friend class timer_wheel;
 	public:
 		//std::atomic<void *> custom_data;
 		std::atomic<int64_t> keep_alive_send_time;
@@ -45,9 +62,17 @@ namespace KCP
 		//std::function<int(const char *, int, void *)> output;	// int(*output)(const char *buf, int len, void *user)
 		//std::function<void(const char *, void *)> writelog;	//void(*writelog)(const char *log, void *user)
 		std::function<void(void *)> post_update;
+		std::function<void(void *)> output_end;
+		bool output_in_round = false;	// written by the output callback, only accessed under mtx
+		timer_node *schedule_node = nullptr;	// entry in the KCPUpdater, only accessed under the lock of its shard
 
 		void Initialise(uint32_t conv);
+		// the caller holds mtx
+		int ReceiveMessage(packet_buffer &buffer);
 		void MoveKCP(KCP &other) noexcept;
+		// the caller holds mtx
+		bool TakeOutputRound() { return std::exchange(output_in_round, false); }
+		void EndOutputRound(bool has_output);
 
 	public:
 		KCP() { Initialise(0); }
@@ -71,16 +96,33 @@ namespace KCP
 
 		// set output callback, which will be invoked by kcp
 		// int(*output)(const char *buf, int len, void *user)
-		void SetOutput(std::function<int(const char *, int, void *)> output_func);
+		// 'output_end_func' is called once after each update or flush that invoked the output callback
+		void SetOutput(std::function<int(const char *, int, void *)> output_func, std::function<void(void *)> output_end_func = nullptr);
 
 		void SetPostUpdate(std::function<void(void *)> post_update_func);
 
 		// user/upper level recv: returns size, returns below zero for EAGAIN
 		int Receive(char *buffer, int len);
 		int Receive(std::vector<char> &buffer);
+		// the next message in a buffer of its own, takes the lock only once
+		int Receive(packet_buffer &buffer);
+		// all complete messages, in order
+		std::vector<received_message> ReceiveAll();
+		// calls 'visitor' with each fragment of the next message as a std::span<const char>
+		// the lock of this session is held during the calls, 'visitor' must not use this KCP
+		template<typename Visitor>
+		int ReceiveFragments(Visitor &&visitor)
+		{
+			std::scoped_lock locker{ mtx };
+			return kcp_ptr->receive_fragments(std::forward<Visitor>(visitor));
+		}
 
 		// user/upper level send, returns below zero for error
 		int Send(const char *buffer, size_t len);
+		// the buffers are sent as one message
+		int Send(std::span<const std::span<const char>> buffers);
+		// takes 'data' instead of copying 'send_ptr', which points into it; 'data' is freed once all segments are acknowledged
+		int Send(packet_buffer data, const char *send_ptr, size_t len);
 
 		// update state (call it repeatedly, every 10ms-100ms), or you can ask 
 		// Check when to call it again (without Input/_send calling).
@@ -88,6 +130,8 @@ namespace KCP
 		void Update(uint32_t current);
 		void Update();
 		uint32_t UpdateCheck();
+		// Update() & Check() with a time shared by a batch of KCP, read from MicrosecondsNowForKCP()
+		uint32_t UpdateCheck(uint64_t current_us);
 
 		// Determine when should you invoke Update:
 		// returns when you should invoke Update in millisec, if there 
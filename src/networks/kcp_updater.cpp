@@ -1,51 +1,262 @@
-#include <list>
-#include <set>
+#include <limits>
+#include <tuple>
 #include "kcp_updater.hpp"
 
 
-template <typename L, typename R>
-inline bool weak_ptr_equals(const std::weak_ptr<L> &l_ptr, const std::weak_ptr<R> &r_ptr)
-{
-	return !l_ptr.owner_before(r_ptr) && !r_ptr.owner_before(l_ptr);
-}
-
 namespace KCP
 {
+	timer_wheel::timer_wheel() : slots{}, level_sizes{}, expired_list(nullptr), current_tick(TimeNowForKCP()), node_count(0) {}
+
+	timer_wheel::~timer_wheel()
+	{
+		for (std::array<timer_node *, slot_count> &level_slots : slots)
+		{
+			for (timer_node *list_head : level_slots)
+				delete_list(list_head);
+		}
+		delete_list(expired_list);
+	}
+
+	void timer_wheel::schedule(const std::shared_ptr<KCP> &kcp_ptr, uint32_t expire_time)
+	{
+		if (node_count == 0)
+			current_tick = TimeNowForKCP();
+
+		timer_node *node = kcp_ptr->schedule_node;
+		if (node == nullptr)
+		{
+			node = new timer_node{ .kcp = kcp_ptr };
+			kcp_ptr->schedule_node = node;
+			++node_count;
+		}
+
+		if (node->list_head != nullptr)
+		{
+			if ((int32_t)(expire_time - node->expire_time) >= 0)
+				return;
+			unlink(node);
+		}
+		node->expire_time = expire_time;
+		place(node);
+	}
+
+	void timer_wheel::cancel(KCP *kcp_ptr)
+	{
+		timer_node *node = kcp_ptr->schedule_node;
+		if (node == nullptr)
+			return;
+		kcp_ptr->schedule_node = nullptr;
+
+		if (node->list_head != nullptr)
+			unlink(node);
+		--node_count;
+
+		if (node->in_flight)
+			node->cancelled = true;
+		else
+			delete node;
+	}
+
+	void timer_wheel::finish(timer_node *node, KCP *kcp_ptr, uint32_t expire_time)
+	{
+		node->in_flight = false;
+		if (node->cancelled)
+		{
+			delete node;
+			return;
+		}
+
+		if (kcp_ptr == nullptr)
+		{
+			delete node;
+			--node_count;
+			return;
+		}
+
+		if (node->list_head != nullptr)
+		{
+			// Scheduled again by someone else while being updated
+			if ((int32_t)(expire_time - node->expire_time) >= 0)
+				return;
+			unlink(node);
+		}
+		node->expire_time = expire_time;
+		place(node);
+	}
+
+	void timer_wheel::advance(uint32_t current_time, due_list &due_kcp)
+	{
+		collect(&expired_list, due_kcp);
+
+		while ((int32_t)(current_time - current_tick) > 0)
+		{
+			if (level_sizes[0] == 0)
+			{
+				// Nothing to collect in the lowest level, jump to the end of its round
+				if (level_sizes[1] == 0 && level_sizes[2] == 0 && level_sizes[3] == 0)
+				{
+					current_tick = current_time;
+					break;
+				}
+				uint32_t round_end = current_tick | slot_mask;
+				current_tick = (int32_t)(current_time - round_end) < 0 ? current_time : round_end;
+				if (current_tick == current_time)
+					break;
+			}
+
+			++current_tick;
+			if ((current_tick & slot_mask) == 0)
+			{
+				if ((current_tick & 0xFFFF) == 0)
+				{
+					if ((current_tick & 0xFF'FFFF) == 0)
+						cascade(3);
+					cascade(2);
+				}
+				cascade(1);
+				collect(&expired_list, due_kcp);	// timers that were due exactly now
+			}
+			collect(&slots[0][current_tick & slot_mask], due_kcp);
+		}
+	}
+
+	uint32_t timer_wheel::next_expire_time() const
+	{
+		if (expired_list != nullptr)
+			return current_tick;
+		if (level_sizes[0] + level_sizes[1] + level_sizes[2] + level_sizes[3] == 0)
+			return std::numeric_limits<uint32_t>::max();
+
+		if (level_sizes[0] > 0)
+		{
+			for (uint32_t slot = (current_tick & slot_mask) + 1; slot < slot_count; ++slot)
+			{
+				if (slots[0][slot] != nullptr)
+					return (current_tick & ~slot_mask) | slot;
+			}
+		}
+		return (current_tick | slot_mask) + 1;
+	}
+
+	void timer_wheel::place(timer_node *node)
+	{
+		uint32_t expire_time = node->expire_time;
+		if ((int32_t)(expire_time - current_tick) <= 0)
+		{
+			link(node, &expired_list, level_count);
+			return;
+		}
+
+		// The highest byte that differs from the current time decides the level, so times after a wrap-around still land in order
+		uint32_t difference = expire_time ^ current_tick;
+		uint32_t level = 0;
+		while (level + 1 < level_count && (difference >> (slot_bits * (level + 1))) != 0)
+			++level;
+		uint32_t slot = (expire_time >> (slot_bits * level)) & slot_mask;
+		link(node, &slots[level][slot], level);
+	}
+
+	void timer_wheel::link(timer_node *node, timer_node **list_head, uint32_t level)
+	{
+		node->prev = nullptr;
+		node->next = *list_head;
+		if (*list_head != nullptr)
+			(*list_head)->prev = node;
+		*list_head = node;
+		node->list_head = list_head;
+		node->level = level;
+		++level_sizes[level];
+	}
+
+	void timer_wheel::unlink(timer_node *node)
+	{
+		if (node->prev != nullptr)
+			node->prev->next = node->next;
+		else
+			*node->list_head = node->next;
+		if (node->next != nullptr)
+			node->next->prev = node->prev;
+		node->prev = nullptr;
+		node->next = nullptr;
+		node->list_head = nullptr;
+		--level_sizes[node->level];
+	}
+
+	void timer_wheel::cascade(uint32_t level)
+	{
+		timer_node **list_head = &slots[level][(current_tick >> (slot_bits * level)) & slot_mask];
+		while (*list_head != nullptr)
+		{
+			timer_node *node = *list_head;
+			unlink(node);
+			place(node);
+		}
+	}
+
+	void timer_wheel::collect(timer_node **list_head, due_list &due_kcp)
+	{
+		while (*list_head != nullptr)
+		{
+			timer_node *node = *list_head;
+			unlink(node);
+			node->in_flight = true;
+			due_kcp.emplace_back(node, node->kcp);
+		}
+	}
+
+	void timer_wheel::delete_list(timer_node *list_head)
+	{
+		while (list_head != nullptr)
+		{
+			timer_node *node = list_head;
+			list_head = node->next;
+			if (std::shared_ptr<KCP> kcp_ptr = node->kcp.lock(); kcp_ptr != nullptr)
+				kcp_ptr->schedule_node = nullptr;
+			delete node;
+		}
+	}
+
 	size_t KCPUpdater::get_kcp_count() const
 	{
 		size_t count = 0;
-		std::scoped_lock tasks_lock(kcp_tasks_mutex);
-		for (auto &[update_time, kcp_ptr_list] : kcp_time_list)
+		for (const std::unique_ptr<updater_shard> &shard : shards)
 		{
-			count += kcp_ptr_list.size();
+			std::scoped_lock tasks_lock(shard->kcp_tasks_mutex);
+			count += shard->kcp_time_wheel.size();
 		}
 		return count;
 	}
 
 	void KCPUpdater::submit(std::weak_ptr<KCP> kcp_ptr, uint32_t next_update_time)
 	{
-		std::unique_lock tasks_lock(kcp_tasks_mutex);
-		kcp_time_list[next_update_time].insert(kcp_ptr);
+		std::shared_ptr<KCP> kcp_locked = kcp_ptr.lock();
+		if (kcp_locked == nullptr)
+			return;
+
+		updater_shard &shard = shard_of(*kcp_locked);
+		std::unique_lock tasks_lock(shard.kcp_tasks_mutex);
+		shard.kcp_time_wheel.schedule(kcp_locked, next_update_time);
+		shard.kcp_tasks_total.store(shard.kcp_time_wheel.size());
+		bool wake_worker = shard.nearest_update_time.load() >= next_update_time;
+		if (wake_worker)
+			shard.wake_pending.store(true);
 		tasks_lock.unlock();
-		++kcp_tasks_total;
 
-		if (nearest_update_time.load() >= next_update_time)
-			kcp_tasks_available_cv.notify_one();
+		// A spinning worker sees wake_pending by itself
+		if (wake_worker && !shard.spinning.load())
+			shard.kcp_tasks_available_cv.notify_one();
 	}
 
 	void KCPUpdater::remove(std::weak_ptr<KCP> kcp_ptr)
 	{
-		std::scoped_lock tasks_lock(kcp_tasks_mutex);
-		for (auto &[update_time, kcp_ptr_list] : kcp_time_list)
-		{
-			for (auto iter = kcp_ptr_list.begin(), next = iter; iter != kcp_ptr_list.end(); iter = next)
-			{
-				++next;
-				if (weak_ptr_equals(kcp_ptr, *iter))
-					kcp_ptr_list.erase(iter);
-			}
-		}
-		kcp_tasks_total.store(kcp_time_list.size());
+		std::shared_ptr<KCP> kcp_locked = kcp_ptr.lock();
+		if (kcp_locked == nullptr)
+			return;
+
+		updater_shard &shard = shard_of(*kcp_locked);
+		std::scoped_lock tasks_lock(shard.kcp_tasks_mutex);
+		shard.kcp_time_wheel.cancel(kcp_locked.get());
+		shard.kcp_tasks_total.store(shard.kcp_time_wheel.size());
 	}
 
 	void KCPUpdater::wait_for_tasks()
@@ -53,8 +264,11 @@ namespace KCP
 		if (!waiting)
 		{
 			waiting = true;
-			std::unique_lock<std::mutex> tasks_lock(kcp_tasks_mutex);
-			kcp_tasks_done_cv.wait(tasks_lock, [this] { return (kcp_tasks_total == 0); });
+			for (std::unique_ptr<updater_shard> &shard : shards)
+			{
+				std::unique_lock<std::mutex> tasks_lock(shard->kcp_tasks_mutex);
+				shard->kcp_tasks_done_cv.wait(tasks_lock, [&shard] { return (shard->kcp_tasks_total == 0); });
+			}
 			waiting = false;
 		}
 	}
@@ -62,75 +276,84 @@ namespace KCP
 	void KCPUpdater::destroy_threads()
 	{
 		running = false;
+		for (std::unique_ptr<updater_shard> &shard : shards)
 		{
-			const std::scoped_lock tasks_lock(kcp_tasks_mutex);
-			kcp_tasks_available_cv.notify_all();
+			const std::scoped_lock tasks_lock(shard->kcp_tasks_mutex);
+			shard->kcp_tasks_available_cv.notify_all();
 		}
-		kcp_thread->join();
+		for (std::unique_ptr<updater_shard> &shard : shards)
+			shard->kcp_thread.join();
 	}
 
-	void KCPUpdater::kcp_update_worker()
+	bool KCPUpdater::spin_for_tasks(updater_shard &shard)
 	{
+		bool tasks_due = false;
+		shard.spinning.store(true);
+		auto spin_end = std::chrono::steady_clock::now() + busy_poll;
+		while (running)
+		{
+			if (shard.wake_pending.load() ||
+				(int64_t)(shard.nearest_update_time.load()) - (int64_t)TimeNowForKCP() <= 0)
+			{
+				tasks_due = true;
+				break;
+			}
+			if (std::chrono::steady_clock::now() >= spin_end)
+				break;
+			std::this_thread::yield();
+		}
+		// The wait in kcp_update_worker() checks wake_pending under the lock, so a submit() that skipped the notify is not lost
+		shard.spinning.store(false);
+		return tasks_due;
+	}
+
+	void KCPUpdater::kcp_update_worker(updater_shard &shard)
+	{
+		timer_wheel::due_list due_kcp;
+		std::vector<std::tuple<timer_node *, std::shared_ptr<KCP>, uint32_t>> updated_kcp;
+
 		while (running)
 		{
 			uint32_t kcp_refresh_time = TimeNowForKCP();
-			int64_t wait_time = (int64_t)(nearest_update_time.load()) - ((int64_t)kcp_refresh_time);
+			int64_t wait_time = (int64_t)(shard.nearest_update_time.load()) - ((int64_t)kcp_refresh_time);
 			if (wait_time <= 0)
 				wait_time = 1;
 
-			thread_local std::set<std::weak_ptr<KCP>, std::owner_less<>> kcp_tasks;
+			bool tasks_due = busy_poll.count() > 0 && spin_for_tasks(shard);
+
+			std::unique_lock tasks_lock(shard.kcp_tasks_mutex);
+			if (!tasks_due)
+				shard.kcp_tasks_available_cv.wait_for(tasks_lock, std::chrono::milliseconds{wait_time}, [this, &shard] { return shard.wake_pending.load() || !running; });
+			shard.wake_pending.store(false);
+			if (!running)
+				break;
+
+			// One clock reading for the whole batch
+			uint64_t batch_time_us = MicrosecondsNowForKCP();
+			shard.kcp_time_wheel.advance(TimeForKCP(batch_time_us), due_kcp);
+			tasks_lock.unlock();
+
+			for (auto &[node, kcp_weak_ptr] : due_kcp)
 			{
-				std::unique_lock tasks_lock(kcp_tasks_mutex);
-				kcp_tasks_available_cv.wait_for(tasks_lock, std::chrono::milliseconds{wait_time});
-				if (running)
-				{
-					for (auto iter = kcp_time_list.begin(), next_iter = iter; iter != kcp_time_list.end(); iter = next_iter)
-					{
-						++next_iter;
-						uint32_t refresh_time_label = iter->first;
-						kcp_refresh_time = TimeNowForKCP();
-						if (refresh_time_label > kcp_refresh_time)
-							break;
-
-						kcp_tasks.insert(iter->second.begin(), iter->second.end());
-						kcp_time_list.erase(iter);
-					}
-
-					tasks_lock.unlock();
-
-					std::map<uint32_t, std::list<std::weak_ptr<KCP>>> temp_list;
-					for (std::weak_ptr<KCP> kcp_weak_ptr : kcp_tasks)
-					{
-						std::shared_ptr<KCP> kcp_ptr = kcp_weak_ptr.lock();
-						if (kcp_ptr == nullptr)
-							continue;
-
-						uint32_t kcp_update_time = kcp_ptr->UpdateCheck();
-						temp_list[kcp_update_time].push_back(kcp_weak_ptr);
-					}
-					kcp_tasks.clear();
-
-					tasks_lock.lock();
-
-					if (!temp_list.empty())
-					{
-						for (auto &[update_time, kcp_ptr_list] : temp_list)
-						{
-							kcp_time_list[update_time].insert(kcp_ptr_list.begin(), kcp_ptr_list.end());
-						}
-					}
-
-					kcp_tasks_total.store(kcp_time_list.size());
-
-					if (kcp_time_list.empty())
-						nearest_update_time.store(std::numeric_limits<uint32_t>::max());
-					else
-						nearest_update_time.store(kcp_time_list.begin()->first);
-
-					if (waiting)
-						kcp_tasks_done_cv.notify_one();
-				}
+				std::shared_ptr<KCP> kcp_ptr = kcp_weak_ptr.lock();
+				uint32_t update_time = kcp_ptr == nullptr ? 0 : kcp_ptr->UpdateCheck(batch_time_us);
+				updated_kcp.emplace_back(node, std::move(kcp_ptr), update_time);
 			}
+			due_kcp.clear();
+
+			tasks_lock.lock();
+			for (auto &[node, kcp_ptr, update_time] : updated_kcp)
+				shard.kcp_time_wheel.finish(node, kcp_ptr.get(), update_time);
+
+			shard.kcp_tasks_total.store(shard.kcp_time_wheel.size());
+			shard.nearest_update_time.store(shard.kcp_time_wheel.next_expire_time());
+
+			if (waiting)
+				shard.kcp_tasks_done_cv.notify_one();
+			tasks_lock.unlock();
+
+			// Sessions whose last owner was this update are destroyed outside the lock
+			updated_kcp.clear();
 		}
 	}
-}
\ No newline at end of file
+}
@@ -4,8 +4,10 @@
 #include <exception>          // std::current_exception
 #include <memory>             // std::make_shared, std::make_unique, std::shared_ptr, std::unique_ptr
 #include <mutex>              // std::mutex, std::scoped_lock, std::unique_lock
-#include <map>
+#include <array>
+#include <chrono>
 #include <thread>             // std::thread
+#include <vector>
 #include <type_traits>        // std::common_type_t, std::decay_t, std::invoke_result_t, std::is_void_v
 #include <utility>            // std::forward, std::move, std::swap
 #include <numeric>
@@ -18,23 +20,105 @@ namespace KCP
 {
 	using concurrency_t = std::invoke_result_t<decltype(std::thread::hardware_concurrency)>;
 
-	class [[nodiscard]] KCPUpdater
+	/**
+	* @brief Schedule entry of one KCP. It is owned by the timer_wheel; the KCP only keeps a pointer to it, so it never has to be searched for.
+	*/
+	struct timer_node
+	{
+		std::weak_ptr<KCP> kcp;
+		uint32_t expire_time = 0;
+		uint32_t level = 0;
+		timer_node *prev = nullptr;
+		timer_node *next = nullptr;
+		timer_node **list_head = nullptr;	// nullptr if not linked into any slot
+		bool in_flight = false;	// collected by advance() and being updated without the lock
+		bool cancelled = false;	// removed while in flight, deleted when the update finishes
+	};
+
+	/**
+	* @brief Hierarchical timing wheel of KCP update times, in KCP milliseconds.
+	* Four levels of 256 slots cover the whole 32-bit time range. Scheduling, rescheduling and cancelling are constant-time;
+	* a timer in a higher level is moved down when the current time reaches its slot. Not thread-safe, the owner locks it.
+	*/
+	class timer_wheel
 	{
-		using task_queue = std::list<std::pair<std::weak_ptr<KCP>, std::weak_ptr<std::atomic<uint32_t>>>>;
+	public:
+		using due_list = std::vector<std::pair<timer_node *, std::weak_ptr<KCP>>>;
+
+		timer_wheel();
+		timer_wheel(const timer_wheel &) = delete;
+		timer_wheel& operator=(const timer_wheel &) = delete;
+		~timer_wheel();
+
+		/**
+		* @brief Schedule a KCP. If it is already scheduled, the earlier of both times is kept.
+		*/
+		void schedule(const std::shared_ptr<KCP> &kcp_ptr, uint32_t expire_time);
+
+		/**
+		* @brief Remove a KCP from the wheel.
+		*/
+		void cancel(KCP *kcp_ptr);
+
+		/**
+		* @brief Move the wheel forward to @p current_time and collect every timer that is due. Every collected node must be given back with finish().
+		*/
+		void advance(uint32_t current_time, due_list &due_kcp);
+
+		/**
+		* @brief Give back a node collected by advance(). It is scheduled again at @p expire_time, or deleted if the KCP is gone (@p kcp_ptr is nullptr) or has been removed.
+		*/
+		void finish(timer_node *node, KCP *kcp_ptr, uint32_t expire_time);
+
+		/**
+		* @brief The time the owner should call advance() again: the earliest timer in the lowest level or the next time a higher level moves down.
+		*/
+		[[nodiscard]]
+		uint32_t next_expire_time() const;
+
+		/**
+		* @brief Number of scheduled KCP sessions, including those being updated.
+		*/
+		[[nodiscard]]
+		size_t size() const { return node_count; }
+
+	private:
+		static constexpr uint32_t level_count = 4;
+		static constexpr uint32_t slot_bits = 8;
+		static constexpr uint32_t slot_count = 1u << slot_bits;
+		static constexpr uint32_t slot_mask = slot_count - 1;
+
+		void place(timer_node *node);
+		void link(timer_node *node, timer_node **list_head, uint32_t level);
+		void unlink(timer_node *node);
+		void cascade(uint32_t level);
+		void collect(timer_node **list_head, due_list &due_kcp);
+		void delete_list(timer_node *list_head);
+
+		std::array<std::array<timer_node *, slot_count>, level_count> slots;
+		std::array<size_t, level_count + 1> level_sizes;
+		timer_node *expired_list;	// scheduled at or before current_tick, due on the next advance()
+		uint32_t current_tick;	// every slot up to and including this time has been collected
+		size_t node_count;
+	};
 
+	class [[nodiscard]] KCPUpdater
+	{
 	public:
 		// ============================
 		// Constructors and destructors
 		// ============================
 
 		/**
-		* @brief Construct a new thread pool.
+		* @brief Construct a new KCP updater.
 		*
-		* @param thread_count_ The number of threads to use. The default value is the total number of hardware threads available, as reported by the implementation. This is usually determined by the number of cores in the CPU. If a core is hyperthreaded, it will count as two threads.
+		* @param thread_count_ The number of update threads. Each thread owns a shard with its own timing wheel, and every KCP is updated by the shard selected by its conv.
+		* @param busy_poll_ How long an update thread spins before it sleeps. Zero means it sleeps straight away.
 		*/
-		KCPUpdater() : kcp_thread(std::make_unique<std::thread>())
+		explicit KCPUpdater(const concurrency_t thread_count_ = 1, std::chrono::microseconds busy_poll_ = {}) :
+			thread_count(thread_count_ > 0 ? thread_count_ : 1), busy_poll(busy_poll_)
 		{
-			create_thread();
+			create_threads();
 		}
 
 		KCPUpdater(const KCPUpdater &) = delete;
@@ -56,12 +140,33 @@ namespace KCP
 		[[nodiscard]]
 		size_t get_task_count() const
 		{
-			return kcp_tasks_total.load();
+			size_t total = 0;
+			for (const std::unique_ptr<updater_shard> &shard : shards)
+				total += shard->kcp_tasks_total.load();
+			return total;
 		}
 
 		[[nodiscard]]
 		size_t get_kcp_count() const;
 
+		/**
+		* @brief Get the number of update threads.
+		*/
+		[[nodiscard]]
+		concurrency_t get_thread_count() const
+		{
+			return thread_count;
+		}
+
+		/**
+		* @brief Get the native handle of an update thread, e.g. to set its CPU affinity.
+		*/
+		[[nodiscard]]
+		std::thread::native_handle_type get_native_handle(concurrency_t thread_number = 0)
+		{
+			return shards[thread_number]->kcp_thread.native_handle();
+		}
+
 		void submit(std::weak_ptr<KCP> kcp_ptr, uint32_t next_update_time);
 
 		void remove(std::weak_ptr<KCP> kcp_ptr);
@@ -72,17 +177,33 @@ namespace KCP
 		void wait_for_tasks();
 
 	private:
+		struct updater_shard
+		{
+			std::condition_variable kcp_tasks_available_cv = {};
+			std::condition_variable kcp_tasks_done_cv = {};
+			timer_wheel kcp_time_wheel;
+			std::atomic<size_t> kcp_tasks_total = 0;
+			mutable std::mutex kcp_tasks_mutex = {};
+			std::thread kcp_thread;
+			std::atomic<uint32_t> nearest_update_time{ std::numeric_limits<uint32_t>::max() };
+			std::atomic<bool> wake_pending = false;	// a nearer KCP has been submitted since the last round
+			std::atomic<bool> spinning = false;
+		};
+
 		// ========================
 		// Private member functions
 		// ========================
 
 		/**
-		* @brief Create the threads in the pool and assign a worker to each thread.
+		* @brief Create the shards and start one update thread for each of them.
 		*/
-		void create_thread()
+		void create_threads()
 		{
 			running = true;
-			*kcp_thread = std::thread(&KCPUpdater::kcp_update_worker, this);
+			for (concurrency_t i = 0; i < thread_count; ++i)
+				shards.emplace_back(std::make_unique<updater_shard>());
+			for (std::unique_ptr<updater_shard> &shard : shards)
+				shard->kcp_thread = std::thread(&KCPUpdater::kcp_update_worker, this, std::ref(*shard));
 		}
 
 		/**
@@ -91,26 +212,36 @@ namespace KCP
 		void destroy_threads();
 
 		/**
-		* @brief A worker function to be assigned to each thread in the pool. Waits until it is notified by push_task() that a task is available, and then retrieves the task from the queue and executes it. Once the task finishes, the worker notifies wait_for_tasks() in case it is waiting.
+		* @brief Select the shard of a KCP by its conv, so a session always stays on the same thread.
+		*/
+		[[nodiscard]]
+		updater_shard& shard_of(KCP &kcp) const
+		{
+			uint64_t conv_hash = (uint64_t)kcp.GetConv() * 0x9E3779B97F4A7C15ull;
+			return *shards[(size_t)((conv_hash >> 32) % thread_count)];
+		}
+
+		/**
+		* @brief The worker of one shard. Sleeps until the earliest timer of its wheel is due or a nearer one is submitted, then updates every due KCP and schedules it again.
 		*/
-		void kcp_update_worker();
+		void kcp_update_worker(updater_shard &shard);
+
+		/**
+		* @brief Spin for up to busy_poll before the worker sleeps, so a wake-up does not have to go through the scheduler.
+		*
+		* @return true if a KCP became due or a nearer one was submitted while spinning.
+		*/
+		bool spin_for_tasks(updater_shard &shard);
 
 		// ============
 		// Private data
 		// ============
 
-		std::condition_variable kcp_tasks_available_cv = {};
-		std::condition_variable kcp_tasks_done_cv = {};
-		//std::map<std::weak_ptr<KCP>, uint32_t, std::owner_less<>> pile_of_kcp = {};	// uint32_t is for storing next update time
-		std::map<uint32_t, std::set<std::weak_ptr<KCP>, std::owner_less<>>> kcp_time_list;
-		std::set<std::weak_ptr<KCP>, std::owner_less<>> expired_kcp;
-		std::atomic<size_t> kcp_tasks_total = 0;
-		mutable std::mutex kcp_tasks_mutex = {};
-		std::unique_ptr<std::thread> kcp_thread = nullptr;
+		const concurrency_t thread_count;
+		const std::chrono::microseconds busy_poll;
+		std::vector<std::unique_ptr<updater_shard>> shards;
 		std::atomic<bool> running = false;
 		std::atomic<bool> waiting = false;
-
-		std::atomic<uint32_t> nearest_update_time{std::numeric_limits<uint32_t>::max()};
 	};
 
 }
@@ -33,7 +33,7 @@ void mux_tunnel::tcp_accept_new_income(std::shared_ptr<tcp_session> incoming_ses
 
 	std::weak_ptr<KCP::KCP> kcp_ptr_weak = kcp_ptr;
 	std::weak_ptr<mux_records> mux_records_ptr_weak = mux_records_ptr;
-	bool replaced = incoming_session->replace_callback([this, kcp_ptr_weak, mux_records_ptr_weak](std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session) mutable
+	bool replaced = incoming_session->replace_callback([this, kcp_ptr_weak, mux_records_ptr_weak](packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session) mutable
 		{
 			read_tcp_data_to_cache(std::move(data), data_size, incoming_session, kcp_ptr_weak, mux_records_ptr_weak);
 		});
@@ -48,7 +48,7 @@ void mux_tunnel::tcp_accept_new_income(std::shared_ptr<tcp_session> incoming_ses
 	if (current_settings.ignore_listen_address || current_settings.ignore_listen_port)
 	{
 		auto data = packet::mux_tell_server_connect_address(protocol_type::tcp, new_id, remote_output_address, remote_output_port);
-		std::unique_ptr<uint8_t[]> data_sptr = std::make_unique<uint8_t[]>(data.size());
+		packet_buffer data_sptr = std::make_unique<uint8_t[]>(data.size());
 		uint8_t *data_ptr = data_sptr.get();
 		std::copy(data.begin(), data.end(), data_ptr);
 		mux_data_cache data_cache = { std::move(data_sptr), data_ptr, data.size() };
@@ -64,7 +64,7 @@ void mux_tunnel::tcp_accept_new_income(std::shared_ptr<tcp_session> incoming_ses
 	incoming_session->async_read_data();
 }
 
-void mux_tunnel::read_tcp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_ptr_weak, std::weak_ptr<mux_records> mux_records_weak)
+void mux_tunnel::read_tcp_data_to_cache(packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_ptr_weak, std::weak_ptr<mux_records> mux_records_weak)
 {
 	move_cached_data_to_tunnel(true);
 
@@ -113,7 +113,7 @@ void mux_tunnel::read_tcp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t
 	tcp_recv_traffic += data_size;
 }
 
-void mux_tunnel::client_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port)
+void mux_tunnel::client_udp_data_to_cache(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port)
 {
 	move_cached_data_to_tunnel();
 
@@ -154,7 +154,7 @@ void mux_tunnel::client_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_
 				if (current_settings.ignore_listen_address || current_settings.ignore_listen_port)
 				{
 					auto data = packet::mux_tell_server_connect_address(protocol_type::udp, new_id, remote_output_address, remote_output_port);
-					std::unique_ptr<uint8_t[]> data_sptr = std::make_unique<uint8_t[]>(data.size());
+					packet_buffer data_sptr = std::make_unique<uint8_t[]>(data.size());
 					uint8_t *data_ptr = data_sptr.get();
 					std::copy(data.begin(), data.end(), data_ptr);
 					mux_data_cache data_cache = { std::move(data_sptr), data_ptr, data.size() };
@@ -209,7 +209,7 @@ void mux_tunnel::client_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_
 	udp_recv_traffic += data_size;
 }
 
-void mux_tunnel::server_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak, std::weak_ptr<mux_records> mux_records_weak)
+void mux_tunnel::server_udp_data_to_cache(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak, std::weak_ptr<mux_records> mux_records_weak)
 {
 	move_cached_data_to_tunnel();
 
@@ -227,7 +227,7 @@ void mux_tunnel::server_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_
 	read_udp_data_to_cache(std::move(data), data_size, mux_records_ptr.get(), kcp_session_weak);
 }
 
-void mux_tunnel::transfer_data(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size)
+void mux_tunnel::transfer_data(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, packet_buffer buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size)
 {
 	auto [mux_connection_id, mux_data, mux_data_size] = packet::extract_mux_data_from_unpacked_data(unbacked_data_ptr, unbacked_data_size);
 	std::shared_ptr<KCP::KCP> &kcp_ptr = current_settings.mode == running_mode::server ? kcp_mappings_ptr->ingress_kcp : kcp_mappings_ptr->egress_kcp;
@@ -368,7 +368,7 @@ void mux_tunnel::delete_channel(protocol_type prtcl, kcp_mappings *kcp_mappings_
 	}
 }
 
-void mux_tunnel::pre_connect_custom_address(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size)
+void mux_tunnel::pre_connect_custom_address(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, packet_buffer buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size)
 {
 	auto [mux_connection_id, user_input_port, user_input_ip] = packet::extract_mux_pre_connect_from_unpacked_data(unbacked_data_ptr, unbacked_data_size);
 	uint64_t complete_connection_id = ((uint64_t)kcp_mappings_ptr->ingress_kcp->GetConv() << 32) + mux_connection_id;
@@ -434,7 +434,8 @@ void mux_tunnel::setup_mux_kcp(std::shared_ptr<KCP::KCP> kcp_ptr)
 {
 	if (current_settings.mode == running_mode::server)
 	{
-		kcp_ptr->SetOutput([this](const char *buf, int len, void *user) -> int { return server_ptr->kcp_sender(buf, len, user); });
+		kcp_ptr->SetOutput([this](const char *buf, int len, void *user) -> int { return server_ptr->kcp_sender(buf, len, user); },
+			[this](void *user) { server_ptr->kcp_sender_flush(user); });
 		kcp_ptr->SetPostUpdate([this](void *user)
 			{
 				if (user == nullptr) return;
@@ -446,7 +447,8 @@ void mux_tunnel::setup_mux_kcp(std::shared_ptr<KCP::KCP> kcp_ptr)
 
 	if (current_settings.mode == running_mode::client)
 	{
-		kcp_ptr->SetOutput([this](const char *buf, int len, void *user) -> int { return client_ptr->kcp_sender(buf, len, user); });
+		kcp_ptr->SetOutput([this](const char *buf, int len, void *user) -> int { return client_ptr->kcp_sender(buf, len, user); },
+			[this](void *user) { client_ptr->kcp_sender_flush(user); });
 		kcp_ptr->SetPostUpdate([this](void *user)
 			{
 				if (user == nullptr) return;
@@ -517,7 +519,7 @@ void mux_tunnel::move_cached_data_to_tunnel(std::map<std::weak_ptr<KCP::KCP>, st
 		for (size_t i = 0; i < pickup_size; i++)
 		{
 			mux_data_cache cached_data = std::move(data_cache.front());
-			kcp_ptr->Send((const char *)cached_data.sending_ptr, cached_data.data_size);
+			kcp_ptr->Send(std::move(cached_data.data), (const char *)cached_data.sending_ptr, cached_data.data_size);
 			data_cache.pop_front();
 		}
 
@@ -737,7 +739,7 @@ void mux_tunnel::send_cancel_packet(protocol_type prtcl, uint32_t mux_connection
 	kcp_updater.submit(kcp_ptr, next_update_time);
 }
 
-void mux_tunnel::read_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, mux_records *mux_records_ptr, std::weak_ptr<KCP::KCP> kcp_ptr)
+void mux_tunnel::read_udp_data_to_cache(packet_buffer data, size_t data_size, mux_records *mux_records_ptr, std::weak_ptr<KCP::KCP> kcp_ptr)
 {
 	std::shared_lock udp_cache_shared_locker{ mutex_mux_udp_cache };
 	auto cache_iter = mux_udp_cache.find(kcp_ptr);
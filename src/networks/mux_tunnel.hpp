@@ -47,13 +47,13 @@ struct mux_tunnel
 	// client only
 	void tcp_accept_new_income(std::shared_ptr<tcp_session> incoming_session, const std::string &remote_output_address, asio::ip::port_type remote_output_port);
 	// client and server
-	void read_tcp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_session_weak, std::weak_ptr<mux_records> kcp_ptr_weak);
-	void client_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port);
-	void server_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak, std::weak_ptr<mux_records> mux_records_weak);
+	void read_tcp_data_to_cache(packet_buffer data, size_t data_size, std::shared_ptr<tcp_session> incoming_session, std::weak_ptr<KCP::KCP> kcp_session_weak, std::weak_ptr<mux_records> kcp_ptr_weak);
+	void client_udp_data_to_cache(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, const std::string &remote_output_address, asio::ip::port_type remote_output_port);
+	void server_udp_data_to_cache(packet_buffer data, size_t data_size, udp::endpoint peer, asio::ip::port_type port_number, std::weak_ptr<KCP::KCP> kcp_session_weak, std::weak_ptr<mux_records> mux_records_weak);
 
-	void transfer_data(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size);
+	void transfer_data(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, packet_buffer buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size);
 	void delete_channel(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, uint8_t *unbacked_data_ptr, size_t unbacked_data_size);
-	void pre_connect_custom_address(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, std::unique_ptr<uint8_t[]> buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size);	// server only
+	void pre_connect_custom_address(protocol_type prtcl, kcp_mappings *kcp_mappings_ptr, packet_buffer buffer_cache, uint8_t *unbacked_data_ptr, size_t unbacked_data_size);	// server only
 
 	void setup_mux_kcp(std::shared_ptr<KCP::KCP> kcp_ptr);
 	void move_cached_data_to_tunnel(bool skip_kcp_update = false);
@@ -66,7 +66,7 @@ struct mux_tunnel
 
 private:
 	void send_cancel_packet(protocol_type prtcl, uint32_t mux_connection_id, std::shared_ptr<KCP::KCP> kcp_ptr);
-	void read_udp_data_to_cache(std::unique_ptr<uint8_t[]> data, size_t data_size, mux_records *mux_records_ptr, std::weak_ptr<KCP::KCP> kcp_ptr);
+	void read_udp_data_to_cache(packet_buffer data, size_t data_size, mux_records *mux_records_ptr, std::weak_ptr<KCP::KCP> kcp_ptr);
 
 	KCP::KCPUpdater &kcp_updater;
 	user_settings &current_settings;
@@ -395,6 +395,65 @@ std::vector<std::string> parse_the_rest(const std::vector<std::string> &args, us
 				break;
 			}
 
+			case strhash("io_threads"):
+				if (auto thread_count = std::stoi(value); thread_count <= 0)
+					current_settings->io_threads = 0;
+				else if (thread_count < USHRT_MAX)
+					current_settings->io_threads = static_cast<uint16_t>(thread_count);
+				else
+					current_settings->io_threads = USHRT_MAX;
+				break;
+
+			case strhash("local_threads"):
+				if (auto thread_count = std::stoi(value); thread_count <= 0)
+					current_settings->local_threads = 0;
+				else if (thread_count < USHRT_MAX)
+					current_settings->local_threads = static_cast<uint16_t>(thread_count);
+				else
+					current_settings->local_threads = USHRT_MAX;
+				break;
+
+			case strhash("peer_threads"):
+				if (auto thread_count = std::stoi(value); thread_count <= 0)
+					current_settings->peer_threads = 0;
+				else if (thread_count < USHRT_MAX)
+					current_settings->peer_threads = static_cast<uint16_t>(thread_count);
+				else
+					current_settings->peer_threads = USHRT_MAX;
+				break;
+
+			case strhash("sender_threads"):
+				if (auto thread_count = std::stoi(value); thread_count <= 0)
+					current_settings->sender_threads = 0;
+				else if (thread_count < USHRT_MAX)
+					current_settings->sender_threads = static_cast<uint16_t>(thread_count);
+				else
+					current_settings->sender_threads = USHRT_MAX;
+				break;
+
+			case strhash("kcp_updater_threads"):
+				if (auto thread_count = std::stoi(value); thread_count <= 0)
+					current_settings->kcp_updater_threads = 0;
+				else if (thread_count < USHRT_MAX)
+					current_settings->kcp_updater_threads = static_cast<uint16_t>(thread_count);
+				else
+					current_settings->kcp_updater_threads = USHRT_MAX;
+				break;
+
+			case strhash("isolated_pools"):
+			{
+				bool yes = value == "yes" || value == "true" || value == "1";
+				current_settings->isolated_pools = yes;
+				break;
+			}
+
+			case strhash("run_to_completion"):
+			{
+				bool yes = value == "yes" || value == "true" || value == "1";
+				current_settings->run_to_completion = yes;
+				break;
+			}
+
 			case strhash("fec"):
 				if (auto pos = value.find(":"); pos == std::string::npos)
 				{
@@ -452,6 +511,100 @@ std::vector<std::string> parse_the_rest(const std::vector<std::string> &args, us
 				break;
 			}
 
+			case strhash("udp_receive_batch"):
+				if (auto batch_size = std::stoi(value); batch_size <= 0)
+					current_settings->udp_receive_batch = 0;
+				else if (batch_size < USHRT_MAX)
+					current_settings->udp_receive_batch = static_cast<uint16_t>(batch_size);
+				else
+					current_settings->udp_receive_batch = USHRT_MAX;
+				break;
+
+			case strhash("udp_send_batch"):
+				if (auto batch_size = std::stoi(value); batch_size <= 0)
+					current_settings->udp_send_batch = 0;
+				else if (batch_size < USHRT_MAX)
+					current_settings->udp_send_batch = static_cast<uint16_t>(batch_size);
+				else
+					current_settings->udp_send_batch = USHRT_MAX;
+				break;
+
+			case strhash("udp_send_latency"):
+				if (auto latency = std::stoi(value); latency <= 0)
+					current_settings->udp_send_latency = 0;
+				else
+					current_settings->udp_send_latency = static_cast<uint32_t>(latency);
+				break;
+
+			case strhash("busy_poll"):
+				if (auto poll_time = std::stoi(value); poll_time <= 0)
+					current_settings->busy_poll = 0;
+				else
+					current_settings->busy_poll = static_cast<uint32_t>(poll_time);
+				break;
+
+			case strhash("udp_gso"):
+			{
+				bool yes = value == "yes" || value == "true" || value == "1";
+				current_settings->udp_gso = yes;
+				break;
+			}
+
+			case strhash("udp_gro"):
+			{
+				bool yes = value == "yes" || value == "true" || value == "1";
+				current_settings->udp_gro = yes;
+				break;
+			}
+
+			case strhash("udp_listen_shards"):
+				if (auto shard_count = std::stoi(value); shard_count <= 1)
+					current_settings->udp_listen_shards = 0;
+				else if (shard_count < USHRT_MAX)
+					current_settings->udp_listen_shards = static_cast<uint16_t>(shard_count);
+				else
+					current_settings->udp_listen_shards = USHRT_MAX;
+				break;
+
+			case strhash("udp_shard_steering"):
+				current_settings->udp_shard_by_cpu = value == "cpu";
+				break;
+
+			case strhash("cpu_affinity_io"):
+				current_settings->cpu_affinity_io = cpu_list_from_string(value, error_msg);
+				break;
+
+			case strhash("cpu_affinity_kcp_updater"):
+				current_settings->cpu_affinity_kcp_updater = cpu_list_from_string(value, error_msg);
+				break;
+
+			case strhash("cpu_affinity_local"):
+				current_settings->cpu_affinity_local = cpu_list_from_string(value, error_msg);
+				break;
+
+			case strhash("cpu_affinity_peer"):
+				current_settings->cpu_affinity_peer = cpu_list_from_string(value, error_msg);
+				break;
+
+			case strhash("cpu_affinity_sender"):
+				current_settings->cpu_affinity_sender = cpu_list_from_string(value, error_msg);
+				break;
+
+			case strhash("udp_io_backend"):
+				switch (strhash(value.c_str()))
+				{
+				case strhash("asio"):
+					current_settings->udp_io_uring = false;
+					break;
+				case strhash("io_uring"):
+					current_settings->udp_io_uring = true;
+					break;
+				default:
+					error_msg.emplace_back("invalid udp_io_backend: " + value);
+					break;
+				}
+				break;
+
 			case strhash("[listener]"):
 			{
 				if (current_user_settings.mode == running_mode::relay)
@@ -904,6 +1057,33 @@ void copy_settings(user_settings &inner, user_settings &outter)
 
 	if (outter.fib_egress)
 		inner.fib_egress = outter.fib_egress;
+
+	if (outter.udp_receive_batch > 0)
+		inner.udp_receive_batch = outter.udp_receive_batch;
+
+	if (outter.udp_send_batch > 0)
+		inner.udp_send_batch = outter.udp_send_batch;
+
+	if (outter.udp_send_latency > 0)
+		inner.udp_send_latency = outter.udp_send_latency;
+
+	if (outter.udp_gso)
+		inner.udp_gso = outter.udp_gso;
+
+	if (outter.udp_gro)
+		inner.udp_gro = outter.udp_gro;
+
+	if (outter.udp_listen_shards > 0)
+		inner.udp_listen_shards = outter.udp_listen_shards;
+
+	if (outter.udp_shard_by_cpu)
+		inner.udp_shard_by_cpu = outter.udp_shard_by_cpu;
+
+	if (outter.udp_io_uring)
+		inner.udp_io_uring = outter.udp_io_uring;
+
+	if (outter.busy_poll > 0)
+		inner.busy_poll = outter.busy_poll;
 }
 
 void verify_kcp_settings(user_settings &current_user_settings, std::vector<std::string> &error_msg)
@@ -1227,3 +1407,49 @@ uint64_t bandwidth_from_string(const std::string &bandwidth, std::vector<std::st
 
 	return full_bandwidth;
 }
+
+std::vector<uint16_t> cpu_list_from_string(const std::string &cpu_list, std::vector<std::string> &error_msg)
+{
+	// Same format as taskset(1) and cpuset(1): 0-3,8,10-11
+	std::vector<uint16_t> cpu_numbers;
+	std::istringstream iss(cpu_list);
+	std::string each_range;
+	while (std::getline(iss, each_range, ','))
+	{
+		trim(each_range);
+		if (each_range.empty())
+			continue;
+
+		int range_start = -1;
+		int range_end = -1;
+		try
+		{
+			if (auto pos = each_range.find('-'); pos == std::string::npos)
+			{
+				range_start = std::stoi(each_range);
+				range_end = range_start;
+			}
+			else
+			{
+				range_start = std::stoi(each_range.substr(0, pos));
+				range_end = std::stoi(each_range.substr(pos + 1));
+			}
+		}
+		catch (...)
+		{
+		}
+
+		if (range_start < 0 || range_end < range_start || range_end > USHRT_MAX)
+		{
+			error_msg.emplace_back("invalid cpu list: " + cpu_list);
+			return {};
+		}
+
+		for (int i = range_start; i <= range_end; ++i)
+			cpu_numbers.emplace_back((uint16_t)i);
+	}
+
+	std::sort(cpu_numbers.begin(), cpu_numbers.end());
+	cpu_numbers.erase(std::unique(cpu_numbers.begin(), cpu_numbers.end()), cpu_numbers.end());
+	return cpu_numbers;
+}
@@ -14,5 +14,6 @@ void verify_kcp_settings(user_settings &current_user_settings, std::vector<std::
 void verify_server_listen_port(user_settings &current_user_settings, std::vector<std::string> &error_msg);
 void verify_client_destination(user_settings &current_user_settings, std::vector<std::string> &error_msg);
 uint64_t bandwidth_from_string(const std::string &bandwidth, std::vector<std::string> &error_msg);
+std::vector<uint16_t> cpu_list_from_string(const std::string &cpu_list, std::vector<std::string> &error_msg);
 
 #endif
@@ -543,16 +543,16 @@ std::vector<uint8_t> decrypt_data(const std::string &password, encryption_mode m
 	return input_data;
 }
 
-std::pair<std::unique_ptr<uint8_t[]>, size_t> clone_into_pair(const uint8_t *original, size_t data_size)
+std::pair<packet_buffer, size_t> clone_into_pair(const uint8_t *original, size_t data_size)
 {
-	std::pair<std::unique_ptr<uint8_t[]>, size_t> cloned;
+	std::pair<packet_buffer, size_t> cloned;
 	cloned.first = std::make_unique<uint8_t[]>(data_size);
 	cloned.second = data_size;
 	std::copy_n(original, data_size, cloned.first.get());
 	return cloned;
 }
 
-const std::map<size_t, const uint8_t*> mapped_pair_to_mapped_pointer(const std::map<size_t, std::pair<std::unique_ptr<uint8_t[]>, size_t>>& mapped_container)
+const std::map<size_t, const uint8_t*> mapped_pair_to_mapped_pointer(const std::map<size_t, std::pair<packet_buffer, size_t>>& mapped_container)
 {
 	std::map<size_t, const uint8_t*> results;
 
@@ -562,7 +562,7 @@ const std::map<size_t, const uint8_t*> mapped_pair_to_mapped_pointer(const std::
 	return results;
 }
 
-std::tuple<std::unique_ptr<uint8_t[]>, size_t, size_t> compact_into_container(const std::vector<std::pair<std::unique_ptr<uint8_t[]>, size_t>> &fec_snd_data_cache)
+std::tuple<packet_buffer, size_t, size_t> compact_into_container(const std::vector<std::pair<packet_buffer, size_t>> &fec_snd_data_cache)
 {
 	size_t align_length = 0;
 	for (auto &[data_ptr, data_size] : fec_snd_data_cache)
@@ -570,7 +570,7 @@ std::tuple<std::unique_ptr<uint8_t[]>, size_t, size_t> compact_into_container(co
 	align_length += constant_values::fec_container_header;
 
 	size_t total_size = fec_snd_data_cache.size() * align_length;
-	std::unique_ptr<uint8_t[]> final_array = std::make_unique<uint8_t[]>(total_size);
+	packet_buffer final_array = std::make_unique<uint8_t[]>(total_size);
 
 	for (uint16_t i = 0; i < fec_snd_data_cache.size(); ++i)
 	{
@@ -585,11 +585,11 @@ std::tuple<std::unique_ptr<uint8_t[]>, size_t, size_t> compact_into_container(co
 	return { std::move(final_array), align_length, total_size };
 }
 
-std::pair<std::map<size_t, std::pair<std::unique_ptr<uint8_t[]>, size_t>>, size_t>
-compact_into_container(const std::map<uint16_t, std::pair<std::unique_ptr<uint8_t[]>, size_t>> &fec_rcv_data_cache, size_t data_max_count)
+std::pair<std::map<size_t, std::pair<packet_buffer, size_t>>, size_t>
+compact_into_container(const std::map<uint16_t, std::pair<packet_buffer, size_t>> &fec_rcv_data_cache, size_t data_max_count)
 {
 	size_t align_length = 0;
-	std::map<size_t, std::pair<std::unique_ptr<uint8_t[]>, size_t>> final_array;
+	std::map<size_t, std::pair<packet_buffer, size_t>> final_array;
 	for (auto &[i, data] : fec_rcv_data_cache)
 	{
 		size_t data_size = data.second;
@@ -603,7 +603,7 @@ compact_into_container(const std::map<uint16_t, std::pair<std::unique_ptr<uint8_
 	{
 		uint8_t *original_data_ptr = data.first.get();
 		uint16_t data_size = (uint16_t)data.second;
-		std::unique_ptr<uint8_t[]> cache_piece = std::make_unique<uint8_t[]>(align_length);
+		packet_buffer cache_piece = std::make_unique<uint8_t[]>(align_length);
 		if (i < data_max_count)
 		{
 			fec_container *fec_packet = (fec_container *)(cache_piece.get());
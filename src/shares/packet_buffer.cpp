@@ -0,0 +1,217 @@
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "packet_buffer.hpp"
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Blocks are addressed by a 32-bit index, so the shared free list can be a tagged lock-free stack.
+// Each thread keeps a small cache of free blocks and only touches the shared stack when the cache runs empty or full.
+// There is one shared stack for each NUMA node. A slab is first written by the thread that grows it, so its pages
+// land on that thread's node; its blocks always go back to the stack of that node.
+class packet_buffer_pool
+{
+public:
+	static packet_buffer_pool& instance()
+	{
+		// Never destroyed: buffers may still be returned by thread caches during process exit
+		static packet_buffer_pool *pool = new packet_buffer_pool;
+		return *pool;
+	}
+
+	uint8_t* acquire();
+	void release(uint8_t *data);
+
+private:
+	struct block_header
+	{
+		uint32_t index;
+		std::atomic<uint32_t> next;
+	};
+
+	struct thread_cache
+	{
+		std::vector<uint8_t *> blocks;
+		uint32_t node = current_node();
+		~thread_cache()
+		{
+			for (uint8_t *data : blocks)
+				packet_buffer_pool::instance().push_shared(header_of(data)->index);
+		}
+	};
+
+	struct alignas(64) free_stack
+	{
+		std::atomic<uint64_t> head{ empty_index };	// high 32 bits: ABA tag, low 32 bits: block index
+	};
+
+	static constexpr size_t header_size = 16;
+	static constexpr size_t block_stride = header_size + packet_buffer_block_size;
+	static constexpr uint32_t blocks_per_slab = 256;
+	static constexpr uint32_t slabs_max = 16384;
+	static constexpr uint32_t cache_limit = 256;
+	static constexpr uint32_t cache_refill = 32;
+	static constexpr uint32_t empty_index = UINT32_MAX;
+	static constexpr uint32_t nodes_max = 8;
+
+	static_assert(sizeof(block_header) <= header_size);
+
+	packet_buffer_pool() : slab_count(0), slab_nodes{}, slabs{} {}
+
+	// Threads that are not pinned may move to another node later, the node seen when the cache is created is kept
+	static uint32_t current_node()
+	{
+#ifdef __linux__
+		unsigned cpu = 0;
+		unsigned node = 0;
+		if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+			return node % nodes_max;
+#endif
+		return 0;
+	}
+
+	static block_header* header_of(uint8_t *data) { return (block_header *)(data - header_size); }
+	uint8_t* block_of(uint32_t index) { return slabs[index / blocks_per_slab].load(std::memory_order_acquire) + (index % blocks_per_slab) * block_stride; }
+
+	void push_shared(uint32_t index);
+	uint32_t pop_shared(uint32_t node);
+	uint8_t* grow(thread_cache &cache);
+
+	static thread_cache& local_cache()
+	{
+		thread_local thread_cache cache;
+		return cache;
+	}
+
+	std::array<free_stack, nodes_max> shared_stacks;
+	alignas(64) std::atomic<uint32_t> slab_count;
+	std::mutex mutex_grow;
+	std::array<uint8_t, slabs_max> slab_nodes;
+	std::array<std::atomic<uint8_t *>, slabs_max> slabs;
+};
+
+void packet_buffer_pool::push_shared(uint32_t index)
+{
+	block_header *header = (block_header *)block_of(index);
+	std::atomic<uint64_t> &shared_head = shared_stacks[slab_nodes[index / blocks_per_slab]].head;
+	uint64_t head = shared_head.load(std::memory_order_relaxed);
+	uint64_t new_head = 0;
+	do
+	{
+		header->next.store((uint32_t)head, std::memory_order_relaxed);
+		new_head = (((head >> 32) + 1) << 32) | index;
+	} while (!shared_head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+uint32_t packet_buffer_pool::pop_shared(uint32_t node)
+{
+	std::atomic<uint64_t> &shared_head = shared_stacks[node].head;
+	uint64_t head = shared_head.load(std::memory_order_acquire);
+	uint64_t new_head = 0;
+	do
+	{
+		uint32_t index = (uint32_t)head;
+		if (index == empty_index)
+			return empty_index;
+		uint32_t next = ((block_header *)block_of(index))->next.load(std::memory_order_relaxed);
+		new_head = (((head >> 32) + 1) << 32) | next;
+	} while (!shared_head.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire));
+	return (uint32_t)head;
+}
+
+uint8_t* packet_buffer_pool::grow(thread_cache &cache)
+{
+	std::scoped_lock locker{ mutex_grow };
+	uint32_t slab_index = slab_count.load(std::memory_order_relaxed);
+	if (slab_index >= slabs_max)
+		return nullptr;
+
+	uint8_t *slab = new uint8_t[block_stride * blocks_per_slab];
+	for (uint32_t i = 0; i < blocks_per_slab; i++)
+		new (slab + i * block_stride) block_header{ slab_index * blocks_per_slab + i, empty_index };
+	slab_nodes[slab_index] = (uint8_t)cache.node;
+	slabs[slab_index].store(slab, std::memory_order_release);
+	slab_count.store(slab_index + 1, std::memory_order_release);
+
+	// The first block goes to the caller, the rest are handed to the calling thread's cache
+	for (uint32_t i = blocks_per_slab - 1; i > 0; i--)
+	{
+		uint8_t *data = slab + i * block_stride + header_size;
+		if (cache.blocks.size() < cache_limit)
+			cache.blocks.push_back(data);
+		else
+			push_shared(header_of(data)->index);
+	}
+	return slab + header_size;
+}
+
+uint8_t* packet_buffer_pool::acquire()
+{
+	thread_cache &cache = local_cache();
+	if (cache.blocks.empty())
+	{
+		for (uint32_t i = 0; i < cache_refill; i++)
+		{
+			uint32_t index = pop_shared(cache.node);
+			if (index == empty_index)
+				break;
+			cache.blocks.push_back(block_of(index) + header_size);
+		}
+	}
+
+	if (cache.blocks.empty())
+		return grow(cache);
+
+	uint8_t *data = cache.blocks.back();
+	cache.blocks.pop_back();
+	return data;
+}
+
+void packet_buffer_pool::release(uint8_t *data)
+{
+	thread_cache &cache = local_cache();
+	uint32_t index = header_of(data)->index;
+	if (slab_nodes[index / blocks_per_slab] != cache.node)
+	{
+		// Received on one node and released on another, send it home instead of reusing it here
+		push_shared(index);
+		return;
+	}
+
+	if (cache.blocks.size() < cache_limit)
+	{
+		cache.blocks.push_back(data);
+		return;
+	}
+
+	// Receive and processing usually run on different threads, keep the cache at half and share the rest
+	while (cache.blocks.size() > cache_limit / 2)
+	{
+		push_shared(header_of(cache.blocks.back())->index);
+		cache.blocks.pop_back();
+	}
+	cache.blocks.push_back(data);
+}
+
+void packet_buffer_deleter::operator()(uint8_t *ptr) const
+{
+	if (ptr == nullptr)
+		return;
+	if (pooled)
+		packet_buffer_pool::instance().release(ptr);
+	else
+		delete[] ptr;
+}
+
+packet_buffer make_packet_buffer(size_t size)
+{
+	if (size <= packet_buffer_block_size)
+	{
+		if (uint8_t *data = packet_buffer_pool::instance().acquire(); data != nullptr)
+			return packet_buffer(data, packet_buffer_deleter(true));
+	}
+	return packet_buffer(new uint8_t[size]());
+}
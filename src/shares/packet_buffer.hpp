@@ -0,0 +1,31 @@
+#pragma once
+
+#ifndef __PACKET_BUFFER_HPP__
+#define __PACKET_BUFFER_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// One pool block holds a full datagram (2048 bytes) plus the 128 bytes of headroom that handlers use to grow data in place
+constexpr size_t packet_buffer_block_size = 2048u + 128u;
+
+// Buffers coming from the pool go back to it, everything else is released with delete[]
+// Converting from std::default_delete keeps plain std::make_unique<uint8_t[]> buffers usable everywhere
+struct packet_buffer_deleter
+{
+	bool pooled = false;
+
+	packet_buffer_deleter() = default;
+	packet_buffer_deleter(std::default_delete<uint8_t[]>) {}
+	explicit packet_buffer_deleter(bool from_pool) : pooled(from_pool) {}
+
+	void operator()(uint8_t *ptr) const;
+};
+
+using packet_buffer = std::unique_ptr<uint8_t[], packet_buffer_deleter>;
+
+// Sizes up to packet_buffer_block_size are served from the pool and are not zero-filled
+packet_buffer make_packet_buffer(size_t size);
+
+#endif // !__PACKET_BUFFER_HPP__
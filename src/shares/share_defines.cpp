@@ -6,6 +6,14 @@
 #include "share_defines.hpp"
 #include "string_utils.hpp"
 #include "configurations.hpp"
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(__FreeBSD__)
+#include <pthread.h>
+#include <pthread_np.h>
+#include <sys/cpuset.h>
+#endif
 
 user_settings parse_from_args(const std::vector<std::string> &args, std::vector<std::string> &error_msg)
 {
@@ -141,3 +149,40 @@ std::string to_speed_unit(size_t value, size_t duration_seconds)
 
 	return (std::to_string((value_per_second / 1024 / 1024 / 1024)) + " GiB/s");
 }
+
+bool set_thread_affinity(std::thread::native_handle_type thread_handle, const std::vector<uint16_t> &cpu_list)
+{
+	if (cpu_list.empty())
+		return false;
+#if defined(__linux__)
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	for (uint16_t cpu_number : cpu_list)
+	{
+		if (cpu_number < CPU_SETSIZE)
+			CPU_SET(cpu_number, &cpu_set);
+	}
+	return pthread_setaffinity_np(thread_handle, sizeof(cpu_set), &cpu_set) == 0;
+#elif defined(__FreeBSD__)
+	cpuset_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	for (uint16_t cpu_number : cpu_list)
+	{
+		if (cpu_number < CPU_SETSIZE)
+			CPU_SET(cpu_number, &cpu_set);
+	}
+	return pthread_setaffinity_np(thread_handle, sizeof(cpu_set), &cpu_set) == 0;
+#else
+	return false;
+#endif
+}
+
+bool set_current_thread_affinity(const std::vector<uint16_t> &cpu_list)
+{
+#if defined(__linux__) || defined(__FreeBSD__)
+	return set_thread_affinity(pthread_self(), cpu_list);
+#else
+	return false;
+#endif
+}
+
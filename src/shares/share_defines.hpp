@@ -15,11 +15,13 @@
 #include <sstream>
 #include <numeric>
 #include <memory>
+#include <thread>
 #include <vector>
 #include <filesystem>
 #ifdef __cpp_lib_format
 #include <format>
 #endif
+#include "packet_buffer.hpp"
 
 constexpr std::string_view app_name = "kcptube";
 
@@ -153,7 +155,28 @@ struct user_settings
 	ip_only_options ip_version_only = ip_only_options::not_set;
 	int fib_ingress = -1;
 	int fib_egress = -1;
+	uint16_t udp_receive_batch = 0;
+	uint16_t udp_send_batch = 0;
+	uint32_t udp_send_latency = 0;	// microseconds
+	bool udp_gso = false;
+	bool udp_gro = false;
+	uint16_t udp_listen_shards = 0;
+	bool udp_shard_by_cpu = false;
+	bool udp_io_uring = false;
+	uint32_t busy_poll = 0;	// microseconds
+	std::vector<uint16_t> cpu_affinity_io;
+	std::vector<uint16_t> cpu_affinity_kcp_updater;
+	std::vector<uint16_t> cpu_affinity_local;
+	std::vector<uint16_t> cpu_affinity_peer;
+	std::vector<uint16_t> cpu_affinity_sender;
 	bool blast = 1;
+	uint16_t io_threads = 0;
+	uint16_t local_threads = 0;
+	uint16_t peer_threads = 0;
+	uint16_t sender_threads = 0;
+	uint16_t kcp_updater_threads = 0;
+	bool isolated_pools = false;
+	bool run_to_completion = false;
 	bool ignore_listen_address = false;
 	bool ignore_listen_port = false;
 	bool ignore_destination_address = false;
@@ -200,5 +223,7 @@ void print_ip_to_file(const std::string &message, const std::filesystem::path &l
 void print_message_to_file(const std::string &message, const std::filesystem::path &log_file);
 void print_status_to_file(const std::string &message, const std::filesystem::path &log_file);
 std::string to_speed_unit(size_t value, size_t duration_seconds);
+bool set_thread_affinity(std::thread::native_handle_type thread_handle, const std::vector<uint16_t> &cpu_list);
+bool set_current_thread_affinity(const std::vector<uint16_t> &cpu_list);
 
 #endif // !_SHARE_HEADER_